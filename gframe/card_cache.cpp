@@ -0,0 +1,172 @@
+#include "config.h"
+#include "card_cache.h"
+#include "myfilesystem.h"
+
+namespace ygo {
+
+// FNV-1a
+uint64_t CardCache::Hash(const unsigned char* data, size_t len) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= data[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+std::wstring CardCache::GetCachePath(const wchar_t* source) {
+	char file[1024];
+	int len = BufferIO::EncodeUTF8(source, file);
+	wchar_t path[256];
+	myswprintf(path, L"./cache/%016llx.cdbc", (unsigned long long)Hash(reinterpret_cast<unsigned char*>(file), len));
+	return path;
+}
+/*
+* Removes the cache files whose cdb on disk was removed or renamed.
+* The caches of the cdbs in archives and the files of other versions are kept, another instance may still use them.
+*/
+void CardCache::RemoveStale() {
+	FileSystem::TraversalDir(L"./cache", [](const wchar_t* name, bool isdir) {
+		size_t len = std::wcslen(name);
+		if (isdir || len < 5 || std::wcscmp(name + len - 5, L".cdbc"))
+			return;
+		std::wstring path(L"./cache/");
+		path.append(name);
+		FILE* fp = mywfopen(path.c_str(), "rb");
+		if (!fp)
+			return;
+		CardCacheHeader cache_header;
+		bool is_read = std::fread(&cache_header, sizeof cache_header, 1, fp) == 1;
+		std::fclose(fp);
+		if (!is_read || cache_header.id != CACHE_ID || cache_header.version != CACHE_VERSION)
+			return;
+		cache_header.source[sizeof cache_header.source - 1] = 0;
+		uint64_t size = 0;
+		int64_t mtime = 0;
+		if (cache_header.source[0] && !FileSystem::GetFileInfo(cache_header.source, size, mtime))
+			FileSystem::RemoveFile(path.c_str());
+	});
+}
+// Maps the cache file, if it belongs to the cdb with this hash and size.
+bool CardCache::Open(const wchar_t* path, uint64_t source_hash, uint64_t source_size) {
+	auto file = std::make_shared<MappedFile>();
+	if (!file->Open(path) || !SetView(file->data(), file->size()))
+		return false;
+	if (header->source_hash != source_hash || header->source_size != source_size) {
+		SetView(nullptr, 0);
+		return false;
+	}
+	mapped_file = file;
+	return true;
+}
+void CardCache::AddCard(const CardDataC& data, const char* name, const char* text, const char* const desc[16]) {
+	if (new_strings.empty())
+		new_strings.assign(2, 0);
+	CardCacheEntry entry;
+	entry.data = data;
+	entry.name = AddString(name);
+	entry.text = AddString(text);
+	for (int i = 0; i < 16; ++i)
+		entry.desc[i] = AddString(desc[i]);
+	new_entries.push_back(entry);
+}
+// Lays the added cards out as a cache file in memory.
+void CardCache::Finish(uint64_t source_hash, uint64_t source_size, const char* source) {
+	if (new_strings.empty())
+		new_strings.assign(2, 0);
+	CardCacheHeader cache_header;
+	cache_header.id = CACHE_ID;
+	cache_header.version = CACHE_VERSION;
+	cache_header.char_size = sizeof(wchar_t);
+	cache_header.count = (uint32_t)new_entries.size();
+	cache_header.source_hash = source_hash;
+	cache_header.source_size = source_size;
+	if (source)
+		std::strncpy(cache_header.source, source, sizeof cache_header.source - 1);
+	size_t entries_size = new_entries.size() * sizeof(CardCacheEntry);
+	cache_header.strings_offset = (sizeof(CardCacheHeader) + entries_size + 7) & ~(uint64_t)7;
+	cache_header.strings_length = new_strings.size();
+	mapped_file.reset();
+	buffer.assign((size_t)cache_header.strings_offset + new_strings.size() * sizeof(wchar_t), 0);
+	std::memcpy(buffer.data(), &cache_header, sizeof cache_header);
+	if (entries_size)
+		std::memcpy(buffer.data() + sizeof cache_header, new_entries.data(), entries_size);
+	std::memcpy(buffer.data() + cache_header.strings_offset, new_strings.data(), new_strings.size() * sizeof(wchar_t));
+	std::vector<CardCacheEntry>().swap(new_entries);
+	std::vector<wchar_t>().swap(new_strings);
+	SetView(buffer.data(), buffer.size());
+}
+// Writes a new file in place of the old one, which may still be mapped by another instance.
+bool CardCache::Save(const wchar_t* path) const {
+	if (buffer.empty())
+		return false;
+	// another thread may create the directory at the same time
+	if (!FileSystem::IsDirExists(L"./cache") && !FileSystem::MakeDir(L"./cache") && !FileSystem::IsDirExists(L"./cache"))
+		return false;
+	std::wstring temp_path(path);
+	temp_path.append(L".tmp");
+	FILE* fp = mywfopen(temp_path.c_str(), "wb");
+	if (!fp)
+		return false;
+	bool written = std::fwrite(buffer.data(), buffer.size(), 1, fp) == 1;
+	written = (std::fclose(fp) == 0) && written;
+	if (written) {
+		FileSystem::RemoveFile(path);
+		written = FileSystem::Rename(temp_path.c_str(), path);
+	}
+	if (!written)
+		FileSystem::RemoveFile(temp_path.c_str());
+	return written;
+}
+// Decodes the string at the end of the table, it has at most one wchar_t per byte.
+uint32_t CardCache::AddString(const char* str) {
+	if (!str)
+		return NULL_STRING;
+	if (!str[0])
+		return EMPTY_STRING;
+	size_t len = std::strlen(str);
+	auto offset = (uint32_t)new_strings.size();
+	new_strings.resize(offset + len + 1);
+	int count = BufferIO::DecodeUTF8String(str, &new_strings[offset], len + 1);
+	if (count == 0) {
+		new_strings.resize(offset);
+		return EMPTY_STRING;
+	}
+	new_strings.resize(offset + count + 1);
+	return offset;
+}
+// Checks that the header, entries and strings fit in the data, a truncated file is rejected.
+bool CardCache::SetView(const unsigned char* view, size_t len) {
+	header = nullptr;
+	entries = nullptr;
+	strings = nullptr;
+	if (!view || len < sizeof(CardCacheHeader))
+		return false;
+	auto cache_header = reinterpret_cast<const CardCacheHeader*>(view);
+	if (cache_header->id != CACHE_ID || cache_header->version != CACHE_VERSION || cache_header->char_size != sizeof(wchar_t))
+		return false;
+	uint64_t entries_end = sizeof(CardCacheHeader) + (uint64_t)cache_header->count * sizeof(CardCacheEntry);
+	uint64_t strings_offset = cache_header->strings_offset;
+	uint64_t strings_length = cache_header->strings_length;
+	if (strings_offset < entries_end || strings_offset > len || strings_offset % alignof(wchar_t) != 0)
+		return false;
+	if (strings_length < 2 || strings_length > (len - strings_offset) / sizeof(wchar_t))
+		return false;
+	auto cache_entries = reinterpret_cast<const CardCacheEntry*>(view + sizeof(CardCacheHeader));
+	auto cache_strings = reinterpret_cast<const wchar_t*>(view + strings_offset);
+	if (cache_strings[NULL_STRING] != 0 || cache_strings[EMPTY_STRING] != 0 || cache_strings[strings_length - 1] != 0)
+		return false;
+	for (uint32_t i = 0; i < cache_header->count; ++i) {
+		const auto& entry = cache_entries[i];
+		bool is_valid = entry.name < strings_length && entry.text < strings_length;
+		for (int j = 0; j < 16; ++j)
+			is_valid = is_valid && entry.desc[j] < strings_length;
+		if (!is_valid)
+			return false;
+	}
+	header = cache_header;
+	entries = cache_entries;
+	strings = cache_strings;
+	return true;
+}
+
+}
@@ -0,0 +1,85 @@
+#ifndef CARD_CACHE_H
+#define CARD_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "data_manager.h"
+
+class MappedFile;
+
+namespace ygo {
+
+struct CardCacheHeader {
+	uint32_t id{};
+	uint32_t version{};
+	uint32_t char_size{};		// sizeof(wchar_t) of the writer
+	uint32_t count{};
+	uint64_t source_hash{};
+	uint64_t source_size{};
+	uint64_t strings_offset{};
+	uint64_t strings_length{};	// in wchar_t
+	char source[256]{};		// UTF-8 path of the cdb on disk, empty for a cdb in an archive
+};
+
+struct CardCacheEntry {
+	CardDataC data;
+	// offsets in the string table, see CardCache::NULL_STRING
+	uint32_t name{};
+	uint32_t text{};
+	uint32_t desc[16]{};
+};
+
+/*
+* The cards of one cdb as a flat file in ./cache, so the database is parsed only when it changes.
+* Layout: CardCacheHeader, CardCacheEntry[count], the decoded strings.
+* The file belongs to a cdb while the hash and size of the cdb match the header.
+* A file is named after the path of its cdb and is removed once that cdb no longer exists, see RemoveStale.
+*/
+class CardCache {
+public:
+	static constexpr uint32_t CACHE_ID = 0x62646379;	// "ycdb"
+	static constexpr uint32_t CACHE_VERSION = 3;
+	// the string table starts with a NULL column and an empty string, both read as ""
+	static constexpr uint32_t NULL_STRING = 0;
+	static constexpr uint32_t EMPTY_STRING = 1;
+
+	static uint64_t Hash(const unsigned char* data, size_t len);
+	static std::wstring GetCachePath(const wchar_t* source);
+	static void RemoveStale();
+
+	bool Open(const wchar_t* path, uint64_t source_hash, uint64_t source_size);
+	void AddCard(const CardDataC& data, const char* name, const char* text, const char* const desc[16]);
+	// source is the path recorded for RemoveStale, nullptr for a cdb that is not a file on disk
+	void Finish(uint64_t source_hash, uint64_t source_size, const char* source);
+	bool Save(const wchar_t* path) const;
+
+	size_t size() const {
+		return header ? header->count : 0;
+	}
+	const CardCacheEntry& GetEntry(size_t index) const {
+		return entries[index];
+	}
+	const wchar_t* GetString(uint32_t offset) const {
+		return strings + offset;
+	}
+
+private:
+	uint32_t AddString(const char* str);
+	bool SetView(const unsigned char* data, size_t len);
+
+	std::shared_ptr<MappedFile> mapped_file;
+	std::vector<unsigned char> buffer;
+	// the cards added since the last Finish
+	std::vector<CardCacheEntry> new_entries;
+	std::vector<wchar_t> new_strings;
+
+	const CardCacheHeader* header{};
+	const CardCacheEntry* entries{};
+	const wchar_t* strings{};
+};
+
+}
+
+#endif //CARD_CACHE_H
@@ -357,6 +357,16 @@ void ClientField::UpdateFieldCard(int controler, int location, unsigned char* da
 		data += len - 4;
 	}
 }
+void ClientField::UpdateFieldDelta(int controler, int location, unsigned char* data) {
+	int count = BufferIO::Read<uint8_t>(data);
+	for(int i = 0; i < count; ++i) {
+		int sequence = BufferIO::Read<uint8_t>(data);
+		int32_t len;
+		std::memcpy(&len, data, sizeof len);
+		UpdateCard(controler, location, sequence, data);
+		data += len;
+	}
+}
 void ClientField::ClearCommandFlag() {
 	for(auto cit = activatable_cards.begin(); cit != activatable_cards.end(); ++cit)
 		(*cit)->cmdFlag = 0;
@@ -1534,11 +1544,10 @@ void ClientField::UpdateDeclarableList() {
 	int trycode = BufferIO::GetVal(pname);
 	CardData cd;
 	if (dataManager.GetData(trycode, &cd) && is_declarable(cd, declare_opcodes)) {
-		auto& _strings = dataManager.GetStringTable();
-		auto it = _strings.find(trycode);
+		auto pointer = dataManager.GetCodePointer(trycode);
 		mainGame->lstANCard->clear();
 		ancard.clear();
-		mainGame->lstANCard->addItem(it->second.name.c_str());
+		mainGame->lstANCard->addItem(dataManager.GetCardName(pointer.index));
 		ancard.push_back(trycode);
 		return;
 	}
@@ -1548,22 +1557,18 @@ void ClientField::UpdateDeclarableList() {
 	}
 	mainGame->lstANCard->clear();
 	ancard.clear();
-	auto& _datas = dataManager.GetDataTable();
-	auto& _strings = dataManager.GetStringTable();
-	for(auto& entry : _strings) {
-		auto& code = entry.first;
-		auto& str = entry.second;
-		if(str.name.find(pname) != std::wstring::npos) {
-			auto cp = _datas.find(code);
-			if (cp == _datas.end())
-				continue;
+	for(uint32_t i = 0; i < dataManager.GetCardCount(); ++i) {
+		auto& data = dataManager.GetCardData(i);
+		const wchar_t* name = dataManager.GetCardName(i);
+		auto code = data.code;
+		if(std::wcsstr(name, pname)) {
 			//datas.alias can be double card names or alias
-			if(is_declarable(cp->second, declare_opcodes)) {
-				if(pname == str.name || trycode == code) { //exact match or last used
-					mainGame->lstANCard->insertItem(0, str.name.c_str(), -1);
+			if(is_declarable(data, declare_opcodes)) {
+				if(!std::wcscmp(pname, name) || trycode == code) { //exact match or last used
+					mainGame->lstANCard->insertItem(0, name, -1);
 					ancard.insert(ancard.begin(), code);
 				} else {
-					mainGame->lstANCard->addItem(str.name.c_str());
+					mainGame->lstANCard->addItem(name);
 					ancard.push_back(code);
 				}
 			}
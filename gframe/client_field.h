@@ -102,6 +102,7 @@ public:
 	ClientCard* RemoveCard(int controler, int location, int sequence);
 	void UpdateCard(int controler, int location, int sequence, unsigned char* data);
 	void UpdateFieldCard(int controler, int location, unsigned char* data);
+	void UpdateFieldDelta(int controler, int location, unsigned char* data);
 	void ClearCommandFlag();
 	void ClearSelect();
 	void ClearChainSelect();
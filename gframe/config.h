@@ -26,6 +26,7 @@
 #else //_WIN32
 
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <arpa/inet.h>
@@ -50,6 +51,7 @@
 #include <iostream>
 #include <algorithm>
 #include <string>
+#include <mutex>
 #include "bufferio.h"
 #include "../ocgcore/ocgapi.h"
 
@@ -78,6 +80,24 @@ inline FILE* mywfopen(const wchar_t* filename, const char* mode) {
 
 #define myfopen std::fopen
 
+// ocgcore keeps every duel in a process-wide set without a lock, so duels are created and ended under this mutex
+inline std::mutex& duel_set_mutex() {
+	static std::mutex mutex;
+	return mutex;
+}
+inline intptr_t mycreate_duel(uint32_t seed) {
+	std::lock_guard<std::mutex> lock(duel_set_mutex());
+	return create_duel(seed);
+}
+inline intptr_t mycreate_duel_v2(uint32_t seed_sequence[]) {
+	std::lock_guard<std::mutex> lock(duel_set_mutex());
+	return create_duel_v2(seed_sequence);
+}
+inline void myend_duel(intptr_t pduel) {
+	std::lock_guard<std::mutex> lock(duel_set_mutex());
+	end_duel(pduel);
+}
+
 #include <irrlicht.h>
 
 constexpr uint16_t PRO_VERSION = 0x1000;
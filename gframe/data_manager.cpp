@@ -1,35 +1,42 @@
 #include "data_manager.h"
 #include "game.h"
+#include "card_cache.h"
+#include "myfilesystem.h"
 #include "spmemvfs/spmemvfs.h"
+#include <lua.h>
+#include <lauxlib.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 namespace ygo {
 
-unsigned char DataManager::scriptBuffer[0x100000] = {};
+std::mutex DataManager::fs_mutex;
+std::mutex DataManager::script_mutex;
+std::unordered_map<std::string, std::shared_ptr<const DataManager::CachedScript>> DataManager::script_cache;
+std::unordered_set<std::string> DataManager::missing_scripts;
 DataManager dataManager;
 
-DataManager::DataManager() : _datas(32768), _strings(32768) {
+DataManager::DataManager() {
 	extra_setcode = { 
 		{8512558u, {0x8f, 0x54, 0x59, 0x82, 0x13a}},
 		{55088578u, {0x8f, 0x54, 0x59, 0x82, 0x13a}},
 	};
 }
-bool DataManager::ReadDB(sqlite3* pDB, bool is_diy) {
+DataManager::~DataManager() = default;
+bool DataManager::ReadDB(sqlite3* pDB, CardCache& cache) {
 	sqlite3_stmt* pStmt = nullptr;
 	const char* sql = "select * from datas,texts where datas.id=texts.id";
 	if (sqlite3_prepare_v2(pDB, sql, -1, &pStmt, nullptr) != SQLITE_OK)
 		return Error(pDB, pStmt);
-	wchar_t strBuffer[4096];
 
 	// EFCG cdb
 	//datas : id,alias,setcode,type,value,atk,move,race,from
-	uint32_t allow = is_diy ? ALLOW_DIY : ALLOW_EFCG;
 	for (int step = sqlite3_step(pStmt); step != SQLITE_DONE; step = sqlite3_step(pStmt)) {
 		if (step != SQLITE_ROW)
 			return Error(pDB, pStmt);
-		uint32_t code = static_cast<uint32_t>(sqlite3_column_int64(pStmt, 0));
-		auto& cd = _datas[code];
-		cd.allow = allow;
-		cd.code = code;
+		CardDataC cd;
+		cd.code = static_cast<uint32_t>(sqlite3_column_int64(pStmt, 0));
 		cd.alias = sqlite3_column_int(pStmt, 1);
 		uint64_t setcode = static_cast<uint64_t>(sqlite3_column_int64(pStmt, 2));
 		write_setcode(cd.setcode, setcode);
@@ -45,63 +52,198 @@ bool DataManager::ReadDB(sqlite3* pDB, bool is_diy) {
 		cd.move = sqlite3_column_int(pStmt, 6);
 		cd.race = static_cast<decltype(cd.race)>(sqlite3_column_int64(pStmt, 7));
 		cd.from = static_cast<decltype(cd.from)>(sqlite3_column_int64(pStmt, 8));
-		auto& cs = _strings[code];
-		if (const char* text = (const char*)sqlite3_column_text(pStmt, 10)) {
-			BufferIO::DecodeUTF8(text, strBuffer);
-			cs.name = strBuffer;
+		const char* desc[16];
+		for (int i = 0; i < 16; ++i)
+			desc[i] = (const char*)sqlite3_column_text(pStmt, i + 12);
+		cache.AddCard(cd, (const char*)sqlite3_column_text(pStmt, 10), (const char*)sqlite3_column_text(pStmt, 11), desc);
+	}
+	sqlite3_finalize(pStmt);
+	return true;
+}
+/*
+* Merges the cards of a cache into the card table, the cache is kept for the text of its cards.
+* A card replaces the data of the one with the same code of an earlier database, or an earlier row of the same database.
+* The name, text and descriptions of the earlier card are kept where the new row is NULL.
+*/
+void DataManager::AddCards(std::unique_ptr<CardCache> cache_ptr, bool is_diy) {
+	const CardCache& cache = *cache_ptr;
+	auto cache_index = (uint32_t)_caches.size();
+	std::vector<uint32_t> added(cache.size());
+	for (uint32_t i = 0; i < added.size(); ++i)
+		added[i] = i;
+	std::stable_sort(added.begin(), added.end(), [&cache](uint32_t l, uint32_t r) {
+		return cache.GetEntry(l).data.code < cache.GetEntry(r).data.code;
+	});
+	std::vector<uint32_t> codes;
+	std::vector<CardDataC> datas;
+	std::vector<CardString> strings;
+	codes.reserve(_codes.size() + added.size());
+	datas.reserve(_codes.size() + added.size());
+	strings.reserve(_codes.size() + added.size());
+	uint32_t allow = is_diy ? ALLOW_DIY : ALLOW_EFCG;
+	size_t i = 0;
+	for (size_t j = 0; j < added.size(); ++j) {
+		const auto& entry = cache.GetEntry(added[j]);
+		uint32_t code = entry.data.code;
+		for (; i < _codes.size() && _codes[i] < code; ++i) {
+			codes.push_back(_codes[i]);
+			datas.push_back(_datas[i]);
+			strings.push_back(std::move(_strings[i]));
 		}
-		if (const char* text = (const char*)sqlite3_column_text(pStmt, 11)) {
-			BufferIO::DecodeUTF8(text, strBuffer);
-			cs.text = strBuffer;
+		CardString previous;
+		bool is_replaced = false;
+		if (!codes.empty() && codes.back() == code) {
+			previous = strings.back();
+			codes.pop_back();
+			datas.pop_back();
+			strings.pop_back();
+			is_replaced = true;
+		} else if (i < _codes.size() && _codes[i] == code) {
+			previous = _strings[i];
+			++i;
+			is_replaced = true;
 		}
-		constexpr int desc_count = sizeof cs.desc / sizeof cs.desc[0];
-		for (int i = 0; i < desc_count; ++i) {
-			if (const char* text = (const char*)sqlite3_column_text(pStmt, i + 12)) {
-				BufferIO::DecodeUTF8(text, strBuffer);
-				cs.desc[i] = strBuffer;
+		codes.push_back(code);
+		datas.push_back(entry.data);
+		datas.back().allow = allow;
+		strings.emplace_back();
+		auto& cs = strings.back();
+		if (is_replaced && entry.name == CardCache::NULL_STRING)
+			cs.name = previous.name;
+		else
+			cs.name = _arena.Add(cache.GetString(entry.name));
+		cs.cache = cache_index;
+		cs.entry = added[j];
+		if (is_replaced) {
+			bool has_null = entry.text == CardCache::NULL_STRING;
+			for (int k = 0; k < 16; ++k)
+				has_null = has_null || entry.desc[k] == CardCache::NULL_STRING;
+			if (has_null) {
+				cs.shadowed = (uint32_t)_shadowed.size();
+				_shadowed.push_back(previous);
 			}
 		}
 	}
-	sqlite3_finalize(pStmt);
+	for (; i < _codes.size(); ++i) {
+		codes.push_back(_codes[i]);
+		datas.push_back(_datas[i]);
+		strings.push_back(std::move(_strings[i]));
+	}
+	_codes.swap(codes);
+	_datas.swap(datas);
+	_strings.swap(strings);
+	_caches.push_back(std::move(cache_ptr));
 	for (const auto& entry : extra_setcode) {
 		const auto& code = entry.first;
 		const auto& list = entry.second;
 		if (list.size() > SIZE_SETCODE || list.empty())
 			continue;
-		auto it = _datas.find(code);
-		if (it == _datas.end())
+		auto pointer = GetCodePointer(code);
+		if (!pointer)
 			continue;
-		std::memcpy(it->second.setcode, list.data(), list.size() * sizeof(uint16_t));
+		std::memcpy(_datas[pointer.index].setcode, list.data(), list.size() * sizeof(uint16_t));
 	}
-	return true;
 }
 bool DataManager::LoadDB(const wchar_t* wfile) {
+	if (_sealed)
+		return false;
+	spmemvfs_env_init();
+	auto cache = ReadCardCache(wfile, 0);
+	spmemvfs_env_fini();
+	if (!cache)
+		return false;
+	AddCards(std::move(cache), std::wcscmp(wfile, L"cards.cdb") != 0);
+	return true;
+}
+/*
+* Reads the cdbs on a pool of threads, and then adds them in the order of the list,
+* so a later file still replaces the cards of an earlier one.
+*/
+void DataManager::LoadDBs(const std::vector<std::wstring>& files) {
+	if (_sealed)
+		return;
+	std::vector<std::unique_ptr<CardCache>> caches(files.size());
+	std::atomic<size_t> next{};
+	auto worker = [&]() {
+		for (size_t i = next++; i < files.size(); i = next++)
+			caches[i] = ReadCardCache(files[i].c_str(), (unsigned int)i);
+	};
+	size_t thread_count = std::min<size_t>(std::max(1U, std::thread::hardware_concurrency()), files.size());
+	spmemvfs_env_init();
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < thread_count; ++i)
+		threads.emplace_back(worker);
+	worker();
+	for (auto& thread : threads)
+		thread.join();
+	spmemvfs_env_fini();
+	for (size_t i = 0; i < files.size(); ++i) {
+		if (!caches[i])
+			continue;
+		AddCards(std::move(caches[i]), std::wcscmp(files[i].c_str(), L"cards.cdb") != 0);
+	}
+}
+// The databases are loaded, so the caches of the removed ones can go.
+void DataManager::Seal() {
+	if (_sealed)
+		return;
+	_sealed = true;
+	CardCache::RemoveStale();
+}
+/*
+* Reads the cards of a cdb from its cache in ./cache while the cdb is unchanged,
+* otherwise from the database, and then writes the cache again.
+* The memory vfs must be initialized, and files read at the same time need a different serial.
+*/
+std::unique_ptr<CardCache> DataManager::ReadCardCache(const wchar_t* wfile, unsigned int serial) {
 	char file[256];
 	BufferIO::EncodeUTF8(wfile, file);
+	spmembuffer_t* mem = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(fs_mutex);
 #ifdef _WIN32
-	auto reader = FileSystem->createAndOpenFile(wfile);
+		auto reader = FileSystem->createAndOpenFile(wfile);
 #else
-	auto reader = FileSystem->createAndOpenFile(file);
+		auto reader = FileSystem->createAndOpenFile(file);
 #endif
-	if(reader == nullptr)
-		return false;
+		if(reader == nullptr)
+			return nullptr;
+		mem = (spmembuffer_t*)std::calloc(sizeof(spmembuffer_t), 1);
+		mem->total = mem->used = reader->getSize();
+		mem->data = (char*)std::malloc(mem->total);
+		reader->read(mem->data, mem->total);
+		reader->drop();
+	}
+	uint64_t hash = CardCache::Hash(reinterpret_cast<unsigned char*>(mem->data), mem->total);
+	uint64_t size = mem->total;
+	std::wstring cache_path = CardCache::GetCachePath(wfile);
+	auto cache = std::make_unique<CardCache>();
+	if (cache->Open(cache_path.c_str(), hash, size)) {
+		std::free(mem->data);
+		std::free(mem);
+		return cache;
+	}
+	// the memory vfs finds the buffer by the name of the database
+	char db_name[300];
+	mysnprintf(db_name, "%u:%s", serial, file);
 	spmemvfs_db_t db;
-	spmembuffer_t* mem = (spmembuffer_t*)std::calloc(sizeof(spmembuffer_t), 1);
-	spmemvfs_env_init();
-	mem->total = mem->used = reader->getSize();
-	mem->data = (char*)std::malloc(mem->total);
-	reader->read(mem->data, mem->total);
-	reader->drop();
 	bool ret{};
-	if (spmemvfs_open_db(&db, file, mem) != SQLITE_OK)
+	if (spmemvfs_open_db(&db, db_name, mem) != SQLITE_OK)
 		ret = Error(db.handle);
-	else {
-		bool is_diy = std::wcscmp(wfile, L"cards.cdb") != 0;
-		ret = ReadDB(db.handle, is_diy);
-	}
+	else
+		ret = ReadDB(db.handle, *cache);
 	spmemvfs_close_db(&db);
-	spmemvfs_env_fini();
-	return ret;
+	if (!ret)
+		return nullptr;
+	// a cdb in an archive is not on disk, and its cache is never removed
+	uint64_t file_size = 0;
+	int64_t file_mtime = 0;
+	cache->Finish(hash, size, ::FileSystem::GetFileInfo(file, file_size, file_mtime) ? file : nullptr);
+	// use the saved file, so that the text is not kept in memory
+	auto saved = std::make_unique<CardCache>();
+	if (cache->Save(cache_path.c_str()) && saved->Open(cache_path.c_str(), hash, size))
+		return saved;
+	return cache;
 }
 bool DataManager::LoadStrings(const char* file) {
 	FILE* fp = myfopen(file, "r");
@@ -134,33 +276,29 @@ void DataManager::ReadStringConfLine(const char* linebuf) {
 		return;
 	char strbuf[TEXT_LINE_SIZE]{};
 	int value{};
-	wchar_t strBuffer[4096]{};
 	if (std::sscanf(linebuf, "!%63s", strbuf) != 1)
 		return;
 	if(!std::strcmp(strbuf, "system")) {
 		if (std::sscanf(&linebuf[7], "%d %240[^\n]", &value, strbuf) != 2)
 			return;
-		BufferIO::DecodeUTF8(strbuf, strBuffer);
-		_sysStrings[value] = strBuffer;
+		_sysStrings[value] = _arena.AddUTF8(strbuf);
 	} else if(!std::strcmp(strbuf, "victory")) {
 		if (std::sscanf(&linebuf[8], "%x %240[^\n]", &value, strbuf) != 2)
 			return;
-		BufferIO::DecodeUTF8(strbuf, strBuffer);
-		_victoryStrings[value] = strBuffer;
+		_victoryStrings[value] = _arena.AddUTF8(strbuf);
 	} else if(!std::strcmp(strbuf, "counter")) {
 		if (std::sscanf(&linebuf[8], "%x %240[^\n]", &value, strbuf) != 2)
 			return;
-		BufferIO::DecodeUTF8(strbuf, strBuffer);
-		_counterStrings[value] = strBuffer;
+		_counterStrings[value] = _arena.AddUTF8(strbuf);
 	} else if(!std::strcmp(strbuf, "setname")) {
 		//using tab for comment
 		if (std::sscanf(&linebuf[8], "%x %240[^\t\n]", &value, strbuf) != 2)
 			return;
-		BufferIO::DecodeUTF8(strbuf, strBuffer);
-		_setnameStrings[value] = strBuffer;
+		_setnameStrings[value] = _arena.AddUTF8(strbuf);
 	}
 }
 bool DataManager::Error(sqlite3* pDB, sqlite3_stmt* pStmt) {
+	std::lock_guard<std::mutex> lock(errmsg_mutex);
 	if (const char* msg = sqlite3_errmsg(pDB))
 		mysnprintf(errmsg, "%s", msg);
 	else
@@ -168,57 +306,66 @@ bool DataManager::Error(sqlite3* pDB, sqlite3_stmt* pStmt) {
 	sqlite3_finalize(pStmt);
 	return false;
 }
-code_pointer DataManager::GetCodePointer(uint32_t code) const {
-	return _datas.find(code);
+// The text (field -1) or a description of a card, its page of the cache is read on first use.
+const wchar_t* DataManager::GetCacheString(const CardString& cs, int field) const {
+	const CardString* current = &cs;
+	for (;;) {
+		const auto& cache = *_caches[current->cache];
+		const auto& entry = cache.GetEntry(current->entry);
+		uint32_t offset = field < 0 ? entry.text : entry.desc[field];
+		// a NULL column falls back to the card it replaced
+		if (offset != CardCache::NULL_STRING || current->shadowed == CardString::npos)
+			return cache.GetString(offset);
+		current = &_shadowed[current->shadowed];
+	}
 }
-string_pointer DataManager::GetStringPointer(uint32_t code) const {
-	return _strings.find(code);
+code_pointer DataManager::GetCodePointer(uint32_t code) const {
+	code_pointer pointer;
+	auto it = std::lower_bound(_codes.begin(), _codes.end(), code);
+	if (it != _codes.end() && *it == code)
+		pointer.index = (uint32_t)(it - _codes.begin());
+	return pointer;
 }
 bool DataManager::GetData(uint32_t code, CardData* pData) const {
-	auto cdit = _datas.find(code);
-	if(cdit == _datas.end())
+	auto pointer = GetCodePointer(code);
+	if (!pointer)
 		return false;
 	if (pData) {
-		std::memcpy(pData, &cdit->second, sizeof(CardData));
+		std::memcpy(pData, &_datas[pointer.index], sizeof(CardData));
 	}
 	return true;
 }
-bool DataManager::GetString(uint32_t code, CardString* pStr) const {
-	auto csit = _strings.find(code);
-	if(csit == _strings.end()) {
-		pStr->name = unknown_string;
-		pStr->text = unknown_string;
-		return false;
-	}
-	*pStr = csit->second;
-	return true;
-}
 const wchar_t* DataManager::GetName(uint32_t code) const {
-	auto csit = _strings.find(code);
-	if(csit == _strings.end())
+	auto pointer = GetCodePointer(code);
+	if (!pointer)
 		return unknown_string;
-	if(!csit->second.name.empty())
-		return csit->second.name.c_str();
+	if (_strings[pointer.index].name[0])
+		return _strings[pointer.index].name;
 	return unknown_string;
 }
 const wchar_t* DataManager::GetText(uint32_t code) const {
-	auto csit = _strings.find(code);
-	if(csit == _strings.end())
+	auto pointer = GetCodePointer(code);
+	if (!pointer)
 		return unknown_string;
-	if(!csit->second.text.empty())
-		return csit->second.text.c_str();
+	const wchar_t* text = GetCacheString(_strings[pointer.index], -1);
+	if (text[0])
+		return text;
 	return unknown_string;
 }
+const wchar_t* DataManager::GetCardText(uint32_t index) const {
+	return GetCacheString(_strings[index], -1);
+}
 const wchar_t* DataManager::GetDesc(uint32_t strCode) const {
 	if (strCode < (MIN_CARD_ID << 4))
 		return GetSysString(strCode);
 	unsigned int code = (strCode >> 4) & 0x0fffffff;
 	unsigned int offset = strCode & 0xf;
-	auto csit = _strings.find(code);
-	if(csit == _strings.end())
+	auto pointer = GetCodePointer(code);
+	if (!pointer)
 		return unknown_string;
-	if(!csit->second.desc[offset].empty())
-		return csit->second.desc[offset].c_str();
+	const wchar_t* desc = GetCacheString(_strings[pointer.index], offset);
+	if (desc[0])
+		return desc;
 	return unknown_string;
 }
 const wchar_t* DataManager::GetSysString(int code) const {
@@ -227,37 +374,38 @@ const wchar_t* DataManager::GetSysString(int code) const {
 	auto csit = _sysStrings.find(code);
 	if(csit == _sysStrings.end())
 		return unknown_string;
-	return csit->second.c_str();
+	return csit->second;
 }
 const wchar_t* DataManager::GetVictoryString(int code) const {
 	auto csit = _victoryStrings.find(code);
 	if(csit == _victoryStrings.end())
 		return unknown_string;
-	return csit->second.c_str();
+	return csit->second;
 }
 const wchar_t* DataManager::GetCounterName(int code) const {
 	auto csit = _counterStrings.find(code);
 	if(csit == _counterStrings.end())
 		return unknown_string;
-	return csit->second.c_str();
+	return csit->second;
 }
 const wchar_t* DataManager::GetSetName(int code) const {
 	auto csit = _setnameStrings.find(code);
 	if(csit == _setnameStrings.end())
 		return unknown_string;
-	return csit->second.c_str();
+	return csit->second;
 }
 std::vector<unsigned int> DataManager::GetSetCodes(std::wstring setname) const {
 	std::vector<unsigned int> matchingCodes;
 	for(auto csit = _setnameStrings.begin(); csit != _setnameStrings.end(); ++csit) {
-		auto xpos = csit->second.find_first_of(L'|');//setname|another setname or extra info
+		const std::wstring name(csit->second);
+		auto xpos = name.find_first_of(L'|');//setname|another setname or extra info
 		if(setname.size() < 2) {
-			if(csit->second.compare(0, xpos, setname) == 0
-				|| csit->second.compare(xpos + 1, csit->second.length(), setname) == 0)
+			if(name.compare(0, xpos, setname) == 0
+				|| name.compare(xpos + 1, name.length(), setname) == 0)
 				matchingCodes.push_back(csit->first);
 		} else {
-			if(csit->second.substr(0, xpos).find(setname) != std::wstring::npos
-				|| csit->second.substr(xpos + 1).find(setname) != std::wstring::npos) {
+			if(name.substr(0, xpos).find(setname) != std::wstring::npos
+				|| name.substr(xpos + 1).find(setname) != std::wstring::npos) {
 				matchingCodes.push_back(csit->first);
 			}
 		}
@@ -374,32 +522,118 @@ uint32_t DataManager::CardReader(uint32_t code, card_data* pData) {
 		pData->clear();
 	return 0;
 }
+static int WriteChunk(lua_State* L, const void* p, size_t sz, void* ud) {
+	auto chunk = static_cast<std::vector<unsigned char>*>(ud);
+	auto bytes = static_cast<const unsigned char*>(p);
+	chunk->insert(chunk->end(), bytes, bytes + sz);
+	return 0;
+}
+/*
+* Compile a script with the Lua library the core is linked with, the core loads the bytecode with luaL_loadbuffer.
+* The chunk name is the one the core uses and the debug info is kept, errors report the same lines.
+* Returns an empty chunk if the script does not compile, the core then reports the error from the source.
+*/
+static std::vector<unsigned char> CompileScript(const unsigned char* buffer, int len, const char* script_path) {
+	std::vector<unsigned char> chunk;
+	lua_State* L = luaL_newstate();
+	if (!L)
+		return chunk;
+	if (luaL_loadbuffer(L, reinterpret_cast<const char*>(buffer), len, script_path) == LUA_OK)
+		lua_dump(L, WriteChunk, &chunk, 0);
+	lua_close(L);
+	return chunk;
+}
+/*
+* Card scripts are compiled after the first read and kept in memory, so later duels neither look for them nor parse them again.
+* A script read from a loose file is read again when the size or the modification time of the file changes.
+* The scripts that were not found and the files added in a place searched before the cached one are seen after a restart.
+*/
 unsigned char* DataManager::ScriptReaderEx(const char* script_path, int* slen) {
 	// default script name: ./script/c%d.lua
 	if (std::strncmp(script_path, "./script", 8) != 0) // not a card script file
 		return ReadScriptFromFile(script_path, slen);
+	// the raw files in expansions are edited while debugging
+	bool use_cache = !mainGame->gameConf.prefer_expansion_script;
+	if (use_cache) {
+		std::shared_ptr<const CachedScript> script;
+		{
+			std::lock_guard<std::mutex> lock(script_mutex);
+			if (missing_scripts.count(script_path))
+				return nullptr;
+			auto it = script_cache.find(script_path);
+			if (it != script_cache.end())
+				script = it->second;
+		}
+		uint64_t size = 0;
+		int64_t mtime = 0;
+		if (script && (script->file.empty()
+		               || (::FileSystem::GetFileInfo(script->file.c_str(), size, mtime) && size == script->size && mtime == script->mtime))) {
+			unsigned char* buffer = GetScriptBuffer();
+			std::memcpy(buffer, script->chunk.data(), script->chunk.size());
+			*slen = (int)script->chunk.size();
+			return buffer;
+		}
+	}
+	auto script = std::make_shared<CachedScript>();
+	unsigned char* buffer = ReadCardScript(script_path, slen, &script->file);
+	if (use_cache) {
+		if (buffer) {
+			if (!script->file.empty())
+				::FileSystem::GetFileInfo(script->file.c_str(), script->size, script->mtime);
+			script->chunk = CompileScript(buffer, *slen, script_path);
+			if (script->chunk.empty() || script->chunk.size() >= SCRIPT_BUFFER_SIZE)
+				script->chunk.assign(buffer, buffer + *slen);
+			else {
+				std::memcpy(buffer, script->chunk.data(), script->chunk.size());
+				*slen = (int)script->chunk.size();
+			}
+		}
+		std::lock_guard<std::mutex> lock(script_mutex);
+		if (buffer)
+			script_cache[script_path] = std::move(script);
+		else
+			missing_scripts.insert(script_path);
+	}
+	return buffer;
+}
+unsigned char* DataManager::ReadCardScript(const char* script_path, int* slen, std::string* file) {
 	const char* script_name = script_path + 2;
 	char expansions_path[1024]{};
 	mysnprintf(expansions_path, "./expansions/%s", script_name);
 	if (mainGame->gameConf.prefer_expansion_script) { // debug script with raw file in expansions
-		if (ReadScriptFromFile(expansions_path, slen))
-			return scriptBuffer;
+		if (ReadScriptFromFile(expansions_path, slen)) {
+			*file = expansions_path;
+			return GetScriptBuffer();
+		}
 		if (ReadScriptFromIrrFS(script_name, slen))
-			return scriptBuffer;
-		if (ReadScriptFromFile(script_path, slen))
-			return scriptBuffer;
+			return GetScriptBuffer();
+		if (ReadScriptFromFile(script_path, slen)) {
+			*file = script_path;
+			return GetScriptBuffer();
+		}
 	} else {
 		if (ReadScriptFromIrrFS(script_name, slen))
-			return scriptBuffer;
-		if (ReadScriptFromFile(script_path, slen))
-			return scriptBuffer;
-		if (ReadScriptFromFile(expansions_path, slen))
-			return scriptBuffer;
+			return GetScriptBuffer();
+		if (ReadScriptFromFile(script_path, slen)) {
+			*file = script_path;
+			return GetScriptBuffer();
+		}
+		if (ReadScriptFromFile(expansions_path, slen)) {
+			*file = expansions_path;
+			return GetScriptBuffer();
+		}
 	}
 
 	return nullptr;
 }
+unsigned char* DataManager::GetScriptBuffer() {
+	static thread_local std::vector<unsigned char> buffer;
+	if (buffer.empty())
+		buffer.resize(SCRIPT_BUFFER_SIZE);
+	return buffer.data();
+}
 unsigned char* DataManager::ReadScriptFromIrrFS(const char* script_name, int* slen) {
+	std::lock_guard<std::mutex> lock(fs_mutex);
 #ifdef _WIN32
 	wchar_t fname[256]{};
 	BufferIO::DecodeUTF8(script_name, fname);
@@ -409,97 +643,99 @@ unsigned char* DataManager::ReadScriptFromIrrFS(const char* script_name, int* sl
 #endif
 	if (!reader)
 		return nullptr;
-	int size = reader->read(scriptBuffer, sizeof scriptBuffer);
+	unsigned char* buffer = GetScriptBuffer();
+	int size = reader->read(buffer, SCRIPT_BUFFER_SIZE);
 	reader->drop();
-	if (size >= (int)sizeof scriptBuffer)
+	if (size >= (int)SCRIPT_BUFFER_SIZE)
 		return nullptr;
 	*slen = size;
-	return scriptBuffer;
+	return buffer;
 }
 unsigned char* DataManager::ReadScriptFromFile(const char* script_name, int* slen) {
 	FILE* fp = myfopen(script_name, "rb");
 	if (!fp)
 		return nullptr;
-	size_t len = std::fread(scriptBuffer, 1, sizeof scriptBuffer, fp);
+	unsigned char* buffer = GetScriptBuffer();
+	size_t len = std::fread(buffer, 1, SCRIPT_BUFFER_SIZE, fp);
 	std::fclose(fp);
-	if (len >= sizeof scriptBuffer)
+	if (len >= SCRIPT_BUFFER_SIZE)
 		return nullptr;
 	*slen = (int)len;
-	return scriptBuffer;
+	return buffer;
 }
 bool DataManager::deck_sort_energy(code_pointer p1, code_pointer p2) {
-	uint32_t type1 = p1->second.type & TYPE_MAIN;
-	if (type1 != (p2->second.type & TYPE_MAIN))
-		return type1 < (p2->second.type & TYPE_MAIN);
+	uint32_t type1 = p1->type & TYPE_MAIN;
+	if (type1 != (p2->type & TYPE_MAIN))
+		return type1 < (p2->type & TYPE_MAIN);
 	if (type1 == TYPE_MONS) {
-		if (p1->second.energy != p2->second.energy)
-			return p1->second.energy > p2->second.energy;
-		if (p1->second.atk != p2->second.atk)
-			return p1->second.atk > p2->second.atk;
+		if (p1->energy != p2->energy)
+			return p1->energy > p2->energy;
+		if (p1->atk != p2->atk)
+			return p1->atk > p2->atk;
 	}
 	else if (type1 == TYPE_AREA) {
-		if (p1->second.life != p2->second.life)
-			return p1->second.life > p2->second.life;
+		if (p1->life != p2->life)
+			return p1->life > p2->life;
 	}
 	else {
-		if ((p1->second.type & TYPE_SUB) != (p2->second.type & TYPE_SUB))
-			return (p1->second.type & TYPE_SUB) < (p2->second.type & TYPE_SUB);
-		if (p1->second.energy != p2->second.energy)
-			return p1->second.energy > p2->second.energy;
+		if ((p1->type & TYPE_SUB) != (p2->type & TYPE_SUB))
+			return (p1->type & TYPE_SUB) < (p2->type & TYPE_SUB);
+		if (p1->energy != p2->energy)
+			return p1->energy > p2->energy;
 	}
-	return p1->first < p2->first;
+	return p1->code < p2->code;
 }
 bool DataManager::deck_sort_atk(code_pointer p1, code_pointer p2) {
-	uint32_t type1 = p1->second.type & TYPE_MAIN;
-	if (type1 != (p2->second.type & TYPE_MAIN))
-		return type1 < (p2->second.type & TYPE_MAIN);
+	uint32_t type1 = p1->type & TYPE_MAIN;
+	if (type1 != (p2->type & TYPE_MAIN))
+		return type1 < (p2->type & TYPE_MAIN);
 	if (type1 == TYPE_MONS) {
-		if (p1->second.atk != p2->second.atk)
-			return p1->second.atk > p2->second.atk;
-		if (p1->second.energy != p2->second.energy)
-			return p1->second.energy > p2->second.energy;
+		if (p1->atk != p2->atk)
+			return p1->atk > p2->atk;
+		if (p1->energy != p2->energy)
+			return p1->energy > p2->energy;
 	}
 	else if (type1 == TYPE_AREA) {
-		if (p1->second.life != p2->second.life)
-			return p1->second.life > p2->second.life;
+		if (p1->life != p2->life)
+			return p1->life > p2->life;
 	}
 	else {
-		if ((p1->second.type & TYPE_SUB) != (p2->second.type & TYPE_SUB))
-			return (p1->second.type & TYPE_SUB) < (p2->second.type & TYPE_SUB);
-		if (p1->second.energy != p2->second.energy)
-			return p1->second.energy > p2->second.energy;
+		if ((p1->type & TYPE_SUB) != (p2->type & TYPE_SUB))
+			return (p1->type & TYPE_SUB) < (p2->type & TYPE_SUB);
+		if (p1->energy != p2->energy)
+			return p1->energy > p2->energy;
 	}
-	return p1->first < p2->first;
+	return p1->code < p2->code;
 }
 bool DataManager::deck_sort_life(code_pointer p1, code_pointer p2) {
-	uint32_t type1 = p1->second.type & TYPE_MAIN;
-	if (type1 != (p2->second.type & TYPE_MAIN))
-		return type1 > (p2->second.type & TYPE_MAIN);
+	uint32_t type1 = p1->type & TYPE_MAIN;
+	if (type1 != (p2->type & TYPE_MAIN))
+		return type1 > (p2->type & TYPE_MAIN);
 	if (type1 == TYPE_MONS) {
-		if (p1->second.energy != p2->second.energy)
-			return p1->second.energy > p2->second.energy;
-		if (p1->second.atk != p2->second.atk)
-			return p1->second.atk > p2->second.atk;
+		if (p1->energy != p2->energy)
+			return p1->energy > p2->energy;
+		if (p1->atk != p2->atk)
+			return p1->atk > p2->atk;
 	}
 	else if (type1 == TYPE_AREA) {
-		if (p1->second.life != p2->second.life)
-			return p1->second.life > p2->second.life;
+		if (p1->life != p2->life)
+			return p1->life > p2->life;
 	}
 	else {
-		if ((p1->second.type & TYPE_SUB) != (p2->second.type & TYPE_SUB))
-			return (p1->second.type & TYPE_SUB) < (p2->second.type & TYPE_SUB);
-		if (p1->second.energy != p2->second.energy)
-			return p1->second.energy > p2->second.energy;
+		if ((p1->type & TYPE_SUB) != (p2->type & TYPE_SUB))
+			return (p1->type & TYPE_SUB) < (p2->type & TYPE_SUB);
+		if (p1->energy != p2->energy)
+			return p1->energy > p2->energy;
 	}
-	return p1->first < p2->first;
+	return p1->code < p2->code;
 }
 bool DataManager::deck_sort_name(code_pointer p1, code_pointer p2) {
-	const wchar_t* name1 = dataManager.GetName(p1->first);
-	const wchar_t* name2 = dataManager.GetName(p2->first);
+	const wchar_t* name1 = dataManager.GetName(p1->code);
+	const wchar_t* name2 = dataManager.GetName(p2->code);
 	int res = std::wcscmp(name1, name2);
 	if (res != 0)
 		return res < 0;
-	return p1->first < p2->first;
+	return p1->code < p2->code;
 }
 
 }
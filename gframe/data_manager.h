@@ -1,11 +1,16 @@
 #ifndef DATAMANAGER_H
 #define DATAMANAGER_H
 
+#include <cstdint>
+#include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <string>
+#include <mutex>
 #include <sqlite3.h>
 #include <card_data.h>
+#include "string_arena.h"
 
 namespace irr {
 	namespace io {
@@ -16,6 +21,8 @@ namespace irr {
 
 namespace ygo {
 
+class CardCache;
+
 constexpr int MAX_STRING_ID = 0x7ff;
 constexpr uint32_t MIN_CARD_ID = (uint32_t)(MAX_STRING_ID + 1) >> 4;
 constexpr uint32_t MAX_CARD_ID = 0x0fffffffU;
@@ -46,34 +53,61 @@ struct CardDataC {
 		return false;
 	}
 };
+// The name stays in memory, the text and descriptions are read from the card cache when they are shown.
 struct CardString {
-	std::wstring name;
-	std::wstring text;
-	std::wstring desc[16];
+	static constexpr uint32_t npos = UINT32_MAX;
+
+	const wchar_t* name{};	// in the string arena
+	uint32_t cache{};	// index in the loaded caches
+	uint32_t entry{};	// entry in that cache
+	uint32_t shadowed{ npos };	// the replaced card in the shadowed strings, for the texts the entry leaves NULL
+};
+// A card of the card table by its index. Adding a database moves the indexes, so every database is loaded before the table is used.
+struct code_pointer {
+	static constexpr uint32_t npos = UINT32_MAX;
+	uint32_t index{ npos };
+
+	explicit operator bool() const {
+		return index != npos;
+	}
+	bool operator==(const code_pointer& other) const {
+		return index == other.index;
+	}
+	bool operator!=(const code_pointer& other) const {
+		return index != other.index;
+	}
+	const CardDataC& operator*() const;
+	const CardDataC* operator->() const;
 };
-using code_pointer = std::unordered_map<uint32_t, CardDataC>::const_iterator;
-using string_pointer = std::unordered_map<uint32_t, CardString>::const_iterator;
 
 class DataManager {
 public:
 	DataManager();
-	bool ReadDB(sqlite3* pDB, bool is_diy);
+	~DataManager();
+	bool ReadDB(sqlite3* pDB, CardCache& cache);
+	void AddCards(std::unique_ptr<CardCache> cache, bool is_diy);
 	bool LoadDB(const wchar_t* wfile);
+	void LoadDBs(const std::vector<std::wstring>& files);
+	// no database is added after this, the code_pointers taken from now on stay valid, and the stale card caches are removed
+	void Seal();
 	bool LoadStrings(const char* file);
 	bool LoadStrings(irr::io::IReadFile* reader);
 	void ReadStringConfLine(const char* linebuf);
 	bool Error(sqlite3* pDB, sqlite3_stmt* pStmt = nullptr);
 
 	code_pointer GetCodePointer(uint32_t code) const;
-	string_pointer GetStringPointer(uint32_t code) const;
-	const std::unordered_map<uint32_t, CardDataC>& GetDataTable() const {
-		return _datas;
+	// the card table, sorted by code
+	uint32_t GetCardCount() const {
+		return (uint32_t)_codes.size();
 	}
-	const std::unordered_map<uint32_t, CardString>& GetStringTable() const {
-		return _strings;
+	const CardDataC& GetCardData(uint32_t index) const {
+		return _datas[index];
 	}
+	const wchar_t* GetCardName(uint32_t index) const {
+		return _strings[index].name;
+	}
+	const wchar_t* GetCardText(uint32_t index) const;
 	bool GetData(uint32_t code, CardData* pData) const;
-	bool GetString(uint32_t code, CardString* pStr) const;
 	const wchar_t* GetName(uint32_t code) const;
 	const wchar_t* GetText(uint32_t code) const;
 	const wchar_t* GetDesc(uint32_t strCode) const;
@@ -90,10 +124,11 @@ public:
 	std::wstring FormatSetName(const uint16_t setcode[]) const;
 	std::wstring FormatMoveMarker(unsigned int move_marker) const;
 
-	std::unordered_map<unsigned int, std::wstring> _counterStrings;
-	std::unordered_map<unsigned int, std::wstring> _victoryStrings;
-	std::unordered_map<unsigned int, std::wstring> _setnameStrings;
-	std::unordered_map<unsigned int, std::wstring> _sysStrings;
+	// the strings point into the string arena
+	std::unordered_map<unsigned int, const wchar_t*> _counterStrings;
+	std::unordered_map<unsigned int, const wchar_t*> _victoryStrings;
+	std::unordered_map<unsigned int, const wchar_t*> _setnameStrings;
+	std::unordered_map<unsigned int, const wchar_t*> _sysStrings;
 	char errmsg[512]{};
 	const wchar_t* unknown_string{ L"???" };
 	irr::io::IFileSystem* FileSystem{};
@@ -103,7 +138,10 @@ public:
 	static constexpr int STRING_ID_TYPE = 1050;
 	static constexpr int TYPES_COUNT = 27;
 
-	static unsigned char scriptBuffer[0x100000];
+	static constexpr size_t SCRIPT_BUFFER_SIZE = 0x100000;
+	// duels on different server loops load scripts at the same time, each thread allocates its buffer on first use
+	static unsigned char* GetScriptBuffer();
+	static std::mutex fs_mutex;
 	static uint32_t CardReader(uint32_t, card_data*);
 	static unsigned char* ScriptReaderEx(const char* script_path, int* slen);
 	
@@ -118,13 +156,48 @@ public:
 	static bool deck_sort_name(code_pointer l1, code_pointer l2);
 
 private:
-	std::unordered_map<uint32_t, CardDataC> _datas;
-	std::unordered_map<uint32_t, CardString> _strings;
+	static unsigned char* ReadCardScript(const char* script_path, int* slen, std::string* file);
+	std::unique_ptr<CardCache> ReadCardCache(const wchar_t* wfile, unsigned int serial);
+	const wchar_t* GetCacheString(const CardString& cs, int field) const;
+
+	// the columns of the card table, _codes is searched and the other ones are indexed alike
+	std::vector<uint32_t> _codes;
+	std::vector<CardDataC> _datas;
+	std::vector<CardString> _strings;
+	// the replaced cards that still provide a text or description
+	std::vector<CardString> _shadowed;
+	// the loaded databases, mapped from ./cache if possible
+	std::vector<std::unique_ptr<CardCache>> _caches;
+	// the card names and the strings of strings.conf
+	StringArena _arena;
+	std::mutex errmsg_mutex;
+	bool _sealed{};
+
+	// a card script compiled once for all duels
+	struct CachedScript {
+		// the bytecode, or the source if it does not compile
+		std::vector<unsigned char> chunk;
+		// the loose file it was read from, empty for an archive
+		std::string file;
+		uint64_t size{};
+		int64_t mtime{};
+	};
+	// the card scripts found by ScriptReaderEx and the ones not found, shared by the duels of all threads
+	static std::mutex script_mutex;
+	static std::unordered_map<std::string, std::shared_ptr<const CachedScript>> script_cache;
+	static std::unordered_set<std::string> missing_scripts;
 	std::unordered_map<uint32_t, std::vector<uint16_t>> extra_setcode;
 };
 
 extern DataManager dataManager;
 
+inline const CardDataC& code_pointer::operator*() const {
+	return dataManager.GetCardData(index);
+}
+inline const CardDataC* code_pointer::operator->() const {
+	return &dataManager.GetCardData(index);
+}
+
 }
 
 #endif // DATAMANAGER_H
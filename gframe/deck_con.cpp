@@ -140,7 +140,6 @@ void DeckBuilder::Terminate() {
 bool DeckBuilder::OnEvent(const irr::SEvent& event) {
 	if(mainGame->dField.OnCommonEvent(event))
 		return false;
-	auto& _datas = dataManager.GetDataTable();
 	switch(event.EventType) {
 	case irr::EET_GUI_EVENT: {
 		irr::s32 id = event.GUIEvent.Caller->getID();
@@ -690,11 +689,11 @@ bool DeckBuilder::OnEvent(const irr::SEvent& event) {
 				BufferIO::Write<int32_t>(pdeck, static_cast<int32_t>(deckManager.current_deck.main.size() + deckManager.current_deck.area.size()));
 				BufferIO::Write<int32_t>(pdeck, static_cast<int32_t>(deckManager.current_deck.side.size()));
 				for(size_t i = 0; i < deckManager.current_deck.main.size(); ++i)
-					BufferIO::Write<uint32_t>(pdeck, deckManager.current_deck.main[i]->first);
+					BufferIO::Write<uint32_t>(pdeck, deckManager.current_deck.main[i]->code);
 				for(size_t i = 0; i < deckManager.current_deck.area.size(); ++i)
-					BufferIO::Write<uint32_t>(pdeck, deckManager.current_deck.area[i]->first);
+					BufferIO::Write<uint32_t>(pdeck, deckManager.current_deck.area[i]->code);
 				for(size_t i = 0; i < deckManager.current_deck.side.size(); ++i)
-					BufferIO::Write<uint32_t>(pdeck, deckManager.current_deck.side[i]->first);
+					BufferIO::Write<uint32_t>(pdeck, deckManager.current_deck.side[i]->code);
 				DuelClient::SendBufferToServer(CTOS_UPDATE_DECK, deckbuf, pdeck - deckbuf);
 				break;
 			}
@@ -1059,8 +1058,8 @@ bool DeckBuilder::OnEvent(const irr::SEvent& event) {
 				break;
 			dragx = event.MouseInput.X;
 			dragy = event.MouseInput.Y;
-			draging_pointer = _datas.find(hovered_code);
-			if (draging_pointer == _datas.end())
+			draging_pointer = dataManager.GetCodePointer(hovered_code);
+			if (!draging_pointer)
 				break;
 			if(hovered_pos == 4) {
 				if(!check_limit(draging_pointer))
@@ -1113,8 +1112,8 @@ bool DeckBuilder::OnEvent(const irr::SEvent& event) {
 					break;
 				if(hovered_pos == 0 || hovered_seq == -1)
 					break;
-				auto pointer = _datas.find(hovered_code);
-				if (pointer == _datas.end())
+				auto pointer = dataManager.GetCodePointer(hovered_code);
+				if (!pointer)
 					break;
 				soundManager.PlaySoundEffect(SOUND_CARD_DROP);
 				if(hovered_pos == 1) {
@@ -1148,8 +1147,8 @@ bool DeckBuilder::OnEvent(const irr::SEvent& event) {
 				} else if(hovered_pos == 3) {
 					pop_side(hovered_seq);
 				} else {
-					auto pointer = _datas.find(hovered_code);
-					if (pointer == _datas.end())
+					auto pointer = dataManager.GetCodePointer(hovered_code);
+					if (!pointer)
 						break;
 					if(!check_limit(pointer))
 						break;
@@ -1183,8 +1182,8 @@ bool DeckBuilder::OnEvent(const irr::SEvent& event) {
 				break;
 			if (is_draging)
 				break;
-			auto pointer = _datas.find(hovered_code);
-			if (pointer == _datas.end())
+			auto pointer = dataManager.GetCodePointer(hovered_code);
+			if (!pointer)
 				break;
 			if(!check_limit(pointer))
 				break;
@@ -1289,7 +1288,7 @@ void DeckBuilder::GetHoveredCard() {
 					hovered_seq = -1;
 					hovered_code = 0;
 				} else {
-					hovered_code = deckManager.current_deck.main[hovered_seq]->first;
+					hovered_code = deckManager.current_deck.main[hovered_seq]->code;
 				}
 			}
 		} else if(y >= 164 && y <= 435) {
@@ -1306,7 +1305,7 @@ void DeckBuilder::GetHoveredCard() {
 				hovered_seq = -1;
 				hovered_code = 0;
 			} else {
-				hovered_code = deckManager.current_deck.main[hovered_seq]->first;
+				hovered_code = deckManager.current_deck.main[hovered_seq]->code;
 			}
 		} else if(y >= 466 && y <= 530) {
 			int lx = deckManager.current_deck.area.size();
@@ -1321,7 +1320,7 @@ void DeckBuilder::GetHoveredCard() {
 				hovered_seq = -1;
 				hovered_code = 0;
 			} else {
-				hovered_code = deckManager.current_deck.area[hovered_seq]->first;
+				hovered_code = deckManager.current_deck.area[hovered_seq]->code;
 				if(x >= 772)
 					is_lastcard = 1;
 			}
@@ -1338,7 +1337,7 @@ void DeckBuilder::GetHoveredCard() {
 				hovered_seq = -1;
 				hovered_code = 0;
 			} else {
-				hovered_code = deckManager.current_deck.side[hovered_seq]->first;
+				hovered_code = deckManager.current_deck.side[hovered_seq]->code;
 				if(x >= 772)
 					is_lastcard = 1;
 			}
@@ -1351,7 +1350,7 @@ void DeckBuilder::GetHoveredCard() {
 			hovered_seq = -1;
 			hovered_code = 0;
 		} else {
-			hovered_code = results[current_pos]->first;
+			hovered_code = results[current_pos]->code;
 		}
 	}
 	if(is_draging) {
@@ -1472,15 +1471,9 @@ void DeckBuilder::FilterCards() {
 			query_elements.push_back(element);
 		}
 	}
-	auto& _datas = dataManager.GetDataTable();
-	auto& _strings = dataManager.GetStringTable();
-	for (code_pointer ptr = _datas.begin(); ptr != _datas.end(); ++ptr) {
-		auto& code = ptr->first;
-		auto& data = ptr->second;
-		auto strpointer = _strings.find(code);
-		if (strpointer == _strings.end())
-			continue;
-		const CardString& strings = strpointer->second;
+	for (code_pointer ptr{ 0 }; ptr.index < dataManager.GetCardCount(); ++ptr.index) {
+		const CardDataC& data = dataManager.GetCardData(ptr.index);
+		const wchar_t* name = dataManager.GetCardName(ptr.index);
 		if(data.type & TYPE_TOKEN)
 			continue;
 		switch(filter_type_main) {
@@ -1543,7 +1536,7 @@ void DeckBuilder::FilterCards() {
 		}
 		}
 		if (filter_limit) {
-			if (!filterList->content.count(ptr->first) || filterList->content.at(ptr->first) != filter_limit - 1)
+			if (!filterList->content.count(data.code) || filterList->content.at(data.code) != filter_limit - 1)
 				continue;
 		}
 		if (filter_allow) {
@@ -1556,14 +1549,14 @@ void DeckBuilder::FilterCards() {
 		for (auto elements_iterator = query_elements.begin(); elements_iterator != query_elements.end(); ++elements_iterator) {
 			bool match = false;
 			if (elements_iterator->type == element_t::type_t::name) {
-				match = CardNameContains(strings.name.c_str(), elements_iterator->keyword.c_str());
+				match = CardNameContains(name, elements_iterator->keyword.c_str());
 			} else if (elements_iterator->type == element_t::type_t::setcode) {
 				match = data.is_setcodes(elements_iterator->setcodes);
 			} else if (trycode && (data.code == trycode || data.alias == trycode && is_alternative(data.code, data.alias))){
 				match = true;
 			} else {
-				match = CardNameContains(strings.name.c_str(), elements_iterator->keyword.c_str())
-					|| strings.text.find(elements_iterator->keyword) != std::wstring::npos
+				match = CardNameContains(name, elements_iterator->keyword.c_str())
+					|| std::wcsstr(dataManager.GetCardText(ptr.index), elements_iterator->keyword.c_str()) != nullptr
 					|| data.is_setcodes(elements_iterator->setcodes);
 			}
 			if(elements_iterator->exclude)
@@ -1627,7 +1620,7 @@ void DeckBuilder::SortList() {
 	auto left = results.begin();
 	const wchar_t* pstr = mainGame->ebKeyword->getText();
 	for(auto it = results.begin(); it != results.end(); ++it) {
-		if(std::wcscmp(pstr, dataManager.GetName((*it)->first)) == 0) {
+		if(std::wcscmp(pstr, dataManager.GetName((*it)->code)) == 0) {
 			std::iter_swap(left, it);
 			++left;
 		}
@@ -1814,7 +1807,7 @@ bool DeckBuilder::CardNameContains(const wchar_t* haystack, const wchar_t* needl
 	return false;
 }
 bool DeckBuilder::push_main(code_pointer pointer, int seq) {
-	if (pointer->second.type & TYPE_AREA)
+	if (pointer->type & TYPE_AREA)
 		return false;
 	auto& container = deckManager.current_deck.main;
 	int maxc = mainGame->is_siding ? DECK_MAX_SIZE + 5 : DECK_MAX_SIZE;
@@ -1829,7 +1822,7 @@ bool DeckBuilder::push_main(code_pointer pointer, int seq) {
 	return true;
 }
 bool DeckBuilder::push_area(code_pointer pointer, int seq) {
-	if (!(pointer->second.type & TYPE_AREA))
+	if (!(pointer->type & TYPE_AREA))
 		return false;
 	auto& container = deckManager.current_deck.area;
 	int maxc = mainGame->is_siding ? ADECK_MAX_SIZE + 5 : ADECK_MAX_SIZE;
@@ -1875,21 +1868,21 @@ void DeckBuilder::pop_side(int seq) {
 	GetHoveredCard();
 }
 bool DeckBuilder::check_limit(code_pointer pointer) {
-	auto limitcode = pointer->second.alias ? pointer->second.alias : pointer->first;
+	auto limitcode = pointer->alias ? pointer->alias : pointer->code;
 	int limit = 3;
 	auto flit = filterList->content.find(limitcode);
 	if(flit != filterList->content.end())
 		limit = flit->second;
 	for (auto& card : deckManager.current_deck.main) {
-		if (card->first == limitcode || card->second.alias == limitcode)
+		if (card->code == limitcode || card->alias == limitcode)
 			limit--;
 	}
 	for (auto& card : deckManager.current_deck.area) {
-		if (card->first == limitcode || card->second.alias == limitcode)
+		if (card->code == limitcode || card->alias == limitcode)
 			limit--;
 	}
 	for (auto& card : deckManager.current_deck.side) {
-		if (card->first == limitcode || card->second.alias == limitcode)
+		if (card->code == limitcode || card->alias == limitcode)
 			limit--;
 	}
 	return limit > 0;
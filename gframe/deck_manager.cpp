@@ -95,64 +95,63 @@ unsigned int DeckManager::CheckDeck(const Deck& deck, unsigned int lfhash, int h
 	if (host_allow_ind == 0)
 		allow = ALLOW_EFCG;
 	for (auto& cit : deck.main) {
-		auto allowError = checkAllow(cit->second.allow, allow);
+		auto allowError = checkAllow(cit->allow, allow);
 		if(allowError)
-			return (allowError << 28) | cit->first;
-		if (cit->second.type & (TYPE_AREA | TYPE_TOKEN))
+			return (allowError << 28) | cit->code;
+		if (cit->type & (TYPE_AREA | TYPE_TOKEN))
 			return (DECKERROR_MAINCOUNT << 28);
-		int code = cit->second.alias ? cit->second.alias : cit->first;
+		int code = cit->alias ? cit->alias : cit->code;
 		ccount[code]++;
 		int dc = ccount[code];
 		if(dc > 3)
-			return (DECKERROR_CARDCOUNT << 28) | cit->first;
+			return (DECKERROR_CARDCOUNT << 28) | cit->code;
 		auto it = list.find(code);
 		if(it != list.end() && dc > it->second)
-			return (DECKERROR_LFLIST << 28) | cit->first;
+			return (DECKERROR_LFLIST << 28) | cit->code;
 	}
 	for (auto& cit : deck.area) {
-		auto allowError = checkAllow(cit->second.allow, allow);
+		auto allowError = checkAllow(cit->allow, allow);
 		if(allowError)
-			return (allowError << 28) | cit->first;
-		if (!(cit->second.type & TYPE_AREA) || cit->second.type & TYPE_TOKEN)
+			return (allowError << 28) | cit->code;
+		if (!(cit->type & TYPE_AREA) || cit->type & TYPE_TOKEN)
 			return (DECKERROR_ADECKCOUNT << 28);
-		int code = cit->second.alias ? cit->second.alias : cit->first;
+		int code = cit->alias ? cit->alias : cit->code;
 		ccount[code]++;
 		int dc = ccount[code];
 		if(dc > 3)
-			return (DECKERROR_CARDCOUNT << 28) | cit->first;
+			return (DECKERROR_CARDCOUNT << 28) | cit->code;
 		auto it = list.find(code);
 		if(it != list.end() && dc > it->second)
-			return (DECKERROR_LFLIST << 28) | cit->first;
+			return (DECKERROR_LFLIST << 28) | cit->code;
 	}
 	for (auto& cit : deck.side) {
-		auto allowError = checkAllow(cit->second.allow, allow);
+		auto allowError = checkAllow(cit->allow, allow);
 		if(allowError)
-			return (allowError << 28) | cit->first;
-		if (cit->second.type & TYPE_TOKEN)
+			return (allowError << 28) | cit->code;
+		if (cit->type & TYPE_TOKEN)
 			return (DECKERROR_SIDECOUNT << 28);
-		int code = cit->second.alias ? cit->second.alias : cit->first;
+		int code = cit->alias ? cit->alias : cit->code;
 		ccount[code]++;
 		int dc = ccount[code];
 		if(dc > 3)
-			return (DECKERROR_CARDCOUNT << 28) | cit->first;
+			return (DECKERROR_CARDCOUNT << 28) | cit->code;
 		auto it = list.find(code);
 		if(it != list.end() && dc > it->second)
-			return (DECKERROR_LFLIST << 28) | cit->first;
+			return (DECKERROR_LFLIST << 28) | cit->code;
 	}
 	return 0;
 }
 uint32_t DeckManager::LoadDeck(Deck& deck, uint32_t dbuf[], int mainc, int sidec, bool is_packlist) {
 	deck.clear();
 	uint32_t errorcode = 0;
-	auto& _datas = dataManager.GetDataTable();
 	for(int i = 0; i < mainc; ++i) {
 		auto code = dbuf[i];
-		auto it = _datas.find(code);
-		if(it == _datas.end()) {
+		auto it = dataManager.GetCodePointer(code);
+		if(!it) {
 			errorcode = code;
 			continue;
 		}
-		auto& cd = it->second;
+		auto& cd = *it;
 		if (cd.type & TYPE_TOKEN) {
 			errorcode = code;
 			continue;
@@ -172,12 +171,12 @@ uint32_t DeckManager::LoadDeck(Deck& deck, uint32_t dbuf[], int mainc, int sidec
 	}
 	for(int i = 0; i < sidec; ++i) {
 		auto code = dbuf[mainc + i];
-		auto it = _datas.find(code);
-		if(it == _datas.end()) {
+		auto it = dataManager.GetCodePointer(code);
+		if(!it) {
 			errorcode = code;
 			continue;
 		}
-		auto& cd = it->second;
+		auto& cd = *it;
 		if (cd.type & TYPE_TOKEN) {
 			errorcode = code;
 			continue;
@@ -216,21 +215,21 @@ bool DeckManager::LoadSide(Deck& deck, uint32_t dbuf[], int mainc, int sidec) {
 	std::unordered_map<uint32_t, int> pcount;
 	std::unordered_map<uint32_t, int> ncount;
 	for(size_t i = 0; i < deck.main.size(); ++i)
-		pcount[deck.main[i]->first]++;
+		pcount[deck.main[i]->code]++;
 	for(size_t i = 0; i < deck.area.size(); ++i)
-		pcount[deck.area[i]->first]++;
+		pcount[deck.area[i]->code]++;
 	for(size_t i = 0; i < deck.side.size(); ++i)
-		pcount[deck.side[i]->first]++;
+		pcount[deck.side[i]->code]++;
 	Deck ndeck;
 	LoadDeck(ndeck, dbuf, mainc, sidec);
 	if (ndeck.main.size() != deck.main.size() || ndeck.area.size() != deck.area.size() || ndeck.side.size() != deck.side.size())
 		return false;
 	for(size_t i = 0; i < ndeck.main.size(); ++i)
-		ncount[ndeck.main[i]->first]++;
+		ncount[ndeck.main[i]->code]++;
 	for(size_t i = 0; i < ndeck.area.size(); ++i)
-		ncount[ndeck.area[i]->first]++;
+		ncount[ndeck.area[i]->code]++;
 	for(size_t i = 0; i < ndeck.side.size(); ++i)
-		ncount[ndeck.side[i]->first]++;
+		ncount[ndeck.side[i]->code]++;
 	for (auto& cdit : ncount)
 		if (cdit.second != pcount[cdit.first])
 			return false;
@@ -328,13 +327,13 @@ void DeckManager::SaveDeck(const Deck& deck, std::stringstream& deckStream) {
 	deckStream << "#created by ..." << std::endl;
 	deckStream << "#main" << std::endl;
 	for(size_t i = 0; i < deck.main.size(); ++i)
-		deckStream << deck.main[i]->first << std::endl;
+		deckStream << deck.main[i]->code << std::endl;
 	deckStream << "#area" << std::endl;
 	for(size_t i = 0; i < deck.area.size(); ++i)
-		deckStream << deck.area[i]->first << std::endl;
+		deckStream << deck.area[i]->code << std::endl;
 	deckStream << "!side" << std::endl;
 	for(size_t i = 0; i < deck.side.size(); ++i)
-		deckStream << deck.side[i]->first << std::endl;
+		deckStream << deck.side[i]->code << std::endl;
 }
 bool DeckManager::SaveDeck(const Deck& deck, const wchar_t* file) {
 	if(!FileSystem::IsDirExists(L"./deck") && !FileSystem::MakeDir(L"./deck"))
@@ -1124,8 +1124,8 @@ void Game::WaitFrameSignal(int frame) {
 	frameSignal.Wait();
 }
 void Game::DrawThumb(code_pointer cp, irr::core::vector2di pos, const LFList* lflist, bool drag) {
-	auto code = cp->first;
-	auto lcode = cp->second.alias;
+	auto code = cp->code;
+	auto lcode = cp->alias;
 	if (lcode == 0)
 		lcode = code;
 	irr::video::ITexture* img = imageManager.GetTextureThumb(code);
@@ -1155,7 +1155,7 @@ void Game::DrawThumb(code_pointer cp, irr::core::vector2di pos, const LFList* lf
 			break;
 		}
 	}
-	if (cbLimit->getSelected() >= 4 && (cp->second.allow & ALLOW_DIY))
+	if (cbLimit->getSelected() >= 4 && (cp->allow & ALLOW_DIY))
 		driver->draw2DImage(imageManager.tdiy, otloc, irr::core::recti(0, 0, 128, 64), 0, 0, true);
 }
 void Game::DrawDeckBd() {
@@ -1243,36 +1243,36 @@ void Game::DrawDeckBd() {
 	for (int i = 0; i < max_result && i + scrFilter->getPos() < (int)deckBuilder.results.size(); ++i) {
 		code_pointer ptr = deckBuilder.results[i + scrFilter->getPos()];
 		if (i >= 7) {
-			imageManager.GetTextureThumb(ptr->second.code);
+			imageManager.GetTextureThumb(ptr->code);
 			break;
 		}
 		if (deckBuilder.hovered_pos == 4 && deckBuilder.hovered_seq == (int)i)
 			driver->draw2DRectangle(0x80000000, Resize(806, 164 + i * 66, 1019, 230 + i * 66));
 		DrawThumb(ptr, irr::core::vector2di(810, 165 + i * 66), deckBuilder.filterList);
 		const wchar_t* diyBuffer = L"";
-		if (ptr->second.allow & ALLOW_DIY)
+		if (ptr->allow & ALLOW_DIY)
 			diyBuffer = L"[Diy]";
-		myswprintf(textBuffer, L"%ls %ls", dataManager.GetName(ptr->first), diyBuffer);
+		myswprintf(textBuffer, L"%ls %ls", dataManager.GetName(ptr->code), diyBuffer);
 		DrawShadowText(textFont, textBuffer, Resize(860, 165 + i * 66, 955, 185 + i * 66), Resize(1, 1, 0, 0));
-		if (ptr->second.type & TYPE_AREA)
-			myswprintf(textBuffer, L"LP %d", ptr->second.life);
+		if (ptr->type & TYPE_AREA)
+			myswprintf(textBuffer, L"LP %d", ptr->life);
 		else {
-			const auto& move_marker = dataManager.FormatMoveMarker(ptr->second.move);
-			myswprintf(textBuffer, L"\u00A4 %d %ls", ptr->second.energy, move_marker.c_str());
+			const auto& move_marker = dataManager.FormatMoveMarker(ptr->move);
+			myswprintf(textBuffer, L"\u00A4 %d %ls", ptr->energy, move_marker.c_str());
 		}
 		DrawShadowText(textFont, textBuffer, Resize(860, 187 + i * 66, 955, 207 + i * 66), Resize(1, 1, 0, 0));
-		if (ptr->second.type & TYPE_MONS) {
-			const auto& from = dataManager.FormatFrom(ptr->second.from);
-			const auto& race = dataManager.FormatRace(ptr->second.race);
+		if (ptr->type & TYPE_MONS) {
+			const auto& from = dataManager.FormatFrom(ptr->from);
+			const auto& race = dataManager.FormatRace(ptr->race);
 			wchar_t atkBuffer[16]{};
-			if (ptr->second.atk < 0)
+			if (ptr->atk < 0)
 				myswprintf(atkBuffer, L"ATK ?");
 			else
-				myswprintf(atkBuffer, L"ATK %d", ptr->second.atk);
+				myswprintf(atkBuffer, L"ATK %d", ptr->atk);
 			myswprintf(textBuffer, L"%ls/%ls %ls", from.c_str(), race.c_str(), atkBuffer);
 		}
 		else {
-			const auto& type = dataManager.FormatType(ptr->second.type);
+			const auto& type = dataManager.FormatType(ptr->type);
 			myswprintf(textBuffer, L"%ls", type.c_str());
 		}
 		DrawShadowText(textFont, textBuffer, Resize(860, 209 + i * 66, 955, 229 + i * 66), Resize(1, 1, 0, 0));
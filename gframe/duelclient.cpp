@@ -8,6 +8,7 @@
 #include "game.h"
 #include "deck_manager.h"
 #include "replay.h"
+#include "lzma/LzmaLib.h"
 #include <thread>
 
 namespace ygo {
@@ -21,6 +22,9 @@ bool DuelClient::is_host = false;
 event_base* DuelClient::client_base = 0;
 bufferevent* DuelClient::client_bev = 0;
 unsigned char DuelClient::duel_client_write[SIZE_NETWORK_BUFFER];
+std::vector<unsigned char> DuelClient::read_scratch;
+std::vector<unsigned char> DuelClient::incoming_replay;
+size_t DuelClient::incoming_replay_size = 0;
 bool DuelClient::is_closing = false;
 bool DuelClient::is_swapping = false;
 int DuelClient::select_hint = 0;
@@ -99,21 +103,11 @@ void DuelClient::StopClient(bool is_exiting) {
 }
 void DuelClient::ClientRead(bufferevent* bev, void* ctx) {
 	evbuffer* input = bufferevent_get_input(bev);
-	int len = evbuffer_get_length(input);
-	if (len < 2)
-		return;
-	unsigned char* duel_client_read = new unsigned char[SIZE_NETWORK_BUFFER];
-	uint16_t packet_len = 0;
-	while (len >= 2) {
-		evbuffer_copyout(input, &packet_len, sizeof packet_len);
-		if (len < packet_len + 2)
-			break;
-		int read_len = evbuffer_remove(input, duel_client_read, packet_len + 2);
-		if (read_len > 2)
-			HandleSTOCPacketLan(&duel_client_read[2], read_len - 2);
-		len -= packet_len + 2;
-	}
-	delete[] duel_client_read;
+	ReadPackets(input, read_scratch, [bev](unsigned char* data, int len) {
+		HandleSTOCPacketLan(data, len);
+		// a broken batch closes the connection
+		return (bufferevent_get_enabled(bev) & EV_READ) != 0;
+	});
 }
 void DuelClient::ClientEvent(bufferevent* bev, short events, void* ctx) {
 	if (events & BEV_EVENT_CONNECTED) {
@@ -126,7 +120,11 @@ void DuelClient::ClientEvent(bufferevent* bev, short events, void* ctx) {
 			memset(buf, 0, sizeof(uint32_t)); // real_ip
 			memcpy(buf + sizeof(uint32_t), hostname_buf, hostname_msglen);
 			SendBufferToServer(CTOS_EXTERNAL_ADDRESS, buf, hostname_msglen + sizeof(uint32_t));
+			// a local host gains nothing from compression
+			SendPacketToServer(CTOS_COMPRESSION);
 		}
+		SendPacketToServer(CTOS_UPDATE_DELTA);
+		SendPacketToServer(CTOS_REPLAY_CHUNKS);
 		CTOS_PlayerInfo cspi;
 		BufferIO::CopyCharArray(mainGame->ebNickName->getText(), cspi.name);
 		SendPacketToServer(CTOS_PLAYER_INFO, cspi);
@@ -247,6 +245,53 @@ int DuelClient::ClientThread() {
 	connect_state = 0;
 	return 0;
 }
+/*
+* prep: ExtendedReplayHeader + compressed replay data
+*/
+void DuelClient::ReceiveReplay(unsigned char* prep, size_t len) {
+	mainGame->gMutex.lock();
+	mainGame->wPhase->setVisible(false);
+	if(mainGame->dInfo.player_type < 7)
+		mainGame->btnLeaveGame->setVisible(false);
+	mainGame->CloseGameButtons();
+	Replay new_replay;
+	std::memcpy(&new_replay.pheader, prep, sizeof new_replay.pheader);
+	time_t starttime;
+	if (new_replay.pheader.base.flag & REPLAY_UNIFORM)
+		starttime = new_replay.pheader.base.start_time;
+	else
+		starttime = new_replay.pheader.base.seed;
+	wchar_t timetext[40];
+	std::wcsftime(timetext, sizeof timetext / sizeof timetext[0], L"%Y-%m-%d %H-%M-%S", std::localtime(&starttime));
+	mainGame->ebRSName->setText(timetext);
+	if(!mainGame->chkAutoSaveReplay->isChecked()) {
+		mainGame->wReplaySave->setText(dataManager.GetSysString(1340));
+		mainGame->PopupElement(mainGame->wReplaySave);
+		mainGame->gMutex.unlock();
+		mainGame->replaySignal.Reset();
+		mainGame->replaySignal.Wait();
+	}
+	else {
+		mainGame->actionParam = 1;
+		wchar_t msgbuf[256];
+		myswprintf(msgbuf, dataManager.GetSysString(1367), timetext);
+		mainGame->SetStaticText(mainGame->stACMessage, 310, mainGame->guiFont, msgbuf);
+		mainGame->PopupElement(mainGame->wACMessage, 20);
+		mainGame->gMutex.unlock();
+		mainGame->WaitFrameSignal(30);
+	}
+	if(mainGame->actionParam || !is_host) {
+		prep += sizeof new_replay.pheader;
+		new_replay.comp_data.assign(prep, prep + len - sizeof new_replay.pheader);
+		if (mainGame->actionParam) {
+			bool save_result = new_replay.SaveReplay(mainGame->ebRSName->getText());
+			if (!save_result)
+				new_replay.SaveReplay(L"_LastReplay");
+		}
+		else
+			new_replay.SaveReplay(L"_LastReplay");
+	}
+}
 void DuelClient::HandleSTOCPacketLan(unsigned char* data, int len) {
 	unsigned char* pdata = data;
 	unsigned char pktType = BufferIO::Read<uint8_t>(pdata);
@@ -257,6 +302,37 @@ void DuelClient::HandleSTOCPacketLan(unsigned char* data, int len) {
 		ClientAnalyze(pdata, len - 1);
 		break;
 	}
+	case STOC_COMPRESSED: {
+		if (len < 1 + (int)sizeof(uint32_t) + LZMA_PROPS_SIZE)
+			return;
+		size_t packets_len = BufferIO::Read<uint32_t>(pdata);
+		const unsigned char* props = pdata;
+		pdata += LZMA_PROPS_SIZE;
+		size_t comp_len = len - 1 - sizeof(uint32_t) - LZMA_PROPS_SIZE;
+		std::vector<unsigned char> packets;
+		size_t out_len = packets_len;
+		if (packets_len <= MAX_COMPRESSED_BATCH) {
+			packets.resize(packets_len);
+			if (LzmaUncompress(packets.data(), &out_len, pdata, &comp_len, props, LZMA_PROPS_SIZE) != SZ_OK)
+				out_len = 0;
+		}
+		// the rest of the duel would be out of sync, so the batch is not skipped
+		if (packets_len > MAX_COMPRESSED_BATCH || out_len != packets_len) {
+			ClientEvent(client_bev, BEV_EVENT_ERROR, nullptr);
+			return;
+		}
+		size_t pos = 0;
+		while (pos + sizeof(uint16_t) <= packets_len) {
+			uint16_t packet_len = 0;
+			std::memcpy(&packet_len, packets.data() + pos, sizeof packet_len);
+			pos += sizeof packet_len;
+			if (packet_len == 0 || pos + packet_len > packets_len)
+				break;
+			HandleSTOCPacketLan(packets.data() + pos, packet_len);
+			pos += packet_len;
+		}
+		break;
+	}
 	case STOC_ERROR_MSG: {
 		if (len < 1 + (int)sizeof(STOC_ErrorMsg))
 			return;
@@ -714,50 +790,36 @@ void DuelClient::HandleSTOCPacketLan(unsigned char* data, int len) {
 	case STOC_REPLAY: {
 		if (len < 1 + (int)sizeof(ExtendedReplayHeader))
 			return;
-		mainGame->gMutex.lock();
-		mainGame->wPhase->setVisible(false);
-		if(mainGame->dInfo.player_type < 7)
-			mainGame->btnLeaveGame->setVisible(false);
-		mainGame->CloseGameButtons();
-		auto prep = pdata;
-		Replay new_replay;
-		std::memcpy(&new_replay.pheader, prep, sizeof(new_replay.pheader));
-		time_t starttime;
-		if (new_replay.pheader.base.flag & REPLAY_UNIFORM)
-			starttime = new_replay.pheader.base.start_time;
-		else
-			starttime = new_replay.pheader.base.seed;
-		wchar_t timetext[40];
-		std::wcsftime(timetext, sizeof timetext / sizeof timetext[0], L"%Y-%m-%d %H-%M-%S", std::localtime(&starttime));
-		mainGame->ebRSName->setText(timetext);
-		if(!mainGame->chkAutoSaveReplay->isChecked()) {
-			mainGame->wReplaySave->setText(dataManager.GetSysString(1340));
-			mainGame->PopupElement(mainGame->wReplaySave);
-			mainGame->gMutex.unlock();
-			mainGame->replaySignal.Reset();
-			mainGame->replaySignal.Wait();
-		}
-		else {
-			mainGame->actionParam = 1;
-			wchar_t msgbuf[256];
-			myswprintf(msgbuf, dataManager.GetSysString(1367), timetext);
-			mainGame->SetStaticText(mainGame->stACMessage, 310, mainGame->guiFont, msgbuf);
-			mainGame->PopupElement(mainGame->wACMessage, 20);
-			mainGame->gMutex.unlock();
-			mainGame->WaitFrameSignal(30);
-		}
-		if(mainGame->actionParam || !is_host) {
-			prep += sizeof new_replay.pheader;
-			std::memcpy(new_replay.comp_data, prep, len - sizeof new_replay.pheader - 1);
-			new_replay.comp_size = len - sizeof new_replay.pheader - 1;
-			if (mainGame->actionParam) {
-				bool save_result = new_replay.SaveReplay(mainGame->ebRSName->getText());
-				if (!save_result)
-					new_replay.SaveReplay(L"_LastReplay");
-			}
-			else
-				new_replay.SaveReplay(L"_LastReplay");
+		ReceiveReplay(pdata, len - 1);
+		break;
+	}
+	case STOC_REPLAY_START: {
+		if (len < 1 + (int)sizeof(ExtendedReplayHeader) + (int)sizeof(uint32_t))
+			return;
+		incoming_replay.assign(pdata, pdata + sizeof(ExtendedReplayHeader));
+		pdata += sizeof(ExtendedReplayHeader);
+		uint32_t comp_size = BufferIO::Read<uint32_t>(pdata);
+		if (comp_size > MAX_REPLAY_SIZE) {
+			incoming_replay.clear();
+			incoming_replay_size = 0;
+			return;
 		}
+		incoming_replay_size = sizeof(ExtendedReplayHeader) + comp_size;
+		incoming_replay.reserve(incoming_replay_size);
+		break;
+	}
+	case STOC_REPLAY_DATA: {
+		if (incoming_replay.size() + len - 1 > incoming_replay_size)
+			return;
+		incoming_replay.insert(incoming_replay.end(), pdata, pdata + len - 1);
+		break;
+	}
+	case STOC_REPLAY_END: {
+		if (incoming_replay_size && incoming_replay.size() == incoming_replay_size)
+			ReceiveReplay(incoming_replay.data(), incoming_replay.size());
+		incoming_replay.clear();
+		incoming_replay.shrink_to_fit();
+		incoming_replay_size = 0;
 		break;
 	}
 	case STOC_TIME_LIMIT: {
@@ -1295,6 +1357,14 @@ bool DuelClient::ClientAnalyze(unsigned char* msg, int len) {
 		mainGame->gMutex.unlock();
 		return true;
 	}
+	case MSG_UPDATE_DELTA: {
+		int player = mainGame->LocalPlayer(BufferIO::Read<uint8_t>(pbuf));
+		int location = BufferIO::Read<uint8_t>(pbuf);
+		mainGame->gMutex.lock();
+		mainGame->dField.UpdateFieldDelta(player, location, pbuf);
+		mainGame->gMutex.unlock();
+		return true;
+	}
 	case MSG_UPDATE_CARD: {
 		int player = mainGame->LocalPlayer(BufferIO::Read<uint8_t>(pbuf));
 		unsigned int loc = BufferIO::Read<uint8_t>(pbuf);
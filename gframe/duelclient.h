@@ -19,6 +19,10 @@ private:
 	static event_base* client_base;
 	static bufferevent* client_bev;
 	static unsigned char duel_client_write[SIZE_NETWORK_BUFFER];
+	static std::vector<unsigned char> read_scratch;
+	// a replay sent in several packets
+	static std::vector<unsigned char> incoming_replay;
+	static size_t incoming_replay_size;
 	static bool is_closing;
 	static bool is_swapping;
 	static int select_hint;
@@ -43,6 +47,7 @@ public:
 	static void ClientEvent(bufferevent* bev, short events, void* ctx);
 	static int ClientThread();
 	static void HandleSTOCPacketLan(unsigned char* data, int len);
+	static void ReceiveReplay(unsigned char* prep, size_t len);
 	static bool ClientAnalyze(unsigned char* msg, int len);
 	static void SwapField();
 	static void SetResponseI(int32_t respI);
@@ -6,6 +6,7 @@
 #include "deck_manager.h"
 #include "sound_manager.h"
 #include "replay.h"
+#include "replay_index.h"
 #include "materials.h"
 #include "duelclient.h"
 #include "netserver.h"
@@ -730,7 +731,9 @@ bool Game::Initialize() {
 	wReplay = env->addWindow(irr::core::rect<irr::s32>(220, 100, 800, 520), false, dataManager.GetSysString(1202));
 	wReplay->getCloseButton()->setVisible(false);
 	wReplay->setVisible(false);
-	lstReplayList = env->addListBox(irr::core::rect<irr::s32>(10, 30, 350, 400), wReplay, LISTBOX_REPLAY_LIST, true);
+	ebReplayFilter = env->addEditBox(L"", irr::core::rect<irr::s32>(10, 30, 350, 50), true, wReplay, EDITBOX_REPLAY_FILTER);
+	ebReplayFilter->setTextAlignment(irr::gui::EGUIA_CENTER, irr::gui::EGUIA_CENTER);
+	lstReplayList = env->addListBox(irr::core::rect<irr::s32>(10, 55, 350, 400), wReplay, LISTBOX_REPLAY_LIST, true);
 	lstReplayList->setItemHeight(18);
 	btnLoadReplay = env->addButton(irr::core::rect<irr::s32>(470, 355, 570, 380), wReplay, BUTTON_LOAD_REPLAY, dataManager.GetSysString(1348));
 	btnDeleteReplay = env->addButton(irr::core::rect<irr::s32>(360, 355, 460, 380), wReplay, BUTTON_DELETE_REPLAY, dataManager.GetSysString(1361));
@@ -884,6 +887,22 @@ bool Game::Initialize() {
 	}
 	return true;
 }
+// The card databases and scripts only, for the command line tools.
+bool Game::InitializeHeadless() {
+	LoadConfig();
+	device = irr::createDevice(irr::video::EDT_NULL);
+	if(!device) {
+		ErrorLog("Failed to create Irrlicht Engine device!");
+		return false;
+	}
+	dataManager.FileSystem = device->getFileSystem();
+	if(!dataManager.LoadDB(L"cards.cdb")) {
+		ErrorLog("Failed to load card database (cards.cdb)!");
+		return false;
+	}
+	LoadExpansions();
+	return true;
+}
 void Game::MainLoop() {
 	wchar_t cap[256];
 	camera = smgr->addCameraSceneNode(0);
@@ -1055,13 +1074,15 @@ std::wstring Game::SetStaticText(irr::gui::IGUIStaticText* pControl, irr::u32 cW
 	return std::wstring(strBuffer);
 }
 void Game::LoadExpansions() {
-	FileSystem::TraversalDir(L"./expansions", [](const wchar_t* name, bool isdir) {
+	// the databases are read together at the end, in the order they are found
+	std::vector<std::wstring> databases;
+	FileSystem::TraversalDir(L"./expansions", [&databases](const wchar_t* name, bool isdir) {
 		if (isdir)
 			return;
 		wchar_t fpath[1024];
 		myswprintf(fpath, L"./expansions/%ls", name);
 		if (IsExtension(name, L".cdb")) {
-			dataManager.LoadDB(fpath);
+			databases.push_back(fpath);
 			return;
 		}
 		if (IsExtension(name, L".conf")) {
@@ -1092,7 +1113,7 @@ void Game::LoadExpansions() {
 			BufferIO::DecodeUTF8(uname, fname);
 #endif
 			if (IsExtension(fname, L".cdb")) {
-				dataManager.LoadDB(fname);
+				databases.push_back(fname);
 				continue;
 			}
 			if (IsExtension(fname, L".conf")) {
@@ -1110,6 +1131,7 @@ void Game::LoadExpansions() {
 			}
 		}
 	}
+	dataManager.LoadDBs(databases);
 }
 void Game::RefreshCategoryDeck(irr::gui::IGUIComboBox* cbCategory, irr::gui::IGUIComboBox* cbDeck, bool selectlastused) {
 	cbCategory->clear();
@@ -1168,11 +1190,22 @@ void Game::RefreshDeck(const wchar_t* deckpath, const std::function<void(const w
 	});
 }
 void Game::RefreshReplay() {
-	lstReplayList->clear();
+	replayFiles.clear();
 	FileSystem::TraversalDir(L"./replay", [this](const wchar_t* name, bool isdir) {
 		if (!isdir && IsExtension(name, L".yrp"))
-			lstReplayList->addItem(name);
+			replayFiles.push_back(name);
 	});
+	replayIndex.Update(replayFiles);
+	FilterReplay();
+}
+// the replays not yet indexed are matched by file name only
+void Game::FilterReplay() {
+	lstReplayList->clear();
+	const wchar_t* filter = ebReplayFilter->getText();
+	for (const auto& name : replayFiles) {
+		if (!filter[0] || replayIndex.Match(name, filter))
+			lstReplayList->addItem(name.c_str());
+	}
 }
 void Game::RefreshSingleplay() {
 	lstSinglePlayList->clear();
@@ -1463,12 +1496,13 @@ void Game::ShowCardInfo(int code, bool resize) {
 	if (showingcode == code && !resize)
 		return;
 	wchar_t formatBuffer[256];
-	auto& _datas = dataManager.GetDataTable();
-	auto cit = _datas.find(code);
-	bool is_valid = (cit != _datas.end());
+	auto cit = dataManager.GetCodePointer(code);
+	bool is_valid = !!cit;
 	imgCard->setImage(imageManager.GetTexture(code, true));
 	// name
-	auto& cd = cit->second;
+	CardDataC cd;
+	if (is_valid)
+		cd = *cit;
 	int cod = code;
 	if (is_valid && is_alternative(cd.code, cd.alias))
 		cod = cd.alias;
@@ -1510,10 +1544,10 @@ void Game::ShowCardInfo(int code, bool resize) {
 		// setname
 		if (!gameConf.hide_setname) {
 			auto target = cit;
-			if (cd.alias && _datas.find(cd.alias) != _datas.end())
-				target = _datas.find(cd.alias);
-			if (target->second.setcode[0]) {
-				const auto& setname = dataManager.FormatSetName(target->second.setcode);
+			if (cd.alias && dataManager.GetCodePointer(cd.alias))
+				target = dataManager.GetCodePointer(cd.alias);
+			if (target->setcode[0]) {
+				const auto& setname = dataManager.FormatSetName(target->setcode);
 				myswprintf(formatBuffer, L"%ls%ls", dataManager.GetSysString(1329), setname.c_str());
 				stSetName->setText(formatBuffer);
 				stSetName->setRelativePosition(irr::core::rect<irr::s32>(15, 60 + offset, 296 * xScale, 83 + offset));
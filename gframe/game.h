@@ -73,6 +73,7 @@
 #define BUTTON_DELETE_REPLAY		133
 #define BUTTON_RENAME_REPLAY		134
 #define BUTTON_EXPORT_DECK			135
+#define EDITBOX_REPLAY_FILTER		136
 #define BUTTON_REPLAY_START			140
 #define BUTTON_REPLAY_PAUSE			141
 #define BUTTON_REPLAY_STEP			142
@@ -381,6 +382,7 @@ class Game {
 
 public:
 	bool Initialize();
+	bool InitializeHeadless();
 	void MainLoop();
 	void BuildProjectionMatrix(irr::core::matrix4& mProjection, irr::f32 left, irr::f32 right, irr::f32 bottom, irr::f32 top, irr::f32 znear, irr::f32 zfar);
 	void InitStaticText(irr::gui::IGUIStaticText* pControl, irr::u32 cWidth, irr::u32 cHeight, irr::gui::CGUITTFont* font, const wchar_t* text);
@@ -390,6 +392,7 @@ public:
 	void RefreshDeck(irr::gui::IGUIComboBox* cbCategory, irr::gui::IGUIComboBox* cbDeck);
 	void RefreshDeck(const wchar_t* deckpath, const std::function<void(const wchar_t*)>& additem);
 	void RefreshReplay();
+	void FilterReplay();
 	void RefreshSingleplay();
 	void RefreshBot();
 	void DrawSelectionLine(irr::video::S3DVertex* vec, bool strip, int width, float* cv);
@@ -477,6 +480,7 @@ public:
 	std::vector<int> logParam;
 	std::wstring chatMsg[8];
 	std::vector<BotInfo> botInfo;
+	std::vector<std::wstring> replayFiles;
 
 	int hideChatTimer{};
 	bool hideChat{};
@@ -635,6 +639,7 @@ public:
 	//replay
 	irr::gui::IGUIWindow* wReplay;
 	irr::gui::IGUIListBox* lstReplayList;
+	irr::gui::IGUIEditBox* ebReplayFilter;
 	irr::gui::IGUIStaticText* stReplayInfo;
 	irr::gui::IGUIButton* btnLoadReplay;
 	irr::gui::IGUIButton* btnDeleteReplay;
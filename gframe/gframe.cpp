@@ -1,9 +1,12 @@
 #include "config.h"
 #include "game.h"
 #include "data_manager.h"
+#include "netserver.h"
+#include "replay_verifier.h"
 #include <event2/thread.h>
 #include <clocale>
 #include <memory>
+#include <thread>
 #ifdef __APPLE__
 #import <CoreFoundation/CoreFoundation.h>
 #endif
@@ -71,6 +74,17 @@ int main(int argc, char* argv[]) {
 #endif //_WIN32
 	ygo::Game _game;
 	ygo::mainGame = &_game;
+	if(argc >= 2 && !std::strcmp(argv[1], "--verify-replays")) { // check replays without a window
+		if(!ygo::mainGame->InitializeHeadless())
+			return EXIT_FAILURE;
+		wchar_t dir[256] = L"./replay";
+		if(argc >= 3)
+			BufferIO::DecodeUTF8(argv[2], dir);
+		unsigned int threads = std::thread::hardware_concurrency();
+		if(argc >= 4)
+			threads = (unsigned int)std::strtoul(argv[3], nullptr, 10);
+		return ygo::ReplayVerifier::Run(dir, threads);
+	}
 	if(!ygo::mainGame->Initialize())
 		return 0;
 
@@ -89,6 +103,40 @@ int main(int argc, char* argv[]) {
 
 	bool keep_on_return = false;
 	bool deckCategorySpecified = false;
+	// the extra databases and the server options are handled before anything uses the card table or starts the server
+	bool has_server = false;
+	bool has_stats = false;
+	for(int i = 1; i < wargc; ++i) {
+		if(wargv[i][0] == L'-' && wargv[i][1] == L'e' && wargv[i][2] != L'\0')
+			ygo::dataManager.LoadDB(&wargv[i][2]);
+		else if(!std::wcscmp(wargv[i], L"-e")) { // extra database
+			++i;
+			if(i < wargc)
+				ygo::dataManager.LoadDB(wargv[i]);
+		} else if(!std::wcscmp(wargv[i], L"--server"))
+			has_server = true;
+		else if(!std::wcscmp(wargv[i], L"--stats"))
+			has_stats = true;
+		else if(!std::wcscmp(wargv[i], L"--replay-codec")) {
+			++i;
+			if(i < wargc && !std::wcscmp(wargv[i], L"lzma"))
+				ygo::NetServer::SetReplayCodec(ygo::Replay::CODEC_LZMA);
+			else if(i < wargc && !std::wcscmp(wargv[i], L"fast"))
+				ygo::NetServer::SetReplayCodec(ygo::Replay::CODEC_FAST);
+			else if(i < wargc && !std::wcscmp(wargv[i], L"store"))
+				ygo::NetServer::SetReplayCodec(ygo::Replay::CODEC_STORE);
+			else {
+				ygo::mainGame->ErrorLog("Unknown replay codec, use lzma, fast or store!");
+				return EXIT_FAILURE;
+			}
+		}
+	}
+	// the stats are written by the multi-room server only
+	if(has_stats && !has_server) {
+		ygo::mainGame->ErrorLog("--stats requires --server!");
+		return EXIT_FAILURE;
+	}
+	ygo::dataManager.Seal();
 	for(int i = 1; i < wargc; ++i) {
 		if (wargc == 2 && std::wcslen(wargv[1]) >= 4) {
 			wchar_t* pstrext = wargv[1] + std::wcslen(wargv[1]) - 4;
@@ -108,14 +156,10 @@ int main(int argc, char* argv[]) {
 				break;
 			}
 		}
-		if(wargv[i][0] == L'-' && wargv[i][1] == L'e' && wargv[i][2] != L'\0') {
-			ygo::dataManager.LoadDB(&wargv[i][2]);
+		if(wargv[i][0] == L'-' && wargv[i][1] == L'e' && wargv[i][2] != L'\0') // loaded above
 			continue;
-		}
-		if(!std::wcscmp(wargv[i], L"-e")) { // extra database
+		if(!std::wcscmp(wargv[i], L"-e")) { // extra database, loaded above
 			++i;
-			if(i < wargc)
-				ygo::dataManager.LoadDB(wargv[i]);
 			continue;
 		} else if(!std::wcscmp(wargv[i], L"-n")) { // nickName
 			++i;
@@ -137,6 +181,20 @@ int main(int argc, char* argv[]) {
 			if(i < wargc)
 				ygo::mainGame->ebJoinPass->setText(wargv[i]);
 			continue;
+		} else if(!std::wcscmp(wargv[i], L"--server")) { // multi-room server
+			unsigned short port = ygo::mainGame->gameConf.serverport;
+			if(i + 1 < wargc && wargv[i + 1][0] != L'-')
+				port = (unsigned short)std::wcstol(wargv[++i], nullptr, 10);
+			ygo::NetServer::StartServer(port, true);
+			continue;
+		} else if(!std::wcscmp(wargv[i], L"--stats")) { // server stats file
+			++i;
+			if(i < wargc)
+				ygo::ServerStats::SetOutput(wargv[i]);
+			continue;
+		} else if(!std::wcscmp(wargv[i], L"--replay-codec")) { // replay compression of the server, set above
+			++i;
+			continue;
 		} else if(!std::wcscmp(wargv[i], L"-k")) { // Keep on return
 			exit_on_return = false;
 			keep_on_return = true;
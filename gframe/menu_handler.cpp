@@ -5,6 +5,7 @@
 #include "duelclient.h"
 #include "deck_manager.h"
 #include "replay_mode.h"
+#include "replay_index.h"
 #include "single_mode.h"
 #include "image_manager.h"
 #include "sound_manager.h"
@@ -20,11 +21,11 @@ void UpdateDeck() {
 	BufferIO::Write<int32_t>(pdeck, static_cast<int32_t>(deckManager.current_deck.main.size() + deckManager.current_deck.area.size()));
 	BufferIO::Write<int32_t>(pdeck, static_cast<int32_t>(deckManager.current_deck.side.size()));
 	for(size_t i = 0; i < deckManager.current_deck.main.size(); ++i)
-		BufferIO::Write<uint32_t>(pdeck, deckManager.current_deck.main[i]->first);
+		BufferIO::Write<uint32_t>(pdeck, deckManager.current_deck.main[i]->code);
 	for(size_t i = 0; i < deckManager.current_deck.area.size(); ++i)
-		BufferIO::Write<uint32_t>(pdeck, deckManager.current_deck.area[i]->first);
+		BufferIO::Write<uint32_t>(pdeck, deckManager.current_deck.area[i]->code);
 	for(size_t i = 0; i < deckManager.current_deck.side.size(); ++i)
-		BufferIO::Write<uint32_t>(pdeck, deckManager.current_deck.side[i]->first);
+		BufferIO::Write<uint32_t>(pdeck, deckManager.current_deck.side[i]->code);
 	DuelClient::SendBufferToServer(CTOS_UPDATE_DECK, deckbuf, pdeck - deckbuf);
 }
 bool MenuHandler::OnEvent(const irr::SEvent& event) {
@@ -468,6 +469,8 @@ bool MenuHandler::OnEvent(const irr::SEvent& event) {
 				mainGame->HideElement(mainGame->wQuery);
 				if(prev_operation == BUTTON_DELETE_REPLAY) {
 					if(Replay::DeleteReplay(mainGame->lstReplayList->getListItem(prev_sel))) {
+						auto& files = mainGame->replayFiles;
+						files.erase(std::remove(files.begin(), files.end(), mainGame->lstReplayList->getListItem(prev_sel)), files.end());
 						mainGame->stReplayInfo->setText(L"");
 						mainGame->lstReplayList->removeItem(prev_sel);
 					}
@@ -491,6 +494,8 @@ bool MenuHandler::OnEvent(const irr::SEvent& event) {
 						myswprintf(newname, L"%ls.yrp", mainGame->ebRSName->getText());
 					}
 					if(Replay::RenameReplay(mainGame->lstReplayList->getListItem(prev_sel), newname)) {
+						auto& files = mainGame->replayFiles;
+						std::replace(files.begin(), files.end(), std::wstring(mainGame->lstReplayList->getListItem(prev_sel)), std::wstring(newname));
 						mainGame->lstReplayList->setItem(prev_sel, newname, -1);
 					} else {
 						mainGame->env->addMessageBox(L"", dataManager.GetSysString(1365));
@@ -531,17 +536,21 @@ bool MenuHandler::OnEvent(const irr::SEvent& event) {
 				auto filename = mainGame->lstReplayList->getListItem(sel);
 				if (!filename)
 					break;
-				wchar_t replay_path[256]{};
-				myswprintf(replay_path, L"./replay/%ls", filename);
-				if (!temp_replay.OpenReplay(replay_path)) {
-					mainGame->stReplayInfo->setText(L"Error");
-					break;
+				ReplayInfo info;
+				if (!replayIndex.GetInfo(filename, info)) {
+					wchar_t replay_path[256]{};
+					myswprintf(replay_path, L"./replay/%ls", filename);
+					if (!temp_replay.OpenReplayInfo(replay_path)) {
+						mainGame->stReplayInfo->setText(L"Error");
+						break;
+					}
+					info.Load(temp_replay);
 				}
 				wchar_t infobuf[256]{};
 				std::wstring repinfo;
 				time_t curtime;
-				const auto& rh = temp_replay.pheader.base;
-				if(temp_replay.pheader.base.flag & REPLAY_UNIFORM)
+				const auto& rh = info.header.base;
+				if(rh.flag & REPLAY_UNIFORM)
 					curtime = rh.start_time;
 				else{
 					curtime = rh.seed;
@@ -553,16 +562,20 @@ bool MenuHandler::OnEvent(const irr::SEvent& event) {
 				repinfo.append(infobuf);
 				if (rh.flag & REPLAY_SINGLE_MODE) {
 					wchar_t path[256]{};
-					BufferIO::DecodeUTF8(temp_replay.script_name.c_str(), path);
+					BufferIO::DecodeUTF8(info.script_name.c_str(), path);
 					repinfo.append(path);
 					repinfo.append(L"\n");
 				}
-				const auto& player_names = temp_replay.players;
+				const auto& player_names = info.players;
 				if(rh.flag & REPLAY_TAG)
 					myswprintf(infobuf, L"%ls\n%ls\n===VS===\n%ls\n%ls\n", player_names[0].c_str(), player_names[1].c_str(), player_names[2].c_str(), player_names[3].c_str());
 				else
 					myswprintf(infobuf, L"%ls\n===VS===\n%ls\n", player_names[0].c_str(), player_names[1].c_str());
 				repinfo.append(infobuf);
+				if (info.turns) {
+					myswprintf(infobuf, L"%ls%u\n", dataManager.GetSysString(211), info.turns);
+					repinfo.append(infobuf);
+				}
 				mainGame->ebRepStartTurn->setText(L"1");
 				mainGame->SetStaticText(mainGame->stReplayInfo, 180, mainGame->guiFont, repinfo.c_str());
 				break;
@@ -652,6 +665,16 @@ bool MenuHandler::OnEvent(const irr::SEvent& event) {
 			}
 			break;
 		}
+		case irr::gui::EGET_EDITBOX_CHANGED: {
+			switch(id) {
+			case EDITBOX_REPLAY_FILTER: {
+				mainGame->stReplayInfo->setText(L"");
+				mainGame->FilterReplay();
+				break;
+			}
+			}
+			break;
+		}
 		case irr::gui::EGET_COMBO_BOX_CHANGED: {
 			switch(id) {
 			case COMBOBOX_BOT_RULE: {
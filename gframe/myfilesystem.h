@@ -7,7 +7,10 @@
 
 #ifndef _WIN32
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <vector>
 #include <algorithm>
 #endif
@@ -35,6 +38,21 @@ public:
 		return IsFileExists(wfile);
 	}
 
+	static bool GetFileInfo(const wchar_t* wfile, uint64_t& size, int64_t& mtime) {
+		WIN32_FILE_ATTRIBUTE_DATA data;
+		if(!GetFileAttributesExW(wfile, GetFileExInfoStandard, &data) || (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+			return false;
+		size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+		mtime = ((int64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+		return true;
+	}
+
+	static bool GetFileInfo(const char* file, uint64_t& size, int64_t& mtime) {
+		wchar_t wfile[1024];
+		BufferIO::DecodeUTF8(file, wfile);
+		return GetFileInfo(wfile, size, mtime);
+	}
+
 	static bool IsDirExists(const wchar_t* wdir) {
 		DWORD attr = GetFileAttributesW(wdir);
 		return attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY);
@@ -139,6 +157,21 @@ public:
 		return IsFileExists(file);
 	}
 
+	static bool GetFileInfo(const char* file, uint64_t& size, int64_t& mtime) {
+		struct stat fileStat;
+		if(stat(file, &fileStat) != 0 || S_ISDIR(fileStat.st_mode))
+			return false;
+		size = fileStat.st_size;
+		mtime = fileStat.st_mtime;
+		return true;
+	}
+
+	static bool GetFileInfo(const wchar_t* wfile, uint64_t& size, int64_t& mtime) {
+		char file[1024];
+		BufferIO::EncodeUTF8(wfile, file);
+		return GetFileInfo(file, size, mtime);
+	}
+
 	static bool IsDirExists(const char* dir) {
 		struct stat fileStat;
 		return (stat(dir, &fileStat) == 0) && S_ISDIR(fileStat.st_mode);
@@ -265,4 +298,79 @@ public:
 
 #endif // _WIN32
 
+// A read-only mapping of a whole file.
+class MappedFile {
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile() {
+		Close();
+	}
+
+#ifdef _WIN32
+	bool Open(const wchar_t* wfile) {
+		Close();
+		HANDLE file = CreateFileW(wfile, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if(file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER file_size;
+		HANDLE mapping = nullptr;
+		if(GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0 && (uint64_t)file_size.QuadPart <= SIZE_MAX)
+			mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);
+		if(!mapping)
+			return false;
+		view = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		CloseHandle(mapping);
+		if(!view)
+			return false;
+		length = (size_t)file_size.QuadPart;
+		return true;
+	}
+	void Close() {
+		if(view)
+			UnmapViewOfFile(view);
+		view = nullptr;
+		length = 0;
+	}
+#else
+	bool Open(const wchar_t* wfile) {
+		char file[1024];
+		BufferIO::EncodeUTF8(wfile, file);
+		Close();
+		int fd = open(file, O_RDONLY);
+		if(fd < 0)
+			return false;
+		struct stat fileStat;
+		void* addr = MAP_FAILED;
+		if(fstat(fd, &fileStat) == 0 && S_ISREG(fileStat.st_mode) && fileStat.st_size > 0)
+			addr = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if(addr == MAP_FAILED)
+			return false;
+		view = static_cast<const unsigned char*>(addr);
+		length = fileStat.st_size;
+		return true;
+	}
+	void Close() {
+		if(view)
+			munmap(const_cast<unsigned char*>(view), length);
+		view = nullptr;
+		length = 0;
+	}
+#endif // _WIN32
+
+	const unsigned char* data() const {
+		return view;
+	}
+	size_t size() const {
+		return length;
+	}
+
+private:
+	const unsigned char* view{};
+	size_t length{};
+};
+
 #endif //FILESYSTEM_H
@@ -3,24 +3,54 @@
 #include "single_duel.h"
 #include "tag_duel.h"
 #include "deck_manager.h"
+#include "lzma/LzmaLib.h"
+#include <chrono>
 #include <thread>
+#include <vector>
 
 namespace ygo {
-std::unordered_map<bufferevent*, DuelPlayer> NetServer::users;
+std::vector<ServerLoop*> NetServer::loops;
+std::atomic<int> NetServer::running_loops{ 0 };
+unsigned int NetServer::next_loop = 0;
 unsigned short NetServer::server_port = 0;
 event_base* NetServer::net_evbase = 0;
 event* NetServer::broadcast_ev = 0;
+event* NetServer::stats_ev = 0;
 evconnlistener* NetServer::listener = 0;
-DuelMode* NetServer::duel_mode = 0;
-unsigned char NetServer::net_server_write[SIZE_NETWORK_BUFFER];
-size_t NetServer::last_sent = 0;
+std::mutex NetServer::rooms_mutex;
+std::map<uint32_t, DuelMode*> NetServer::rooms;
+uint32_t NetServer::next_room_id = 1;
+bool NetServer::multi_room = false;
+thread_local int NetServer::batch_depth = 0;
+thread_local std::vector<DuelPlayer*> NetServer::batch_players;
+std::vector<std::thread> NetServer::replay_workers;
+std::mutex NetServer::replay_mutex;
+std::condition_variable NetServer::replay_cv;
+std::deque<ReplayJob*> NetServer::replay_queue;
+bool NetServer::replay_stopping = false;
+int NetServer::replay_codec = Replay::CODEC_LZMA;
 
-bool NetServer::StartServer(unsigned short port) {
+bool NetServer::StartServer(unsigned short port, bool is_multi_room) {
 	if(net_evbase)
 		return false;
-	net_evbase = event_base_new();
-	if(!net_evbase)
+	// the LAN host runs everything on one loop, a multi-room server uses one loop per core
+	unsigned int loop_count = 1;
+	if(is_multi_room)
+		loop_count = std::max(1U, std::thread::hardware_concurrency());
+	for(unsigned int i = 0; i < loop_count; ++i) {
+		event_base* evbase = event_base_new();
+		if(!evbase)
+			break;
+		ServerLoop* loop = new ServerLoop;
+		loop->evbase = evbase;
+		loops.push_back(loop);
+	}
+	if(loops.empty())
 		return false;
+	net_evbase = loops[0]->evbase;
+	multi_room = is_multi_room;
+	next_room_id = 1;
+	next_loop = 0;
 	sockaddr_in sin;
 	std::memset(&sin, 0, sizeof sin);
 	server_port = port;
@@ -30,17 +60,39 @@ bool NetServer::StartServer(unsigned short port) {
 	listener = evconnlistener_new_bind(net_evbase, ServerAccept, nullptr,
 	                                   LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE, -1, (sockaddr*)&sin, sizeof(sin));
 	if(!listener) {
-		event_base_free(net_evbase);
+		for(auto loop : loops) {
+			event_base_free(loop->evbase);
+			delete loop;
+		}
+		loops.clear();
 		net_evbase = 0;
 		return false;
 	}
 	evconnlistener_set_error_cb(listener, ServerAcceptError);
-	std::thread(ServerThread).detach();
+	if(multi_room) {
+		stats_ev = event_new(net_evbase, -1, EV_TIMEOUT | EV_PERSIST, StatsEvent, nullptr);
+		timeval timeout = { ServerStats::REPORT_INTERVAL, 0 };
+		event_add(stats_ev, &timeout);
+	}
+	for(auto loop : loops)
+		loop->replay_ev = event_new(loop->evbase, -1, 0, SendReplays, loop);
+	// replays are compressed off the loops, a duel ending does not stall the other rooms
+	unsigned int worker_count = 1;
+	if(is_multi_room)
+		worker_count = std::max(1U, std::thread::hardware_concurrency() / 2);
+	replay_stopping = false;
+	for(unsigned int i = 0; i < worker_count; ++i)
+		replay_workers.emplace_back(ReplayWorker);
+	running_loops = (int)loops.size();
+	for(auto loop : loops)
+		std::thread(ServerThread, loop).detach();
 	return true;
 }
 bool NetServer::StartBroadcast() {
 	if(!net_evbase)
 		return false;
+	if(broadcast_ev)
+		return true;
 	SOCKET udp = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
 	int opt = TRUE;
 	setsockopt(udp, SOL_SOCKET, SO_BROADCAST, (const char*)&opt, sizeof opt);
@@ -61,9 +113,23 @@ bool NetServer::StartBroadcast() {
 void NetServer::StopServer() {
 	if(!net_evbase)
 		return;
-	if(duel_mode)
-		duel_mode->EndDuel();
-	event_base_loopexit(net_evbase, 0);
+	// every loop ends its own duels
+	for(auto loop : loops)
+		event_base_once(loop->evbase, -1, EV_TIMEOUT, StopLoop, loop, nullptr);
+}
+void NetServer::StopLoop(evutil_socket_t fd, short events, void* arg) {
+	ServerLoop* loop = static_cast<ServerLoop*>(arg);
+	std::vector<DuelMode*> loop_rooms;
+	{
+		std::lock_guard<std::mutex> lock(rooms_mutex);
+		for(auto& room : rooms) {
+			if(event_get_base(room.second->etimer) == loop->evbase)
+				loop_rooms.push_back(room.second);
+		}
+	}
+	for(auto dm : loop_rooms)
+		dm->EndDuel();
+	event_base_loopexit(loop->evbase, 0);
 }
 void NetServer::StopBroadcast() {
 	if(!net_evbase || !broadcast_ev)
@@ -76,6 +142,9 @@ void NetServer::StopBroadcast() {
 	broadcast_ev = 0;
 }
 void NetServer::StopListen() {
+	// a multi-room server keeps accepting players for the other rooms
+	if(multi_room)
+		return;
 	evconnlistener_disable(listener);
 	StopBroadcast();
 }
@@ -94,27 +163,109 @@ void NetServer::BroadcastEvent(evutil_socket_t fd, short events, void* arg) {
 		sockTo.sin_addr.s_addr = bc_addr.sin_addr.s_addr;
 		sockTo.sin_family = AF_INET;
 		sockTo.sin_port = htons(7921);
-		HostPacket hp;
-		hp.identifier = NETWORK_SERVER_ID;
-		hp.port = server_port;
-		hp.version = PRO_VERSION;
-		hp.host = duel_mode->host_info;
-		BufferIO::CopyCharArray(duel_mode->name, hp.name);
-		sendto(fd, (const char*)&hp, sizeof(HostPacket), 0, (sockaddr*)&sockTo, sizeof(sockTo));
+		std::lock_guard<std::mutex> lock(rooms_mutex);
+		for(auto& room : rooms) {
+			DuelMode* dm = room.second;
+			if(dm->duel_stage != DUEL_STAGE_BEGIN)
+				continue;
+			HostPacket hp;
+			hp.identifier = NETWORK_SERVER_ID;
+			hp.port = server_port;
+			hp.version = PRO_VERSION;
+			hp.host = dm->host_info;
+			BufferIO::CopyCharArray(dm->name, hp.name);
+			sendto(fd, (const char*)&hp, sizeof(HostPacket), 0, (sockaddr*)&sockTo, sizeof(sockTo));
+		}
 	}
 }
 void NetServer::ServerAccept(evconnlistener* listener, evutil_socket_t fd, sockaddr* address, int socklen, void* ctx) {
-	bufferevent* bev = bufferevent_socket_new(net_evbase, fd, BEV_OPT_CLOSE_ON_FREE);
+	ServerLoop* loop = loops[next_loop++ % loops.size()];
+	if(loop->evbase == net_evbase)
+		AddPlayer(fd, EV_TIMEOUT, loop);
+	else
+		event_base_once(loop->evbase, fd, EV_TIMEOUT, AddPlayer, loop, nullptr);
+}
+void NetServer::ServerAcceptError(evconnlistener* listener, void* ctx) {
+	for(auto loop : loops)
+		event_base_loopexit(loop->evbase, 0);
+}
+ServerLoop* NetServer::GetLoop(event_base* evbase) {
+	for(auto loop : loops) {
+		if(loop->evbase == evbase)
+			return loop;
+	}
+	return nullptr;
+}
+// runs on the loop that owns the new connection
+void NetServer::AddPlayer(evutil_socket_t fd, short events, void* arg) {
+	ServerLoop* loop = static_cast<ServerLoop*>(arg);
+	// a batch is written at once, there is nothing to gain from waiting for more data
+	int nodelay = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&nodelay, sizeof nodelay);
+	bufferevent* bev = bufferevent_socket_new(loop->evbase, fd, BEV_OPT_CLOSE_ON_FREE);
 	DuelPlayer dp;
 	dp.name[0] = 0;
 	dp.type = 0xff;
 	dp.bev = bev;
-	users[bev] = dp;
-	bufferevent_setcb(bev, ServerEchoRead, nullptr, ServerEchoEvent, nullptr);
+	loop->users[bev] = dp;
+	bufferevent_setcb(bev, ServerEchoRead, nullptr, ServerEchoEvent, loop);
 	bufferevent_enable(bev, EV_READ);
 }
-void NetServer::ServerAcceptError(evconnlistener* listener, void* ctx) {
-	event_base_loopexit(net_evbase, 0);
+/*
+* Hand a player that is not in a room yet to another loop.
+* The packet that triggered the move is still in the input, it is handled again by the new loop.
+*/
+void NetServer::MovePlayer(DuelPlayer* dp, ServerLoop* loop) {
+	bufferevent* bev = dp->bev;
+	ServerLoop* current = GetLoop(bufferevent_get_base(bev));
+	PlayerHandoff* handoff = new PlayerHandoff;
+	handoff->loop = loop;
+	std::memcpy(handoff->name, dp->name, sizeof handoff->name);
+	handoff->compression = dp->compression;
+	handoff->update_delta = dp->update_delta;
+	handoff->replay_chunks = dp->replay_chunks;
+	// the replays of the old loop are not carried over
+	FlushHeld(dp);
+	evbuffer* input = bufferevent_get_input(bev);
+	size_t input_len = evbuffer_get_length(input);
+	if(input_len) {
+		handoff->input.resize(input_len);
+		evbuffer_remove(input, handoff->input.data(), input_len);
+	}
+	evbuffer* output = bufferevent_get_output(bev);
+	size_t output_len = evbuffer_get_length(output);
+	if(output_len) {
+		handoff->output.resize(output_len);
+		evbuffer_remove(output, handoff->output.data(), output_len);
+	}
+	evutil_socket_t fd = bufferevent_getfd(bev);
+	// keep the socket open, the new loop takes it over
+	bufferevent_disable(bev, EV_READ | EV_WRITE);
+	bufferevent_setfd(bev, -1);
+	bufferevent_free(bev);
+	current->users.erase(bev);
+	event_base_once(loop->evbase, fd, EV_TIMEOUT, AdoptPlayer, handoff, nullptr);
+}
+void NetServer::AdoptPlayer(evutil_socket_t fd, short events, void* arg) {
+	PlayerHandoff* handoff = static_cast<PlayerHandoff*>(arg);
+	ServerLoop* loop = handoff->loop;
+	bufferevent* bev = bufferevent_socket_new(loop->evbase, fd, BEV_OPT_CLOSE_ON_FREE);
+	DuelPlayer dp;
+	std::memcpy(dp.name, handoff->name, sizeof dp.name);
+	dp.compression = handoff->compression;
+	dp.update_delta = handoff->update_delta;
+	dp.replay_chunks = handoff->replay_chunks;
+	dp.type = 0xff;
+	dp.bev = bev;
+	loop->users[bev] = dp;
+	bufferevent_setcb(bev, ServerEchoRead, nullptr, ServerEchoEvent, loop);
+	if(handoff->output.size())
+		bufferevent_write(bev, handoff->output.data(), handoff->output.size());
+	if(handoff->input.size())
+		evbuffer_add(bufferevent_get_input(bev), handoff->input.data(), handoff->input.size());
+	delete handoff;
+	bufferevent_enable(bev, EV_READ);
+	ServerEchoRead(bev, loop);
 }
 /*
 * packet_len: 2 bytes
@@ -122,26 +273,18 @@ void NetServer::ServerAcceptError(evconnlistener* listener, void* ctx) {
 * [data]: (packet_len - 1) bytes
 */
 void NetServer::ServerEchoRead(bufferevent *bev, void *ctx) {
+	ServerLoop* loop = static_cast<ServerLoop*>(ctx);
 	evbuffer* input = bufferevent_get_input(bev);
-	int len = evbuffer_get_length(input);
-	if (len < 2)
-		return;
-	unsigned char* net_server_read = new unsigned char[SIZE_NETWORK_BUFFER];
-	uint16_t packet_len = 0;
-	while (len >= 2) {
-		evbuffer_copyout(input, &packet_len, sizeof packet_len);
-		if (len < packet_len + 2)
-			break;
-		int read_len = evbuffer_remove(input, net_server_read, packet_len + 2);
-		if (read_len > 2)
-			HandleCTOSPacket(&users[bev], &net_server_read[2], read_len - 2);
-		len -= packet_len + 2;
-	}
-	delete[] net_server_read;
+	ReadPackets(input, loop->scratch, [loop, bev](unsigned char* data, int packet_len) {
+		HandleCTOSPacket(&loop->users[bev], data, packet_len);
+		// the player was disconnected or moved to another loop
+		return loop->users.find(bev) != loop->users.end();
+	});
 }
 void NetServer::ServerEchoEvent(bufferevent* bev, short events, void* ctx) {
+	ServerLoop* loop = static_cast<ServerLoop*>(ctx);
 	if (events & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) {
-		DuelPlayer* dp = &users[bev];
+		DuelPlayer* dp = &loop->users[bev];
 		DuelMode* dm = dp->game;
 		if(dm)
 			dm->LeaveGame(dp);
@@ -149,40 +292,100 @@ void NetServer::ServerEchoEvent(bufferevent* bev, short events, void* ctx) {
 			DisconnectPlayer(dp);
 	}
 }
-int NetServer::ServerThread() {
-	event_base_dispatch(net_evbase);
-	for(auto bit = users.begin(); bit != users.end(); ++bit) {
+int NetServer::ServerThread(ServerLoop* loop) {
+	event_base_dispatch(loop->evbase);
+	// the workers may still hold replays of this loop
+	while(loop->replay_jobs)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	event_free(loop->replay_ev);
+	loop->replay_ev = 0;
+	for(auto bit = loop->users.begin(); bit != loop->users.end(); ++bit) {
+		for(auto job : bit->second.held_by)
+			DropHold(job);
+		for(auto held : bit->second.held_output)
+			evbuffer_free(held);
+		if(bit->second.pending)
+			evbuffer_free(bit->second.pending);
 		bufferevent_disable(bit->first, EV_READ);
 		bufferevent_free(bit->first);
 	}
-	users.clear();
-	evconnlistener_free(listener);
-	listener = 0;
-	if(broadcast_ev) {
-		evutil_socket_t fd;
-		event_get_assignment(broadcast_ev, 0, &fd, 0, 0, 0);
-		evutil_closesocket(fd);
-		event_free(broadcast_ev);
-		broadcast_ev = 0;
-	}
-	if(duel_mode) {
-		event_free(duel_mode->etimer);
-		delete duel_mode;
-	}
-	duel_mode = 0;
-	event_base_free(net_evbase);
-	net_evbase = 0;
+	loop->users.clear();
+	for(auto job : loop->finished_replays)
+		delete job;
+	loop->finished_replays.clear();
+	if(loop->evbase == net_evbase) {
+		evconnlistener_free(listener);
+		listener = 0;
+		if(broadcast_ev) {
+			evutil_socket_t fd;
+			event_get_assignment(broadcast_ev, 0, &fd, 0, 0, 0);
+			evutil_closesocket(fd);
+			event_free(broadcast_ev);
+			broadcast_ev = 0;
+		}
+		if(stats_ev) {
+			event_free(stats_ev);
+			stats_ev = 0;
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(rooms_mutex);
+		for(auto rit = rooms.begin(); rit != rooms.end(); ) {
+			DuelMode* dm = rit->second;
+			if(event_get_base(dm->etimer) == loop->evbase) {
+				event_free(dm->etimer);
+				delete dm;
+				rit = rooms.erase(rit);
+			} else
+				++rit;
+		}
+	}
+	event_base_free(loop->evbase);
+	loop->evbase = 0;
+	// the last loop resets the server
+	if(--running_loops == 0) {
+		{
+			std::lock_guard<std::mutex> lock(replay_mutex);
+			replay_stopping = true;
+		}
+		replay_cv.notify_all();
+		for(auto& worker : replay_workers)
+			worker.join();
+		replay_workers.clear();
+		for(auto ploop : loops)
+			delete ploop;
+		loops.clear();
+		net_evbase = 0;
+	}
 	return 0;
 }
 void NetServer::DisconnectPlayer(DuelPlayer* dp) {
-	auto bit = users.find(dp->bev);
-	if(bit != users.end()) {
+	ServerLoop* loop = GetLoop(bufferevent_get_base(dp->bev));
+	if(!loop)
+		return;
+	auto bit = loop->users.find(dp->bev);
+	if(bit != loop->users.end()) {
+		FlushHeld(dp);
 		bufferevent_flush(dp->bev, EV_WRITE, BEV_FLUSH);
 		bufferevent_disable(dp->bev, EV_READ);
 		bufferevent_free(dp->bev);
-		users.erase(bit);
+		loop->users.erase(bit);
 	}
 }
+// Writes the output held back for dp, without the replays it still waits for.
+void NetServer::FlushHeld(DuelPlayer* dp) {
+	if(!dp->pending)
+		return;
+	if(dp->held_by.empty())
+		batch_players.erase(std::find(batch_players.begin(), batch_players.end(), dp));
+	for(auto job : dp->held_by)
+		DropHold(job);
+	dp->held_by.clear();
+	for(auto held : dp->held_output)
+		WriteOutput(dp, held);
+	dp->held_output.clear();
+	WritePending(dp);
+}
 void NetServer::HandleCTOSPacket(DuelPlayer* dp, unsigned char* data, int len) {
 	auto pdata = data;
 	unsigned char pktType = BufferIO::Read<uint8_t>(pdata);
@@ -190,17 +393,17 @@ void NetServer::HandleCTOSPacket(DuelPlayer* dp, unsigned char* data, int len) {
 		return;
 	switch(pktType) {
 	case CTOS_RESPONSE: {
-		if(!dp->game || !duel_mode->pduel)
+		if(!dp->game || !dp->game->pduel)
 			return;
 		if (len < 1 + (int)sizeof(unsigned char))
 			return;
-		duel_mode->GetResponse(dp, pdata, len - 1);
+		dp->game->GetResponse(dp, pdata, len - 1);
 		break;
 	}
 	case CTOS_TIME_CONFIRM: {
-		if(!dp->game || !duel_mode->pduel)
+		if(!dp->game || !dp->game->pduel)
 			return;
-		duel_mode->TimeConfirm(dp);
+		dp->game->TimeConfirm(dp);
 		break;
 	}
 	case CTOS_CHAT: {
@@ -212,7 +415,7 @@ void NetServer::HandleCTOSPacket(DuelPlayer* dp, unsigned char* data, int len) {
 			return;
 		if ((len - 1) % sizeof(uint16_t))
 			return;
-		duel_mode->Chat(dp, pdata, len - 1);
+		dp->game->Chat(dp, pdata, len - 1);
 		break;
 	}
 	case CTOS_UPDATE_DECK: {
@@ -222,7 +425,7 @@ void NetServer::HandleCTOSPacket(DuelPlayer* dp, unsigned char* data, int len) {
 			return;
 		if (len > 1 + (int)sizeof(CTOS_DeckData))
 			return;
-		duel_mode->UpdateDeck(dp, pdata, len - 1);
+		dp->game->UpdateDeck(dp, pdata, len - 1);
 		break;
 	}
 	case CTOS_HAND_RESULT: {
@@ -257,6 +460,18 @@ void NetServer::HandleCTOSPacket(DuelPlayer* dp, unsigned char* data, int len) {
 		BufferIO::CopyCharArray(pkt->name, dp->name);
 		break;
 	}
+	case CTOS_COMPRESSION: {
+		dp->compression = true;
+		break;
+	}
+	case CTOS_UPDATE_DELTA: {
+		dp->update_delta = true;
+		break;
+	}
+	case CTOS_REPLAY_CHUNKS: {
+		dp->replay_chunks = true;
+		break;
+	}
 	case CTOS_EXTERNAL_ADDRESS: {
 		// for other server & reverse proxy use only
 		/*
@@ -267,7 +482,7 @@ void NetServer::HandleCTOSPacket(DuelPlayer* dp, unsigned char* data, int len) {
 		break;
 	}
 	case CTOS_CREATE_GAME: {
-		if(dp->game || duel_mode)
+		if(dp->game || (!multi_room && !rooms.empty()))
 			return;
 		if (len < 1 + (int)sizeof(CTOS_CreateGame))
 			return;
@@ -291,85 +506,469 @@ void NetServer::HandleCTOSPacket(DuelPlayer* dp, unsigned char* data, int len) {
 			else
 				pkt->info.lflist = 0;
 		}
-		if (pkt->info.mode == MODE_SINGLE) {
-			duel_mode = new SingleDuel(false);
-			duel_mode->etimer = event_new(net_evbase, 0, EV_TIMEOUT | EV_PERSIST, SingleDuel::SingleTimer, duel_mode);
-		}
-		else if (pkt->info.mode == MODE_MATCH) {
-			duel_mode = new SingleDuel(true);
-			duel_mode->etimer = event_new(net_evbase, 0, EV_TIMEOUT | EV_PERSIST, SingleDuel::SingleTimer, duel_mode);
-		}
-		else if (pkt->info.mode == MODE_TAG) {
-			duel_mode = new TagDuel();
-			duel_mode->etimer = event_new(net_evbase, 0, EV_TIMEOUT | EV_PERSIST, TagDuel::TagTimer, duel_mode);
-		}
-		else
-			return;
-		duel_mode->host_info = pkt->info;
 		BufferIO::NullTerminate(pkt->name);
 		BufferIO::NullTerminate(pkt->pass);
-		BufferIO::CopyCharArray(pkt->name, duel_mode->name);
-		BufferIO::CopyCharArray(pkt->pass, duel_mode->pass);
-		duel_mode->JoinGame(dp, 0, true);
-		StartBroadcast();
+		DuelMode* dm = CreateRoom(*pkt, bufferevent_get_base(dp->bev));
+		if (!dm)
+			return;
+		STOC_CreateGame sccg;
+		sccg.gameid = dm->room_id;
+		SendPacketToPlayer(dp, STOC_CREATE_GAME, sccg);
+		dm->JoinGame(dp, 0, true);
+		if (!multi_room)
+			StartBroadcast();
 		break;
 	}
 	case CTOS_JOIN_GAME: {
-		if (!duel_mode)
-			return;
 		if (len < 1 + (int)sizeof(CTOS_JoinGame))
 			return;
-		duel_mode->JoinGame(dp, pdata, false);
+		CTOS_JoinGame packet;
+		std::memcpy(&packet, pdata, sizeof packet);
+		event_base* room_base = nullptr;
+		DuelMode* dm = FindRoom(packet.gameid, room_base);
+		if (!dm) {
+			STOC_ErrorMsg scem;
+			scem.msg = ERRMSG_JOINERROR;
+			scem.code = 0;
+			SendPacketToPlayer(dp, STOC_ERROR_MSG, scem);
+			return;
+		}
+		if (room_base != bufferevent_get_base(dp->bev)) {
+			if (!dp->game)
+				MovePlayer(dp, GetLoop(room_base));
+			return;
+		}
+		dm->JoinGame(dp, pdata, false);
 		break;
 	}
 	case CTOS_LEAVE_GAME: {
-		if (!duel_mode)
+		if (!dp->game)
 			return;
-		duel_mode->LeaveGame(dp);
+		dp->game->LeaveGame(dp);
 		break;
 	}
 	case CTOS_SURRENDER: {
-		if (!duel_mode)
+		if (!dp->game)
 			return;
-		duel_mode->Surrender(dp);
+		dp->game->Surrender(dp);
 		break;
 	}
 	case CTOS_HS_TODUELIST: {
-		if (!duel_mode || duel_mode->pduel)
+		if (!dp->game || dp->game->pduel)
 			return;
-		duel_mode->ToDuelist(dp);
+		dp->game->ToDuelist(dp);
 		break;
 	}
 	case CTOS_HS_TOOBSERVER: {
-		if (!duel_mode || duel_mode->pduel)
+		if (!dp->game || dp->game->pduel)
 			return;
-		duel_mode->ToObserver(dp);
+		dp->game->ToObserver(dp);
 		break;
 	}
 	case CTOS_HS_READY:
 	case CTOS_HS_NOTREADY: {
-		if (!duel_mode || duel_mode->pduel)
+		if (!dp->game || dp->game->pduel)
 			return;
-		duel_mode->PlayerReady(dp, (CTOS_HS_NOTREADY - pktType) != 0);
+		dp->game->PlayerReady(dp, (CTOS_HS_NOTREADY - pktType) != 0);
 		break;
 	}
 	case CTOS_HS_KICK: {
-		if (!duel_mode || duel_mode->pduel)
+		if (!dp->game || dp->game->pduel)
 			return;
 		if (len < 1 + (int)sizeof(CTOS_Kick))
 			return;
 		CTOS_Kick packet;
 		std::memcpy(&packet, pdata, sizeof packet);
 		const auto* pkt = &packet;
-		duel_mode->PlayerKick(dp, pkt->pos);
+		dp->game->PlayerKick(dp, pkt->pos);
 		break;
 	}
 	case CTOS_HS_START: {
-		if (!duel_mode || duel_mode->pduel)
+		if (!dp->game || dp->game->pduel)
 			return;
-		duel_mode->StartDuel(dp);
+		dp->game->StartDuel(dp);
 		break;
 	}
+	case CTOS_REQUEST_FIELD: {
+		if (!dp->game || !dp->game->pduel)
+			return;
+		dp->game->RequestField(dp);
+		break;
+	}
+	}
+}
+/*
+* The room is pinned to evbase, the loop of its creator.
+* The fields the listener reads are set before the room is added to rooms.
+*/
+DuelMode* NetServer::CreateRoom(const CTOS_CreateGame& packet, event_base* evbase) {
+	const HostInfo& info = packet.info;
+	DuelMode* dm = nullptr;
+	if (info.mode == MODE_SINGLE) {
+		dm = new SingleDuel(false);
+		dm->etimer = event_new(evbase, 0, EV_TIMEOUT | EV_PERSIST, SingleDuel::SingleTimer, dm);
+	}
+	else if (info.mode == MODE_MATCH) {
+		dm = new SingleDuel(true);
+		dm->etimer = event_new(evbase, 0, EV_TIMEOUT | EV_PERSIST, SingleDuel::SingleTimer, dm);
+	}
+	else if (info.mode == MODE_TAG) {
+		dm = new TagDuel();
+		dm->etimer = event_new(evbase, 0, EV_TIMEOUT | EV_PERSIST, TagDuel::TagTimer, dm);
+	}
+	else
+		return nullptr;
+	dm->host_info = info;
+	BufferIO::CopyCharArray(packet.name, dm->name);
+	BufferIO::CopyCharArray(packet.pass, dm->pass);
+	std::lock_guard<std::mutex> lock(rooms_mutex);
+	dm->room_id = next_room_id++;
+	rooms[dm->room_id] = dm;
+	return dm;
+}
+/*
+* gameid 0 is sent by the LAN client, it joins the oldest room that has not started.
+* evbase: the loop of the room, the room may only be used on that loop
+*/
+DuelMode* NetServer::FindRoom(uint32_t gameid, event_base*& evbase) {
+	std::lock_guard<std::mutex> lock(rooms_mutex);
+	auto rit = rooms.end();
+	if (gameid == 0) {
+		rit = std::find_if(rooms.begin(), rooms.end(), [](const std::pair<const uint32_t, DuelMode*>& room) {
+			return room.second->duel_stage == DUEL_STAGE_BEGIN;
+		});
+	} else
+		rit = rooms.find(gameid);
+	if (rit == rooms.end())
+		return nullptr;
+	evbase = event_get_base(rit->second->etimer);
+	return rit->second;
+}
+void NetServer::CloseRoom(DuelMode* dm) {
+	if (!multi_room) {
+		StopServer();
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(rooms_mutex);
+		auto rit = rooms.find(dm->room_id);
+		if (rit == rooms.end())
+			return;
+		rooms.erase(rit);
+	}
+	dm->EndDuel();
+	event_base* evbase = event_get_base(dm->etimer);
+	ServerLoop* loop = GetLoop(evbase);
+	std::vector<DuelPlayer*> members;
+	for (auto& user : loop->users) {
+		if (user.second.game == dm)
+			members.push_back(&user.second);
+	}
+	for (auto dp : members)
+		DisconnectPlayer(dp);
+	event_del(dm->etimer);
+	// the room may still be on the call stack
+	event_base_once(evbase, -1, EV_TIMEOUT, FreeRoom, dm, nullptr);
+}
+void NetServer::FreeRoom(evutil_socket_t fd, short events, void* arg) {
+	DuelMode* dm = static_cast<DuelMode*>(arg);
+	event_free(dm->etimer);
+	delete dm;
+}
+/*
+* Runs on the first loop. The connection counts of each loop are sampled by the loop itself,
+* the report shows the samples of the previous interval.
+*/
+void NetServer::StatsEvent(evutil_socket_t fd, short events, void* arg) {
+	if(!ServerStats::IsEnabled())
+		return;
+	FILE* fp = ServerStats::OpenOutput();
+	if(fp) {
+		WriteStats(fp);
+		std::fclose(fp);
+	}
+	for(auto loop : loops)
+		event_base_once(loop->evbase, -1, EV_TIMEOUT, SampleLoop, loop, nullptr);
+}
+void NetServer::SampleLoop(evutil_socket_t fd, short events, void* arg) {
+	ServerLoop* loop = static_cast<ServerLoop*>(arg);
+	size_t observers = 0, backlog = 0, max_backlog = 0;
+	for(auto& user : loop->users) {
+		if(user.second.type == NETPLAYER_TYPE_OBSERVER)
+			++observers;
+		size_t len = evbuffer_get_length(bufferevent_get_output(user.first));
+		backlog += len;
+		max_backlog = std::max(max_backlog, len);
+	}
+	loop->connections = loop->users.size();
+	loop->observers = observers;
+	loop->backlog = backlog;
+	loop->max_backlog = max_backlog;
+}
+void NetServer::WriteStats(FILE* fp) {
+	static uint64_t last_messages = 0;
+	static uint64_t last_bytes = 0;
+	uint64_t messages = ServerStats::messages.load(std::memory_order_relaxed);
+	uint64_t bytes = ServerStats::bytes_sent.load(std::memory_order_relaxed);
+	std::fprintf(fp, "messages=%llu per_second=%llu\n", (unsigned long long)messages,
+	             (unsigned long long)((messages - last_messages) / ServerStats::REPORT_INTERVAL));
+	std::fprintf(fp, "bytes_sent=%llu per_second=%llu\n", (unsigned long long)bytes,
+	             (unsigned long long)((bytes - last_bytes) / ServerStats::REPORT_INTERVAL));
+	last_messages = messages;
+	last_bytes = bytes;
+	// the histograms cover the last interval
+	ServerStats::engine_step.Take().Print(fp, "engine_step");
+	ServerStats::analyze.Take().Print(fp, "analyze");
+	ServerStats::query_field.Take().Print(fp, "query_field_card");
+	ServerStats::replay_compress.Take().Print(fp, "replay_compress");
+	std::fprintf(fp, "replay_bytes=%llu compressed=%llu\n",
+	             (unsigned long long)ServerStats::replay_bytes.load(std::memory_order_relaxed),
+	             (unsigned long long)ServerStats::replay_compressed_bytes.load(std::memory_order_relaxed));
+	for(size_t i = 0; i < loops.size(); ++i) {
+		ServerLoop* loop = loops[i];
+		std::fprintf(fp, "loop=%u connections=%u observers=%u backlog=%u max_backlog=%u\n", (unsigned int)i,
+		             (unsigned int)loop->connections, (unsigned int)loop->observers,
+		             (unsigned int)loop->backlog, (unsigned int)loop->max_backlog);
+	}
+	std::lock_guard<std::mutex> lock(rooms_mutex);
+	std::fprintf(fp, "rooms=%u\n", (unsigned int)rooms.size());
+	for(auto& room : rooms) {
+		DuelMode* dm = room.second;
+		std::fprintf(fp, "room=%u messages=%llu bytes_sent=%llu\n", room.first,
+		             (unsigned long long)dm->messages.load(std::memory_order_relaxed),
+		             (unsigned long long)dm->bytes_sent.load(std::memory_order_relaxed));
+	}
+}
+/*
+* Hold back the packets sent to players until EndBatch(), each player gets one write per batch.
+* A room starts a batch for each engine step, the batch is compressed as a whole if the player asked for it.
+*/
+void NetServer::BeginBatch() {
+	++batch_depth;
+}
+void NetServer::EndBatch() {
+	if(--batch_depth)
+		return;
+	// the observers usually get the same output, it is compressed once
+	std::vector<CompressedBatch> compressed;
+	for(auto dp : batch_players)
+		WritePending(dp, &compressed);
+	for(auto& batch : compressed)
+		evbuffer_free(batch.pending);
+	batch_players.clear();
+}
+void NetServer::WritePending(DuelPlayer* dp, std::vector<CompressedBatch>* compressed) {
+	evbuffer* pending = dp->pending;
+	dp->pending = nullptr;
+	WriteOutput(dp, pending, compressed);
+}
+/*
+* Writes and frees pending.
+* A compressed batch is added to compressed and its output is kept until the caller frees it.
+* A later player with the same output gets the same packet.
+*/
+void NetServer::WriteOutput(DuelPlayer* dp, evbuffer* pending, std::vector<CompressedBatch>* compressed) {
+	size_t len = evbuffer_get_length(pending);
+	if(!dp->compression || len < MIN_COMPRESS_SIZE || len > MAX_COMPRESSED_BATCH) {
+		bufferevent_write_buffer(dp->bev, pending);
+		CountSent(dp, len);
+		evbuffer_free(pending);
+		return;
+	}
+	const unsigned char* data = evbuffer_pullup(pending, -1);
+	const CompressedBatch* batch = nullptr;
+	if(compressed) {
+		for(const auto& prev : *compressed) {
+			if(prev.len == len && !std::memcmp(prev.data, data, len)) {
+				batch = &prev;
+				break;
+			}
+		}
+	}
+	bool kept = false;
+	NetPacket packet;
+	if(batch) {
+		packet = batch->packet;
+	} else {
+		packet = CompressPackets(data, len);
+		if(compressed) {
+			compressed->push_back(CompressedBatch{ pending, data, len, packet });
+			kept = true;
+		}
+	}
+	if(packet) {
+		AddPacket(bufferevent_get_output(dp->bev), packet.get());
+		CountSent(dp, packet.get()->len);
+	} else if(kept) {
+		bufferevent_write(dp->bev, data, len);
+		CountSent(dp, len);
+	} else {
+		bufferevent_write_buffer(dp->bev, pending);
+		CountSent(dp, len);
+	}
+	if(!kept)
+		evbuffer_free(pending);
+}
+/*
+* Each batch is a complete LZMA stream, the vendored encoder has no flush between blocks.
+* Returns an empty packet if the batch does not shrink.
+*/
+NetPacket NetServer::CompressPackets(const unsigned char* packets, size_t len) {
+	static thread_local std::vector<unsigned char> comp_buffer(MAX_DATA_SIZE);
+	const size_t header_len = sizeof(uint32_t) + LZMA_PROPS_SIZE;
+	size_t comp_size = std::min(len, (size_t)MAX_DATA_SIZE) - header_len;
+	unsigned char props[LZMA_PROPS_SIZE];
+	size_t props_size = LZMA_PROPS_SIZE;
+	if(LzmaCompress(comp_buffer.data(), &comp_size, packets, len, props, &props_size, 1, 0x1U << 16, 3, 0, 2, 32, 1) != SZ_OK)
+		return NetPacket();
+	NetPacket packet(STOC_COMPRESSED, header_len + comp_size);
+	auto pbuf = packet.payload();
+	BufferIO::Write<uint32_t>(pbuf, (uint32_t)len);
+	std::memcpy(pbuf, props, LZMA_PROPS_SIZE);
+	pbuf += LZMA_PROPS_SIZE;
+	std::memcpy(pbuf, comp_buffer.data(), comp_size);
+	return packet;
+}
+/*
+* A replay fitting in one packet is sent as STOC_REPLAY, the packet older clients know.
+* Larger ones are split into STOC_REPLAY_START, STOC_REPLAY_DATA and STOC_REPLAY_END.
+*/
+std::vector<NetPacket> NetServer::CreateReplayPackets(const Replay& replay) {
+	std::vector<NetPacket> packets;
+	const size_t header_len = sizeof replay.pheader;
+	const size_t comp_len = replay.comp_data.size();
+	if (header_len + comp_len <= MAX_DATA_SIZE) {
+		NetPacket packet(STOC_REPLAY, header_len + comp_len);
+		std::memcpy(packet.payload(), &replay.pheader, header_len);
+		std::memcpy(packet.payload() + header_len, replay.comp_data.data(), comp_len);
+		packets.push_back(std::move(packet));
+		return packets;
+	}
+	NetPacket start(STOC_REPLAY_START, header_len + sizeof(uint32_t));
+	auto pbuf = start.payload();
+	std::memcpy(pbuf, &replay.pheader, header_len);
+	pbuf += header_len;
+	BufferIO::Write<uint32_t>(pbuf, (uint32_t)comp_len);
+	packets.push_back(std::move(start));
+	for (size_t pos = 0; pos < comp_len; pos += MAX_DATA_SIZE)
+		packets.push_back(CreatePacket(STOC_REPLAY_DATA, replay.comp_data.data() + pos, std::min(comp_len - pos, (size_t)MAX_DATA_SIZE)));
+	packets.push_back(CreatePacket(STOC_REPLAY_END));
+	return packets;
+}
+/*
+* Compress the recording of a finished duel on a worker.
+* players get the replay before anything sent to them after this call.
+*/
+void NetServer::SendReplay(DuelMode* dm, Replay& replay, const std::vector<DuelPlayer*>& players) {
+	ServerLoop* loop = GetLoop(event_get_base(dm->etimer));
+	if(!loop)
+		return;
+	ReplayJob* job = new ReplayJob;
+	job->loop = loop;
+	replay.EndRecord(job->replay);
+	for(auto dp : players) {
+		if(dp && !dp->replay_chunks)
+			job->chunked = false;
+		HoldPlayer(dp, job);
+	}
+	++loop->replay_jobs;
+	{
+		std::lock_guard<std::mutex> lock(replay_mutex);
+		replay_queue.push_back(job);
+	}
+	replay_cv.notify_one();
+}
+void NetServer::HoldPlayer(DuelPlayer* dp, ReplayJob* job) {
+	if(!dp)
+		return;
+	if(dp->held_by.empty()) {
+		// the output of the current batch goes before the replay, a held player is not part of the batch
+		if(dp->pending) {
+			batch_players.erase(std::find(batch_players.begin(), batch_players.end(), dp));
+			WritePending(dp);
+		}
+	} else {
+		// still waiting for an earlier replay, the output since then goes between the two
+		dp->held_output.push_back(dp->pending);
+		dp->pending = nullptr;
+	}
+	if(!dp->pending)
+		dp->pending = evbuffer_new();
+	dp->held_by.push_back(job);
+	++job->holders;
+}
+// Sends the finished replays at the front of the queue of dp, each followed by the output held after it.
+void NetServer::ReleasePlayer(DuelPlayer* dp) {
+	evbuffer* output = bufferevent_get_output(dp->bev);
+	while(!dp->held_by.empty() && dp->held_by.front()->done) {
+		ReplayJob* job = dp->held_by.front();
+		dp->held_by.pop_front();
+		for(auto& packet : job->packets) {
+			AddPacket(output, packet.get());
+			CountSent(dp, packet.get()->len);
+		}
+		DropHold(job);
+		if(dp->held_output.empty()) {
+			WritePending(dp);
+		} else {
+			WriteOutput(dp, dp->held_output.front());
+			dp->held_output.pop_front();
+		}
+	}
+}
+void NetServer::DropHold(ReplayJob* job) {
+	if(--job->holders == 0 && job->done)
+		delete job;
+}
+void NetServer::ReplayWorker() {
+	for(;;) {
+		ReplayJob* job;
+		{
+			std::unique_lock<std::mutex> lock(replay_mutex);
+			replay_cv.wait(lock, [] { return replay_stopping || !replay_queue.empty(); });
+			if(replay_queue.empty())
+				return;
+			job = replay_queue.front();
+			replay_queue.pop_front();
+		}
+		ServerStats::replay_bytes.fetch_add(job->replay.pheader.base.datasize, std::memory_order_relaxed);
+		{
+			StatsTimer timer(ServerStats::replay_compress);
+			job->replay.CompressRecord(replay_codec, job->chunked);
+		}
+		ServerStats::replay_compressed_bytes.fetch_add(job->replay.comp_data.size(), std::memory_order_relaxed);
+		ServerLoop* loop = job->loop;
+		{
+			std::lock_guard<std::mutex> lock(loop->replay_mutex);
+			loop->finished_replays.push_back(job);
+		}
+		event_active(loop->replay_ev, EV_TIMEOUT, 0);
+		--loop->replay_jobs;
+	}
+}
+/*
+* Runs on the loop. The players still held by a replay get it, followed by their held output.
+* A player waiting for an earlier replay keeps the finished ones until that one is sent.
+*/
+void NetServer::SendReplays(evutil_socket_t fd, short events, void* arg) {
+	ServerLoop* loop = static_cast<ServerLoop*>(arg);
+	std::vector<ReplayJob*> jobs;
+	{
+		std::lock_guard<std::mutex> lock(loop->replay_mutex);
+		jobs.swap(loop->finished_replays);
+	}
+	for(auto job : jobs) {
+		if(!job->holders) {
+			delete job;
+			continue;
+		}
+		job->packets = CreateReplayPackets(job->replay);
+		job->done = true;
+	}
+	for(auto& user : loop->users) {
+		DuelPlayer* dp = &user.second;
+		if(!dp->held_by.empty() && dp->held_by.front()->done)
+			ReleasePlayer(dp);
 	}
 }
 size_t NetServer::CreateChatPacket(unsigned char* src, int src_size, unsigned char* dst, uint16_t dst_player_type) {
@@ -2,24 +2,175 @@
 #define NETSERVER_H
 
 #include <unordered_map>
+#include <map>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <new>
 #include "config.h"
 #include "network.h"
+#include "server_stats.h"
+#include "replay.h"
 
 namespace ygo {
 
+// One event loop and the players it owns. A room and all of its players live on the same loop.
+struct ServerLoop {
+	event_base* evbase{};
+	std::unordered_map<bufferevent*, DuelPlayer> users;
+	// packets spanning evbuffer chains are copied here, one packet is handled at a time
+	std::vector<unsigned char> scratch;
+	// sampled on the loop itself for the stats report
+	std::atomic<size_t> connections{};
+	std::atomic<size_t> observers{};
+	std::atomic<size_t> backlog{};
+	std::atomic<size_t> max_backlog{};
+	// replays compressed by the workers, sent by replay_ev on the loop
+	event* replay_ev{};
+	std::mutex replay_mutex;
+	std::vector<ReplayJob*> finished_replays;
+	std::atomic<int> replay_jobs{};
+};
+
+/*
+* An encoded packet shared by all of its recipients.
+* Each recipient holds a reference until libevent has written the packet to the socket.
+*/
+struct SharedPacket {
+	std::atomic<int> refs;
+	size_t len;
+
+	unsigned char* data() {
+		return reinterpret_cast<unsigned char*>(this + 1);
+	}
+	static SharedPacket* Create(size_t len) {
+		void* mem = ::operator new(sizeof(SharedPacket) + len);
+		SharedPacket* packet = new (mem) SharedPacket;
+		packet->refs = 1;
+		packet->len = len;
+		return packet;
+	}
+	void AddRef() {
+		++refs;
+	}
+	void Release() {
+		if (--refs == 0) {
+			this->~SharedPacket();
+			::operator delete(this);
+		}
+	}
+	static void Cleanup(const void* data, size_t datalen, void* extra) {
+		static_cast<SharedPacket*>(extra)->Release();
+	}
+};
+
+/*
+* A reference to a SharedPacket, the packet is freed with its last reference.
+* The length and proto header are written in place, the payload follows them.
+*/
+class NetPacket {
+public:
+	NetPacket() = default;
+	NetPacket(unsigned char proto, size_t len) {
+		packet = SharedPacket::Create(len + 3);
+		auto p = packet->data();
+		BufferIO::Write<uint16_t>(p, (uint16_t)(1 + len));
+		BufferIO::Write<uint8_t>(p, proto);
+	}
+	NetPacket(const NetPacket& other) : packet(other.packet) {
+		if (packet)
+			packet->AddRef();
+	}
+	NetPacket(NetPacket&& other) noexcept : packet(other.packet) {
+		other.packet = nullptr;
+	}
+	NetPacket& operator=(NetPacket other) noexcept {
+		std::swap(packet, other.packet);
+		return *this;
+	}
+	~NetPacket() {
+		if (packet)
+			packet->Release();
+	}
+	unsigned char* payload() const {
+		return packet->data() + 3;
+	}
+	SharedPacket* get() const {
+		return packet;
+	}
+	explicit operator bool() const {
+		return packet != nullptr;
+	}
+
+private:
+	SharedPacket* packet{};
+};
+
+// The output of one player in a batch, the players with the same output share its compressed packet.
+struct CompressedBatch {
+	evbuffer* pending{};
+	const unsigned char* data{};
+	size_t len{};
+	// empty if the batch does not shrink
+	NetPacket packet;
+};
+
+// A finished replay compressed off the loop. The output of its players is held until it is sent.
+struct ReplayJob {
+	ServerLoop* loop{};
+	Replay replay;
+	// YRP3 only if every recipient reads it
+	bool chunked{ true };
+	// the players still waiting for it, the job is freed with the last one
+	int holders{};
+	// compressed, packets is set
+	bool done{};
+	std::vector<NetPacket> packets;
+};
+
+// A connection moving to the loop that owns the room it joins.
+struct PlayerHandoff {
+	ServerLoop* loop{};
+	uint16_t name[20]{};
+	bool compression{};
+	bool update_delta{};
+	bool replay_chunks{};
+	std::vector<unsigned char> input;
+	std::vector<unsigned char> output;
+};
+
 class NetServer {
 private:
-	static std::unordered_map<bufferevent*, DuelPlayer> users;
+	static std::vector<ServerLoop*> loops;
+	static std::atomic<int> running_loops;
+	static unsigned int next_loop;
 	static unsigned short server_port;
 	static event_base* net_evbase;
 	static event* broadcast_ev;
+	static event* stats_ev;
 	static evconnlistener* listener;
-	static DuelMode* duel_mode;
-	static unsigned char net_server_write[SIZE_NETWORK_BUFFER];
-	static size_t last_sent;
+	static std::mutex rooms_mutex;
+	static std::map<uint32_t, DuelMode*> rooms;
+	static uint32_t next_room_id;
+	static bool multi_room;
+	static thread_local int batch_depth;
+	static thread_local std::vector<DuelPlayer*> batch_players;
+	static std::vector<std::thread> replay_workers;
+	static std::mutex replay_mutex;
+	static std::condition_variable replay_cv;
+	static std::deque<ReplayJob*> replay_queue;
+	static bool replay_stopping;
+	static int replay_codec;
 
 public:
-	static bool StartServer(unsigned short port);
+	static constexpr size_t SMALL_PACKET_SIZE = 64;
+	// smaller batches are sent as they are
+	static constexpr size_t MIN_COMPRESS_SIZE = 256;
+
+	static bool StartServer(unsigned short port, bool is_multi_room = false);
 	static bool StartBroadcast();
 	static void StopServer();
 	static void StopBroadcast();
@@ -29,43 +180,105 @@ public:
 	static void ServerAcceptError(evconnlistener *listener, void* ctx);
 	static void ServerEchoRead(bufferevent* bev, void* ctx);
 	static void ServerEchoEvent(bufferevent* bev, short events, void* ctx);
-	static int ServerThread();
+	static int ServerThread(ServerLoop* loop);
+	static void StopLoop(evutil_socket_t fd, short events, void* arg);
+	static ServerLoop* GetLoop(event_base* evbase);
+	static void AddPlayer(evutil_socket_t fd, short events, void* arg);
+	static void MovePlayer(DuelPlayer* dp, ServerLoop* loop);
+	static void AdoptPlayer(evutil_socket_t fd, short events, void* arg);
 	static void DisconnectPlayer(DuelPlayer* dp);
+	static void FlushHeld(DuelPlayer* dp);
 	static void HandleCTOSPacket(DuelPlayer* dp, unsigned char* data, int len);
+	static DuelMode* CreateRoom(const CTOS_CreateGame& packet, event_base* evbase);
+	static DuelMode* FindRoom(uint32_t gameid, event_base*& evbase);
+	static void CloseRoom(DuelMode* dm);
+	static void FreeRoom(evutil_socket_t fd, short events, void* arg);
+	static bool IsMultiRoom() {
+		return multi_room;
+	}
+	static void StatsEvent(evutil_socket_t fd, short events, void* arg);
+	static void SampleLoop(evutil_socket_t fd, short events, void* arg);
+	static void WriteStats(FILE* fp);
+	static void BeginBatch();
+	static void EndBatch();
+	static void WritePending(DuelPlayer* dp, std::vector<CompressedBatch>* compressed = nullptr);
+	static void WriteOutput(DuelPlayer* dp, evbuffer* pending, std::vector<CompressedBatch>* compressed = nullptr);
+	static NetPacket CompressPackets(const unsigned char* packets, size_t len);
+	static std::vector<NetPacket> CreateReplayPackets(const Replay& replay);
+	static void SetReplayCodec(int codec) {
+		replay_codec = codec;
+	}
+	static void SendReplay(DuelMode* dm, Replay& replay, const std::vector<DuelPlayer*>& players);
+	static void HoldPlayer(DuelPlayer* dp, ReplayJob* job);
+	static void ReleasePlayer(DuelPlayer* dp);
+	static void DropHold(ReplayJob* job);
+	static void ReplayWorker();
+	static void SendReplays(evutil_socket_t fd, short events, void* arg);
 	static size_t CreateChatPacket(unsigned char* src, int src_size, unsigned char* dst, uint16_t dst_player_type);
-	static void SendPacketToPlayer(DuelPlayer* dp, unsigned char proto) {
-		auto p = net_server_write;
-		BufferIO::Write<uint16_t>(p, 1);
-		BufferIO::Write<uint8_t>(p, proto);
-		last_sent = 3;
-		if (dp)
-			bufferevent_write(dp->bev, net_server_write, 3);
+	static NetPacket CreatePacket(unsigned char proto) {
+		return NetPacket(proto, 0);
 	}
 	template<typename ST>
-	static void SendPacketToPlayer(DuelPlayer* dp, unsigned char proto, const ST& st) {
-		auto p = net_server_write;
+	static NetPacket CreatePacket(unsigned char proto, const ST& st) {
 		static_assert(sizeof(ST) <= MAX_DATA_SIZE, "Packet size is too large.");
-		BufferIO::Write<uint16_t>(p, (uint16_t)(1 + sizeof(ST)));
-		BufferIO::Write<uint8_t>(p, proto);
-		std::memcpy(p, &st, sizeof(ST));
-		last_sent = sizeof(ST) + 3;
-		if (dp)
-			bufferevent_write(dp->bev, net_server_write, sizeof(ST) + 3);
+		NetPacket packet(proto, sizeof(ST));
+		std::memcpy(packet.payload(), &st, sizeof(ST));
+		return packet;
 	}
-	static void SendBufferToPlayer(DuelPlayer* dp, unsigned char proto, void* buffer, size_t len) {
-		auto p = net_server_write;
+	static NetPacket CreatePacket(unsigned char proto, const void* buffer, size_t len) {
 		if (len > MAX_DATA_SIZE)
 			len = MAX_DATA_SIZE;
-		BufferIO::Write<uint16_t>(p, (uint16_t)(1 + len));
-		BufferIO::Write<uint8_t>(p, proto);
-		std::memcpy(p, buffer, len);
-		last_sent = len + 3;
-		if (dp)
-			bufferevent_write(dp->bev, net_server_write, len + 3);
-	}
-	static void ReSendToPlayer(DuelPlayer* dp) {
-		if(dp)
-			bufferevent_write(dp->bev, net_server_write, last_sent);
+		NetPacket packet(proto, len);
+		std::memcpy(packet.payload(), buffer, len);
+		return packet;
+	}
+	static NetPacket SendPacketToPlayer(DuelPlayer* dp, unsigned char proto) {
+		NetPacket packet = CreatePacket(proto);
+		ReSendToPlayer(dp, packet);
+		return packet;
+	}
+	template<typename ST>
+	static NetPacket SendPacketToPlayer(DuelPlayer* dp, unsigned char proto, const ST& st) {
+		NetPacket packet = CreatePacket(proto, st);
+		ReSendToPlayer(dp, packet);
+		return packet;
+	}
+	static NetPacket SendBufferToPlayer(DuelPlayer* dp, unsigned char proto, const void* buffer, size_t len) {
+		NetPacket packet = CreatePacket(proto, buffer, len);
+		ReSendToPlayer(dp, packet);
+		return packet;
+	}
+	// send a packet again, the payload is shared instead of copied
+	static void ReSendToPlayer(DuelPlayer* dp, const NetPacket& packet) {
+		if (dp && packet)
+			QueuePacket(dp, packet.get());
+	}
+	static void QueuePacket(DuelPlayer* dp, SharedPacket* packet) {
+		if (batch_depth || !dp->held_by.empty()) {
+			if (!dp->pending) {
+				dp->pending = evbuffer_new();
+				batch_players.push_back(dp);
+			}
+			AddPacket(dp->pending, packet);
+			return;
+		}
+		AddPacket(bufferevent_get_output(dp->bev), packet);
+		CountSent(dp, packet->len);
+	}
+	static void CountSent(DuelPlayer* dp, size_t len) {
+		ServerStats::bytes_sent.fetch_add(len, std::memory_order_relaxed);
+		if (dp->game)
+			dp->game->bytes_sent.fetch_add(len, std::memory_order_relaxed);
+	}
+	static void AddPacket(evbuffer* output, SharedPacket* packet) {
+		// a reference costs a chain of its own, small packets are cheaper to copy
+		if (packet->len <= SMALL_PACKET_SIZE) {
+			evbuffer_add(output, packet->data(), packet->len);
+			return;
+		}
+		packet->AddRef();
+		if (evbuffer_add_reference(output, packet->data(), packet->len, SharedPacket::Cleanup, packet) != 0)
+			packet->Release();
 	}
 };
 
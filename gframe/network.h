@@ -2,6 +2,7 @@
 #define NETWORK_H
 
 #include <cstdint>
+#include <atomic>
 #include <cstring>
 #include <event2/event.h>
 #include <event2/listener.h>
@@ -9,6 +10,8 @@
 #include <event2/buffer.h>
 #include <event2/thread.h>
 #include <type_traits>
+#include <vector>
+#include <deque>
 #include "deck_manager.h"
 
 #define check_trivially_copyable(T) static_assert(std::is_trivially_copyable<T>::value == true && std::is_standard_layout<T>::value == true, "not trivially copyable")
@@ -17,6 +20,8 @@ namespace ygo {
 
 constexpr int SIZE_NETWORK_BUFFER = 0x20000;
 constexpr int MAX_DATA_SIZE = UINT16_MAX - 1;
+// the largest batch sent as STOC_COMPRESSED, a larger one is sent as it is
+constexpr int MAX_COMPRESSED_BATCH = SIZE_NETWORK_BUFFER * 16;
 
 struct HostInfo {
 	uint32_t lflist{};
@@ -128,7 +133,7 @@ struct STOC_HandResult {
 check_trivially_copyable(STOC_HandResult);
 static_assert(sizeof(STOC_HandResult) == 2, "size mismatch: STOC_HandResult");
 
-// reserved for STOC_CREATE_GAME
+// STOC_CREATE_GAME, the id of a room created on a multi-room server
 struct STOC_CreateGame {
 	uint32_t gameid{};
 };
@@ -195,6 +200,7 @@ check_trivially_copyable(STOC_HS_WatchChange);
 static_assert(sizeof(STOC_HS_WatchChange) == 2, "size mismatch: STOC_HS_WatchChange");
 
 class DuelMode;
+struct ReplayJob;
 
 struct DuelPlayer {
 	uint16_t name[20]{};
@@ -202,6 +208,15 @@ struct DuelPlayer {
 	uint8_t type{};
 	uint8_t state{};
 	bufferevent* bev{};
+	bool compression{};
+	bool update_delta{};
+	bool replay_chunks{};
+	// output held back until the end of the current batch
+	evbuffer* pending{};
+	// the replays of its last duels are being compressed, the output is held back until they are sent in order
+	std::deque<ReplayJob*> held_by;
+	// held_output[i] goes between the replays held_by[i] and held_by[i + 1], pending follows the last one
+	std::deque<evbuffer*> held_output;
 };
 
 inline unsigned int GetPosition(unsigned char* qbuf, size_t offset) {
@@ -210,6 +225,57 @@ inline unsigned int GetPosition(unsigned char* qbuf, size_t offset) {
 	return info >> 24;
 }
 
+/*
+* Clear the records of cards an observer may not see in a query_field_card buffer.
+* face_up_only: hide every card that is not face-up, otherwise hide face-down cards
+*/
+inline void HideQueryData(unsigned char* qbuf, int len, bool face_up_only) {
+	int qlen = 0;
+	while (qlen < len) {
+		const int clen = BufferIO::Read<int32_t>(qbuf);
+		qlen += clen;
+		if (clen <= LEN_HEADER)
+			continue;
+		auto position = GetPosition(qbuf, 8);
+		if (face_up_only ? !(position & FACE_UP) : (position & FACE_DOWN))
+			std::memset(qbuf, 0, clen - 4);
+		qbuf += clen - 4;
+	}
+}
+
+/*
+* Pass each complete packet in input to handler(data, len), then drain it.
+* A packet inside one chain is passed in place. A packet that spans chains is copied to scratch first.
+* handler returns false if the connection is gone, and the input is not touched after that.
+*/
+template<typename Handler>
+void ReadPackets(evbuffer* input, std::vector<unsigned char>& scratch, Handler&& handler) {
+	size_t len = evbuffer_get_length(input);
+	while (len >= 2) {
+		uint16_t packet_len = 0;
+		evbuffer_copyout(input, &packet_len, sizeof packet_len);
+		const size_t frame_len = packet_len + 2;
+		if (len < frame_len)
+			break;
+		if (packet_len > 0) {
+			unsigned char* data = nullptr;
+			evbuffer_iovec extent;
+			if (evbuffer_peek(input, frame_len, nullptr, &extent, 1) == 1)
+				data = static_cast<unsigned char*>(extent.iov_base);
+			else {
+				if (scratch.size() < frame_len)
+					scratch.resize(frame_len);
+				evbuffer_copyout(input, scratch.data(), frame_len);
+				data = scratch.data();
+			}
+			if (!handler(data + 2, (int)packet_len))
+				return;
+		}
+		evbuffer_drain(input, frame_len);
+		len = evbuffer_get_length(input);
+	}
+}
+
 class DuelMode {
 public:
 	DuelMode() = default;
@@ -231,15 +297,22 @@ public:
 	virtual void GetResponse(DuelPlayer* dp, unsigned char* pdata, unsigned int len) = 0;
 	virtual void TimeConfirm(DuelPlayer* dp) = 0;
 	virtual void EndDuel() = 0;
+	virtual void RequestField(DuelPlayer* dp) {}
 
 public:
 	event* etimer { nullptr };
+	uint32_t room_id{};
 	DuelPlayer* host_player{ nullptr };
+	// host_info, name and pass are set before the room is published
 	HostInfo host_info;
-	int duel_stage{};
+	// read by the listener for the LAN broadcast and the room lookup
+	std::atomic<int> duel_stage{};
 	intptr_t pduel{};
 	wchar_t name[20]{};
 	wchar_t pass[20]{};
+	// read by the stats report on another loop
+	std::atomic<uint64_t> messages{};
+	std::atomic<uint64_t> bytes_sent{};
 };
 
 }
@@ -267,13 +340,16 @@ public:
 #define CTOS_TIME_CONFIRM	0x15	// no data
 #define CTOS_CHAT			0x16	// uint16_t array
 #define CTOS_EXTERNAL_ADDRESS	0x17	// CTOS_ExternalAddress
+#define CTOS_COMPRESSION	0x18	// no data, the client accepts STOC_COMPRESSED
+#define CTOS_UPDATE_DELTA	0x19	// no data, the client accepts MSG_UPDATE_DELTA
+#define CTOS_REPLAY_CHUNKS	0x1a	// no data, the client reads YRP3 replays
 #define CTOS_HS_TODUELIST	0x20	// no data
 #define CTOS_HS_TOOBSERVER	0x21	// no data
 #define CTOS_HS_READY		0x22	// no data
 #define CTOS_HS_NOTREADY	0x23	// no data
 #define CTOS_HS_KICK		0x24	// CTOS_Kick
 #define CTOS_HS_START		0x25	// no data
-#define CTOS_REQUEST_FIELD	0x30
+#define CTOS_REQUEST_FIELD	0x30	// no data
 
 #define STOC_GAME_MSG		0x1		// byte array
 #define STOC_ERROR_MSG		0x2		// STOC_ErrorMsg
@@ -284,7 +360,7 @@ public:
 #define STOC_CHANGE_SIDE	0x7		// no data
 #define STOC_WAITING_SIDE	0x8		// no data
 #define STOC_DECK_COUNT		0x9		// int16_t[6]
-#define STOC_CREATE_GAME	0x11	// reserved
+#define STOC_CREATE_GAME	0x11	// STOC_CreateGame, the LAN client ignores it
 #define STOC_JOIN_GAME		0x12	// STOC_JoinGame
 #define STOC_TYPE_CHANGE	0x13	// STOC_TypeChange
 #define STOC_LEAVE_GAME		0x14	// reserved
@@ -293,11 +369,15 @@ public:
 #define STOC_REPLAY			0x17	// ExtendedReplayHeader + byte array
 #define STOC_TIME_LIMIT		0x18	// STOC_TimeLimit
 #define STOC_CHAT			0x19	// uint16_t + uint16_t array
+#define STOC_REPLAY_START	0x1a	// ExtendedReplayHeader + uint32_t compressed size, a replay too large for STOC_REPLAY
+#define STOC_REPLAY_DATA	0x1b	// byte array
+#define STOC_REPLAY_END		0x1c	// no data
 #define STOC_HS_PLAYER_ENTER	0x20	// STOC_HS_PlayerEnter
 #define STOC_HS_PLAYER_CHANGE	0x21	// STOC_HS_PlayerChange
 #define STOC_HS_WATCH_CHANGE	0x22	// STOC_HS_WatchChange
 #define STOC_TEAMMATE_SURRENDER	0x23	// no data
 #define STOC_FIELD_FINISH		0x30
+#define STOC_COMPRESSED		0x31	// uint32_t + LZMA props + LZMA data, packets of one batch
 
 // STOC_GAME_MSG header
 #define MSG_WAITING				3
@@ -305,6 +385,7 @@ public:
 #define MSG_UPDATE_DATA			6	// flag=0: clear
 #define MSG_UPDATE_CARD			7	// flag=QUERY_CODE, code=0: clear
 #define MSG_REQUEST_DECK		8
+#define MSG_UPDATE_DELTA		9	// count, [seq, query record] * count
 #define MSG_REFRESH_DECK		34
 #define MSG_CARD_SELECTED		80
 #define MSG_UNEQUIP				95
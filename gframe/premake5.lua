@@ -10,7 +10,10 @@ project "YGOPro"
     includedirs { "../ocgcore" }
     links { "ocgcore", "clzma", "cspmemvfs", LUA_LIB_NAME, "sqlite3", "irrlicht", "freetype", "event" }
 
-    if not BUILD_LUA then
+    if BUILD_LUA then
+        includedirs { "../lua/src" }
+    else
+        includedirs { LUA_INCLUDE_DIR }
         libdirs { LUA_LIB_DIR }
     end
 
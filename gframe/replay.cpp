@@ -2,40 +2,145 @@
 #include "replay.h"
 #include "myfilesystem.h"
 #include "lzma/LzmaLib.h"
+#include "lzma/LzmaEnc.h"
+#include "lzma/LzmaDec.h"
 
 namespace ygo {
 
-Replay::Replay() {
-	replay_data = new unsigned char[MAX_REPLAY_SIZE];
-	comp_data = new unsigned char[MAX_COMP_SIZE];
+static void* LzmaAlloc(void* p, size_t size) {
+	return std::malloc(size);
 }
-Replay::~Replay() {
-	delete[] replay_data;
-	delete[] comp_data;
+static void LzmaFree(void* p, void* address) {
+	std::free(address);
 }
-void Replay::BeginRecord() {
-	if(!FileSystem::IsDirExists(L"./replay") && !FileSystem::MakeDir(L"./replay"))
-		return;
-	if(is_recording)
+static ISzAlloc lzma_alloc = { LzmaAlloc, LzmaFree };
+
+// the state of a compressed replay being read
+struct ReplayDecoder {
+	CLzmaDec state;
+	size_t chunk{};
+	size_t in_pos{};
+	bool is_allocated{};
+
+	ReplayDecoder() {
+		LzmaDec_Construct(&state);
+	}
+	~ReplayDecoder() {
+		if (is_allocated)
+			LzmaDec_Free(&state, &lzma_alloc);
+	}
+};
+
+// feeds the recorded chunks from begin to end to the encoder, every chunk but the last is full
+struct ChunkInStream {
+	ISeqInStream stream;
+	const std::vector<std::vector<unsigned char>>* chunks;
+	size_t chunk_index;
+	size_t offset;
+	size_t left;
+
+	ChunkInStream(const std::vector<std::vector<unsigned char>>& chunks, size_t begin, size_t end)
+		: stream{ Read }, chunks(&chunks), chunk_index(begin / REPLAY_CHUNK_SIZE), offset(begin % REPLAY_CHUNK_SIZE), left(end - begin) {}
+
+	static SRes Read(void* p, void* buf, size_t* size) {
+		ChunkInStream* in = static_cast<ChunkInStream*>(p);
+		auto dst = static_cast<unsigned char*>(buf);
+		size_t len = 0;
+		while (len < *size && in->left && in->chunk_index < in->chunks->size()) {
+			const auto& chunk = (*in->chunks)[in->chunk_index];
+			size_t n = std::min({ *size - len, chunk.size() - in->offset, in->left });
+			std::memcpy(dst + len, chunk.data() + in->offset, n);
+			len += n;
+			in->offset += n;
+			in->left -= n;
+			if (in->offset == chunk.size()) {
+				++in->chunk_index;
+				in->offset = 0;
+			}
+		}
+		*size = len;
+		return SZ_OK;
+	}
+};
+struct VectorOutStream {
+	ISeqOutStream stream;
+	std::vector<unsigned char>* data;
+
+	static size_t Write(void* p, const void* buf, size_t size) {
+		VectorOutStream* out = static_cast<VectorOutStream*>(p);
+		auto src = static_cast<const unsigned char*>(buf);
+		out->data->insert(out->data->end(), src, src + size);
+		return size;
+	}
+};
+
+static uint32_t ReadUInt32(const unsigned char*& p) {
+	uint32_t value;
+	std::memcpy(&value, p, sizeof value);
+	p += sizeof value;
+	return value;
+}
+template<typename T>
+static void AppendValue(std::vector<unsigned char>& buffer, const T& value) {
+	auto p = reinterpret_cast<const unsigned char*>(&value);
+	buffer.insert(buffer.end(), p, p + sizeof(T));
+}
+/*
+* The data offsets where the YRP3 chunks start, followed by the end of the data.
+* The info block is a chunk of its own, the duel is cut at the turns.
+*/
+static std::vector<size_t> GetChunkBounds(size_t info_size, const std::vector<uint32_t>& turn_offsets, size_t data_size) {
+	std::vector<size_t> bounds{ 0, info_size };
+	for (auto offset : turn_offsets) {
+		if (offset >= bounds.back() + REPLAY_MIN_TURN_CHUNK && offset < data_size)
+			bounds.push_back(offset);
+	}
+	if (data_size > bounds.back())
+		bounds.push_back(data_size);
+	return bounds;
+}
+
+void Replay::BeginRecord(bool write_to_file) {
+	if(is_recording && fp) {
 		std::fclose(fp);
-	fp = myfopen("./replay/_LastReplay.yrp", "wb");
-	if(!fp)
-		return;
+		fp = nullptr;
+	}
+	if(write_to_file) {
+		if(!FileSystem::IsDirExists(L"./replay") && !FileSystem::MakeDir(L"./replay"))
+			return;
+		fp = myfopen("./replay/_LastReplay.yrp", "wb");
+		if(!fp)
+			return;
+	}
 	Reset();
 	is_recording = true;
 }
 void Replay::WriteHeader(ExtendedReplayHeader& header) {
 	pheader = header;
+	if(!fp)
+		return;
 	std::fwrite(&header, sizeof header, 1, fp);
 	std::fflush(fp);
 }
 void Replay::WriteData(const void* data, size_t length, bool flush) {
 	if(!is_recording)
 		return;
-	if (replay_size + length > MAX_REPLAY_SIZE)
-		return;
-	std::memcpy(replay_data + replay_size, data, length);
+	auto src = static_cast<const unsigned char*>(data);
+	size_t left = length;
+	while (left) {
+		if (record_chunks.empty() || record_chunks.back().size() == REPLAY_CHUNK_SIZE) {
+			record_chunks.emplace_back();
+			record_chunks.back().reserve(REPLAY_CHUNK_SIZE);
+		}
+		auto& chunk = record_chunks.back();
+		size_t n = std::min(left, REPLAY_CHUNK_SIZE - chunk.size());
+		chunk.insert(chunk.end(), src, src + n);
+		src += n;
+		left -= n;
+	}
 	replay_size += length;
+	if(!fp)
+		return;
 	std::fwrite(data, length, 1, fp);
 	if(flush)
 		std::fflush(fp);
@@ -44,24 +149,129 @@ void Replay::WriteInt32(int32_t data, bool flush) {
 	Write<int32_t>(data, flush);
 }
 void Replay::Flush() {
-	if(!is_recording)
+	if(!is_recording || !fp)
 		return;
 	std::fflush(fp);
 }
+void Replay::EndInfo() {
+	if(!is_recording)
+		return;
+	info_size = replay_size;
+}
+void Replay::MarkTurn() {
+	if(!is_recording)
+		return;
+	turn_offsets.push_back((uint32_t)replay_size);
+}
 void Replay::EndRecord() {
 	if(!is_recording)
 		return;
-	std::fclose(fp);
+	FinishRecord();
+	CompressRecord();
+}
+void Replay::EndRecord(Replay& target) {
+	if(!is_recording)
+		return;
+	FinishRecord();
+	target.Reset();
+	target.pheader = pheader;
+	target.record_chunks.swap(record_chunks);
+	target.replay_size = replay_size;
+	target.info_size = info_size;
+	target.turn_offsets.swap(turn_offsets);
+	record_chunks.clear();
+	turn_offsets.clear();
+	replay_size = 0;
+}
+void Replay::FinishRecord() {
+	if(fp) {
+		std::fclose(fp);
+		fp = nullptr;
+	}
 	pheader.base.datasize = replay_size;
 	pheader.base.flag |= REPLAY_COMPRESSED;
-	size_t propsize = 5;
-	comp_size = MAX_COMP_SIZE;
-	int ret = LzmaCompress(comp_data, &comp_size, replay_data, replay_size, pheader.base.props, &propsize, 5, 0x1U << 24, 3, 0, 2, 32, 1);
+	is_recording = false;
+}
+/*
+* Compress the recorded chunks as they are, without joining them first.
+* The dictionary only needs to cover the replay.
+*/
+bool Replay::CompressRecord(int codec, bool chunked) {
+	comp_data.clear();
+	if (codec == CODEC_STORE) {
+		pheader.base.flag &= ~REPLAY_COMPRESSED;
+		comp_data.reserve(replay_size);
+		for (const auto& chunk : record_chunks)
+			comp_data.insert(comp_data.end(), chunk.begin(), chunk.end());
+		record_chunks.clear();
+		record_chunks.shrink_to_fit();
+		return true;
+	}
+	// without the end of the info block the replay is one stream as in YRP2
+	const bool is_chunked = chunked && info_size && info_size <= replay_size;
+	std::vector<size_t> bounds{ 0, replay_size };
+	if (is_chunked)
+		bounds = GetChunkBounds(info_size, turn_offsets, replay_size);
+	size_t max_chunk_size = 0;
+	for (size_t i = 1; i < bounds.size(); ++i)
+		max_chunk_size = std::max(max_chunk_size, bounds[i] - bounds[i - 1]);
+	const uint32_t max_dict_size = (codec == CODEC_FAST) ? (0x1U << 16) : (0x1U << 24);
+	CLzmaEncProps props;
+	LzmaEncProps_Init(&props);
+	props.level = (codec == CODEC_FAST) ? 1 : 5;
+	props.dictSize = 0x1U << 12;
+	while (props.dictSize < max_chunk_size && props.dictSize < max_dict_size)
+		props.dictSize <<= 1;
+	props.lc = 3;
+	props.lp = 0;
+	props.pb = 2;
+	props.fb = 32;
+	props.numThreads = 1;
+	if (codec == CODEC_FAST)
+		props.algo = 0;
+	// every chunk is a stream of its own with the same properties
+	std::vector<uint32_t> comp_sizes;
+	SRes ret = SZ_OK;
+	for (size_t i = 1; i < bounds.size() && ret == SZ_OK; ++i) {
+		size_t comp_start = comp_data.size();
+		ChunkInStream in(record_chunks, bounds[i - 1], bounds[i]);
+		VectorOutStream out{ { VectorOutStream::Write }, &comp_data };
+		CLzmaEncHandle enc = LzmaEnc_Create(&lzma_alloc);
+		if (!enc) {
+			ret = SZ_ERROR_MEM;
+			break;
+		}
+		SizeT propsize = LZMA_PROPS_SIZE;
+		ret = LzmaEnc_SetProps(enc, &props);
+		if (ret == SZ_OK)
+			ret = LzmaEnc_WriteProperties(enc, pheader.base.props, &propsize);
+		if (ret == SZ_OK)
+			ret = LzmaEnc_Encode(enc, &out.stream, &in.stream, nullptr, &lzma_alloc, &lzma_alloc);
+		LzmaEnc_Destroy(enc, &lzma_alloc, &lzma_alloc);
+		comp_sizes.push_back((uint32_t)(comp_data.size() - comp_start));
+	}
+	record_chunks.clear();
+	record_chunks.shrink_to_fit();
 	if (ret != SZ_OK) {
-		std::memcpy(comp_data, &ret, sizeof ret);
-		comp_size = sizeof ret;
+		comp_data.resize(sizeof ret);
+		std::memcpy(comp_data.data(), &ret, sizeof ret);
+		return false;
 	}
-	is_recording = false;
+	if (is_chunked) {
+		size_t index_start = comp_data.size();
+		AppendValue<uint32_t>(comp_data, (uint32_t)comp_sizes.size());
+		for (size_t i = 0; i < comp_sizes.size(); ++i) {
+			AppendValue<uint32_t>(comp_data, (uint32_t)(bounds[i + 1] - bounds[i]));
+			AppendValue<uint32_t>(comp_data, comp_sizes[i]);
+		}
+		AppendValue<uint32_t>(comp_data, (uint32_t)turn_offsets.size());
+		for (auto offset : turn_offsets)
+			AppendValue<uint32_t>(comp_data, offset);
+		AppendValue<uint32_t>(comp_data, (uint32_t)(comp_data.size() - index_start));
+		AppendValue<uint32_t>(comp_data, REPLAY_INDEX_ID);
+		pheader.base.id = REPLAY_ID_YRP3;
+	}
+	return true;
 }
 bool Replay::SaveReplay(const wchar_t* base_name) {
 	if(!FileSystem::IsDirExists(L"./replay") && !FileSystem::MakeDir(L"./replay"))
@@ -76,55 +286,47 @@ bool Replay::SaveReplay(const wchar_t* base_name) {
 	if(!rfp)
 		return false;
 	std::fwrite(&pheader, sizeof pheader, 1, rfp);
-	std::fwrite(comp_data, comp_size, 1, rfp);
+	std::fwrite(comp_data.data(), comp_data.size(), 1, rfp);
 	std::fclose(rfp);
 	return true;
 }
+/*
+* The file is mapped and read in place.
+* A compressed replay is decoded as it is read, only the info block is decoded here.
+*/
 bool Replay::OpenReplay(const wchar_t* name) {
-	FILE* rfp = mywfopen(name, "rb");
-	if(!rfp) {
+	auto file = std::make_shared<MappedFile>();
+	if (!file->Open(name)) {
 		wchar_t fname[256];
 		if (myswprintf(fname, L"./replay/%ls", name) <= 0)
 			return false;
-		rfp = mywfopen(fname, "rb");
+		if (!file->Open(fname))
+			return false;
 	}
-	if(!rfp)
-		return false;
-
 	Reset();
-	bool correct_header = true;
-	if (std::fread(&pheader, sizeof pheader.base, 1, rfp) < 1)
-		correct_header = false;
-	else if (pheader.base.id != REPLAY_ID_YRP1 && pheader.base.id != REPLAY_ID_YRP2)
-		correct_header = false;
-	else if (pheader.base.version < 0x12d0u)
-		correct_header = false;
-	else if (pheader.base.version >= 0x1353u && !(pheader.base.flag & REPLAY_UNIFORM))
-		correct_header = false;
-	if (!correct_header) {
-		std::fclose(rfp);
+	const unsigned char* pdata = file->data();
+	size_t left = file->size();
+	if (!ReadFileHeader(pdata, left))
 		return false;
-	}
-	if (pheader.base.id == REPLAY_ID_YRP2 && std::fread(reinterpret_cast<unsigned char*>(&pheader) + sizeof pheader.base, sizeof pheader - sizeof pheader.base, 1, rfp) < 1) {
-		std::fclose(rfp);
-		return false;
-	}
-	if(pheader.base.flag & REPLAY_COMPRESSED) {
-		comp_size = std::fread(comp_data, 1, MAX_COMP_SIZE, rfp);
-		std::fclose(rfp);
-		if (pheader.base.datasize > MAX_REPLAY_SIZE)
+	mapped_file = file;
+	stream = pdata;
+	stream_size = left;
+	if (pheader.base.flag & REPLAY_COMPRESSED) {
+		// the decoder window is sized by datasize
+		if (pheader.base.datasize > MAX_REPLAY_SIZE) {
+			Reset();
 			return false;
+		}
 		replay_size = pheader.base.datasize;
-		if (LzmaUncompress(replay_data, &replay_size, comp_data, &comp_size, pheader.base.props, 5) != SZ_OK)
-			return false;
-		if (replay_size != pheader.base.datasize) {
-			replay_size = 0;
+		if (!ReadChunkIndex() || !CreateDecoder()) {
+			Reset();
 			return false;
 		}
+	} else if (pheader.base.id == REPLAY_ID_YRP3) {
+		Reset();
+		return false;
 	} else {
-		replay_size = std::fread(replay_data, 1, MAX_REPLAY_SIZE, rfp);
-		std::fclose(rfp);
-		comp_size = 0;
+		replay_size = stream_size;
 	}
 	is_replaying = true;
 	can_read = true;
@@ -136,6 +338,13 @@ bool Replay::OpenReplay(const wchar_t* name) {
 	data_position = 0;
 	return true;
 }
+// Reads the header and the info block, then closes the file. The replay cannot be played.
+bool Replay::OpenReplayInfo(const wchar_t* name) {
+	if (!OpenReplay(name))
+		return false;
+	ClosePlayback();
+	return true;
+}
 bool Replay::DeleteReplay(const wchar_t* name) {
 	if (std::wcschr(name, L'/') || std::wcschr(name, L'\\'))
 		return false;
@@ -188,8 +397,17 @@ bool Replay::ReadData(void* data, size_t length) {
 		can_read = false;
 		return false;
 	}
-	if (length)
-		std::memcpy(data, &replay_data[data_position], length);
+	if (length) {
+		if (decoder) {
+			if (!DecodeTo(data_position + length)) {
+				can_read = false;
+				return false;
+			}
+			std::memcpy(data, window.data() + (data_position - window_start), length);
+		} else {
+			std::memcpy(data, stream + data_position, length);
+		}
+	}
 	data_position += length;
 	return true;
 }
@@ -201,12 +419,12 @@ void Replay::Rewind() {
 	can_read = true;
 }
 void Replay::Reset() {
+	ClosePlayback();
 	is_recording = false;
-	is_replaying = false;
-	can_read = false;
-	replay_size = 0;
-	comp_size = 0;
-	data_position = 0;
+	record_chunks.clear();
+	comp_data.clear();
+	info_size = 0;
+	turn_offsets.clear();
 	info_offset = 0;
 	players.clear();
 	params = { 0 };
@@ -220,6 +438,185 @@ void Replay::SkipInfo(){
 bool Replay::IsReplaying() const {
 	return is_replaying;
 }
+size_t Replay::GetPosition() const {
+	return data_position;
+}
+size_t Replay::GetTurnCount() const {
+	return turn_offsets.size();
+}
+// turn counts from 1
+bool Replay::GetTurnPosition(size_t turn, size_t& position) const {
+	if (turn == 0 || turn > turn_offsets.size())
+		return false;
+	position = turn_offsets[turn - 1];
+	return true;
+}
+bool Replay::ReadFileHeader(const unsigned char*& pdata, size_t& left) {
+	if (left < sizeof pheader.base)
+		return false;
+	std::memcpy(&pheader.base, pdata, sizeof pheader.base);
+	pdata += sizeof pheader.base;
+	left -= sizeof pheader.base;
+	if (pheader.base.id != REPLAY_ID_YRP1 && pheader.base.id != REPLAY_ID_YRP2 && pheader.base.id != REPLAY_ID_YRP3)
+		return false;
+	if (pheader.base.version < 0x12d0u)
+		return false;
+	if (pheader.base.version >= 0x1353u && !(pheader.base.flag & REPLAY_UNIFORM))
+		return false;
+	if (pheader.base.id != REPLAY_ID_YRP1) {
+		const size_t extended_size = sizeof pheader - sizeof pheader.base;
+		if (left < extended_size)
+			return false;
+		std::memcpy(reinterpret_cast<unsigned char*>(&pheader) + sizeof pheader.base, pdata, extended_size);
+		pdata += extended_size;
+		left -= extended_size;
+	}
+	return true;
+}
+/*
+* The chunks of a YRP3 replay, from the index at the end of the file.
+* The older formats are one chunk.
+*/
+bool Replay::ReadChunkIndex() {
+	chunks.clear();
+	if (pheader.base.id != REPLAY_ID_YRP3) {
+		chunks.push_back({ 0, replay_size, 0, stream_size });
+		return true;
+	}
+	if (stream_size < sizeof(uint32_t) * 2)
+		return false;
+	const unsigned char* footer = stream + stream_size - sizeof(uint32_t) * 2;
+	uint32_t index_size = ReadUInt32(footer);
+	if (ReadUInt32(footer) != REPLAY_INDEX_ID)
+		return false;
+	if (index_size < sizeof(uint32_t) * 2 || index_size > stream_size - sizeof(uint32_t) * 2)
+		return false;
+	const size_t index_start = stream_size - sizeof(uint32_t) * 2 - index_size;
+	const unsigned char* pindex = stream + index_start;
+	const unsigned char* index_end = pindex + index_size;
+	uint32_t chunk_count = ReadUInt32(pindex);
+	if (chunk_count == 0 || chunk_count > (size_t)(index_end - pindex) / (sizeof(uint32_t) * 2))
+		return false;
+	size_t data_offset = 0;
+	size_t file_offset = 0;
+	for (uint32_t i = 0; i < chunk_count; ++i) {
+		ReplayChunk chunk;
+		chunk.data_offset = data_offset;
+		chunk.file_offset = file_offset;
+		chunk.data_size = ReadUInt32(pindex);
+		chunk.comp_size = ReadUInt32(pindex);
+		data_offset += chunk.data_size;
+		file_offset += chunk.comp_size;
+		if (!chunk.data_size || data_offset > replay_size || file_offset > index_start)
+			return false;
+		chunks.push_back(chunk);
+	}
+	if (data_offset != replay_size || index_end - pindex < (ptrdiff_t)sizeof(uint32_t))
+		return false;
+	uint32_t turn_count = ReadUInt32(pindex);
+	if (turn_count != (size_t)(index_end - pindex) / sizeof(uint32_t))
+		return false;
+	turn_offsets.clear();
+	for (uint32_t i = 0; i < turn_count; ++i) {
+		uint32_t offset = ReadUInt32(pindex);
+		if (offset > replay_size || (!turn_offsets.empty() && offset < turn_offsets.back()))
+			return false;
+		turn_offsets.push_back(offset);
+	}
+	return true;
+}
+bool Replay::CreateDecoder() {
+	// nothing can be referenced beyond the end of a chunk, a smaller dictionary is enough
+	unsigned char props[LZMA_PROPS_SIZE];
+	std::memcpy(props, pheader.base.props, LZMA_PROPS_SIZE);
+	uint32_t dict_size = props[1] | (props[2] << 8) | (props[3] << 16) | ((uint32_t)props[4] << 24);
+	size_t max_chunk_size = 0;
+	for (const auto& chunk : chunks)
+		max_chunk_size = std::max(max_chunk_size, chunk.data_size);
+	uint32_t needed = (uint32_t)std::max<size_t>(max_chunk_size, 0x1000);
+	if (dict_size > needed) {
+		props[1] = needed & 0xff;
+		props[2] = (needed >> 8) & 0xff;
+		props[3] = (needed >> 16) & 0xff;
+		props[4] = (needed >> 24) & 0xff;
+	}
+	auto dec = std::make_shared<ReplayDecoder>();
+	if (LzmaDec_Allocate(&dec->state, props, LZMA_PROPS_SIZE, &lzma_alloc) != SZ_OK)
+		return false;
+	dec->is_allocated = true;
+	decoder = dec;
+	StartChunk(0);
+	window.clear();
+	window_start = 0;
+	return true;
+}
+// the chunk holding the data at position
+size_t Replay::FindChunk(size_t position) const {
+	auto it = std::upper_bound(chunks.begin(), chunks.end(), position, [](size_t pos, const ReplayChunk& chunk) {
+		return pos < chunk.data_offset;
+	});
+	return (it == chunks.begin()) ? 0 : (it - chunks.begin() - 1);
+}
+void Replay::StartChunk(size_t index) {
+	LzmaDec_Init(&decoder->state);
+	decoder->chunk = index;
+	decoder->in_pos = chunks[index].file_offset;
+}
+/*
+* Decodes until the window holds the data up to end.
+* The data before the read position is dropped.
+* A read behind the window or in a later chunk starts decoding again at the chunk holding it.
+*/
+bool Replay::DecodeTo(size_t end) {
+	if (data_position >= window_start && end <= window_start + window.size())
+		return true;
+	size_t chunk_index = FindChunk(data_position);
+	if (data_position < window_start || chunk_index > decoder->chunk) {
+		StartChunk(chunk_index);
+		window.clear();
+		window_start = chunks[chunk_index].data_offset;
+	}
+	size_t drop = std::min(data_position - window_start, window.size());
+	window.erase(window.begin(), window.begin() + drop);
+	window_start += drop;
+	size_t decoded = window.size();
+	size_t target = std::min(std::max(end - window_start, decoded + REPLAY_CHUNK_SIZE), replay_size - window_start);
+	window.resize(target);
+	while (decoded < target) {
+		const auto& chunk = chunks[decoder->chunk];
+		const size_t chunk_end = chunk.data_offset + chunk.data_size;
+		if (window_start + decoded >= chunk_end) {
+			// the next chunk is decoded only if the read needs it
+			if (window_start + decoded >= end || decoder->chunk + 1 >= chunks.size())
+				break;
+			StartChunk(decoder->chunk + 1);
+			continue;
+		}
+		SizeT out_len = std::min(target - decoded, chunk_end - (window_start + decoded));
+		SizeT in_len = chunk.file_offset + chunk.comp_size - decoder->in_pos;
+		ELzmaStatus status;
+		SRes ret = LzmaDec_DecodeToBuf(&decoder->state, window.data() + decoded, &out_len, stream + decoder->in_pos, &in_len, LZMA_FINISH_ANY, &status);
+		decoder->in_pos += in_len;
+		decoded += out_len;
+		if (ret != SZ_OK || (!out_len && !in_len))
+			break;
+	}
+	window.resize(decoded);
+	return end <= window_start + window.size();
+}
+void Replay::ClosePlayback() {
+	is_replaying = false;
+	can_read = false;
+	mapped_file.reset();
+	chunks.clear();
+	decoder.reset();
+	stream = nullptr;
+	stream_size = 0;
+	window.clear();
+	window_start = 0;
+	replay_size = 0;
+	data_position = 0;
+}
 bool Replay::ReadInfo() {
 	int player_count = (pheader.base.flag & REPLAY_TAG) ? 4 : 2;
 	for (int i = 0; i < player_count; ++i) {
@@ -2,13 +2,18 @@
 #define REPLAY_H
 
 #include <cstdio>
+#include <memory>
 #include <vector>
 #include <string>
 #include "../ocgcore/ocgapi.h"
 #include "deck_manager.h"
 
+class MappedFile;
+
 namespace ygo {
 
+struct ReplayDecoder;
+
 // replay flag
 #define REPLAY_COMPRESSED	0x1
 #define REPLAY_TAG			0x2
@@ -18,10 +23,16 @@ namespace ygo {
 
 #define REPLAY_ID_YRP1	0x31707279
 #define REPLAY_ID_YRP2	0x32707279
+// YRP2 header, the data is split into chunks compressed apart, listed by an index at the end of the file
+#define REPLAY_ID_YRP3	0x33707279
+#define REPLAY_INDEX_ID	0x78707279
 
-// max size
-constexpr int MAX_REPLAY_SIZE = 0x80000;
-constexpr int MAX_COMP_SIZE = UINT16_MAX + 1;
+// the recording grows by chunks of this size
+constexpr size_t REPLAY_CHUNK_SIZE = 0x4000;
+// a YRP3 chunk ends at the first turn starting after this size
+constexpr size_t REPLAY_MIN_TURN_CHUNK = 0x1000;
+// sanity limit for the decoded size of a replay file, and for a replay received from the server
+constexpr size_t MAX_REPLAY_SIZE = 0x4000000;
 
 struct ReplayHeader {
 	uint32_t id{};
@@ -42,6 +53,20 @@ struct ExtendedReplayHeader {
 	uint32_t value3{};
 };
 
+/*
+* YRP3 layout after ExtendedReplayHeader:
+* compressed chunks, the first one is the info block
+* index: uint32_t chunk count, (uint32_t data size, uint32_t compressed size) of each chunk,
+*        uint32_t turn count, uint32_t data offset of the start of each turn
+* footer: uint32_t index size, uint32_t REPLAY_INDEX_ID
+*/
+struct ReplayChunk {
+	size_t data_offset{};
+	size_t data_size{};
+	size_t file_offset{};
+	size_t comp_size{};
+};
+
 struct DuelParameters {
 	int32_t start_lp{};
 	int32_t start_hand{};
@@ -51,11 +76,16 @@ struct DuelParameters {
 
 class Replay {
 public:
-	Replay();
-	~Replay();
+	// how a finished recording is compressed, every client can read all of them
+	static constexpr int CODEC_LZMA = 0;
+	// LZMA in fast mode with a small dictionary
+	static constexpr int CODEC_FAST = 1;
+	// no compression, REPLAY_COMPRESSED is cleared
+	static constexpr int CODEC_STORE = 2;
 
 	// record
-	void BeginRecord();
+	// write_to_file: keep ./replay/_LastReplay.yrp updated while recording
+	void BeginRecord(bool write_to_file = true);
 	void WriteHeader(ExtendedReplayHeader& header);
 	void WriteData(const void* data, size_t length, bool flush = true);
 	template<typename T>
@@ -64,7 +94,15 @@ public:
 	}
 	void WriteInt32(int32_t data, bool flush = true);
 	void Flush();
+	// the info block ends here, YRP3 compresses it apart from the duel
+	void EndInfo();
+	// a turn starts at the next response
+	void MarkTurn();
 	void EndRecord();
+	// ends the recording and moves it to target, which compresses it later with CompressRecord
+	void EndRecord(Replay& target);
+	// a YRP2 replay is written if chunked is false
+	bool CompressRecord(int codec = CODEC_LZMA, bool chunked = true);
 	bool SaveReplay(const wchar_t* base_name);
 
 	// play
@@ -81,6 +119,7 @@ public:
 		}
 	}
 	bool OpenReplay(const wchar_t* name);
+	bool OpenReplayInfo(const wchar_t* name);
 	bool ReadNextResponse(unsigned char resp[]);
 	bool ReadName(wchar_t* data);
 	void ReadHeader(ExtendedReplayHeader& header);
@@ -96,11 +135,14 @@ public:
 	void Reset();
 	void SkipInfo();
 	bool IsReplaying() const;
+	size_t GetPosition() const;
+	// turns recorded in a YRP3 replay, 0 for the older formats
+	size_t GetTurnCount() const;
+	bool GetTurnPosition(size_t turn, size_t& position) const;
 
 	FILE* fp{ nullptr };
 	ExtendedReplayHeader pheader;
-	unsigned char* comp_data;
-	size_t comp_size{};
+	std::vector<unsigned char> comp_data;
 
 	std::vector<std::wstring> players;	// 80 or 160 bytes
 	DuelParameters params;				// 16 bytes
@@ -109,9 +151,30 @@ public:
 	std::string script_name;			// 2 bytes, script name (max: 256 bytes)
 
 private:
+	bool ReadFileHeader(const unsigned char*& pdata, size_t& left);
 	bool ReadInfo();
-
-	unsigned char* replay_data;
+	void FinishRecord();
+	bool ReadChunkIndex();
+	bool CreateDecoder();
+	size_t FindChunk(size_t position) const;
+	void StartChunk(size_t index);
+	bool DecodeTo(size_t end);
+	void ClosePlayback();
+
+	// recording
+	std::vector<std::vector<unsigned char>> record_chunks;
+	size_t info_size{};
+	// the data offset of the start of each turn, also read from a YRP3 index
+	std::vector<uint32_t> turn_offsets;
+	// playback, the data follows the header in the mapped file
+	std::shared_ptr<MappedFile> mapped_file;
+	const unsigned char* stream{};
+	size_t stream_size{};
+	// compressed data is decoded into a window starting at window_start
+	std::vector<ReplayChunk> chunks;
+	std::shared_ptr<ReplayDecoder> decoder;
+	std::vector<unsigned char> window;
+	size_t window_start{};
 	size_t replay_size{};
 	size_t data_position{};
 	size_t info_offset{};
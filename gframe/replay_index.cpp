@@ -0,0 +1,252 @@
+#include "config.h"
+#include "replay_index.h"
+#include "myfilesystem.h"
+#include <cwctype>
+#include <set>
+
+namespace ygo {
+
+ReplayIndex replayIndex;
+
+static const wchar_t* INDEX_FILE = L"./replay/replay_index.dat";
+
+static std::wstring ToLower(const wchar_t* str) {
+	std::wstring lower(str);
+	for (auto& ch : lower)
+		ch = std::towlower(ch);
+	return lower;
+}
+static bool ContainsNoCase(const std::wstring& str, const std::wstring& lower_filter) {
+	return ToLower(str.c_str()).find(lower_filter) != std::wstring::npos;
+}
+
+template<typename T>
+static void AppendValue(std::vector<unsigned char>& buffer, const T& value) {
+	auto p = reinterpret_cast<const unsigned char*>(&value);
+	buffer.insert(buffer.end(), p, p + sizeof(T));
+}
+static void AppendString(std::vector<unsigned char>& buffer, const std::string& str) {
+	AppendValue<uint16_t>(buffer, (uint16_t)str.size());
+	buffer.insert(buffer.end(), str.begin(), str.end());
+}
+static void AppendString(std::vector<unsigned char>& buffer, const std::wstring& str) {
+	char utf8[1024];
+	BufferIO::EncodeUTF8(str.c_str(), utf8);
+	AppendString(buffer, std::string(utf8));
+}
+
+// reads the index file, any overrun marks it as broken
+struct IndexReader {
+	const unsigned char* p;
+	const unsigned char* end;
+	bool ok{ true };
+
+	template<typename T>
+	T Read() {
+		T value{};
+		ReadData(&value, sizeof(T));
+		return value;
+	}
+	void ReadData(void* data, size_t len) {
+		if (!ok || (size_t)(end - p) < len) {
+			ok = false;
+			return;
+		}
+		std::memcpy(data, p, len);
+		p += len;
+	}
+	std::string ReadString() {
+		uint16_t len = Read<uint16_t>();
+		if (!ok || (size_t)(end - p) < len) {
+			ok = false;
+			return std::string();
+		}
+		std::string str(reinterpret_cast<const char*>(p), len);
+		p += len;
+		return str;
+	}
+	std::wstring ReadWideString() {
+		wchar_t wstr[1024];
+		BufferIO::DecodeUTF8(ReadString().c_str(), wstr);
+		return wstr;
+	}
+};
+
+void ReplayInfo::Load(const Replay& replay) {
+	header = replay.pheader;
+	players = replay.players;
+	params = replay.params;
+	script_name = replay.script_name;
+	decks.clear();
+	for (const auto& deck : replay.decks)
+		decks.emplace_back((uint16_t)deck.main.size(), (uint16_t)deck.area.size());
+	turns = (uint32_t)replay.GetTurnCount();
+}
+bool ReplayInfo::Match(const wchar_t* filter) const {
+	std::wstring lower_filter = ToLower(filter);
+	for (const auto& player : players) {
+		if (ContainsNoCase(player, lower_filter))
+			return true;
+	}
+	wchar_t script[256];
+	BufferIO::DecodeUTF8(script_name.c_str(), script);
+	return ContainsNoCase(script, lower_filter);
+}
+
+ReplayIndex::~ReplayIndex() {
+	Stop();
+}
+// Starts checking the entries of the listed files, the entries of the other files are dropped.
+void ReplayIndex::Update(const std::vector<std::wstring>& files) {
+	Stop();
+	worker = std::thread(&ReplayIndex::Build, this, files);
+}
+// The entry of a file, if the file has not changed since it was read.
+bool ReplayIndex::GetInfo(const wchar_t* name, ReplayInfo& info) {
+	wchar_t path[1024];
+	if (myswprintf(path, L"./replay/%ls", name) <= 0)
+		return false;
+	uint64_t size = 0;
+	int64_t mtime = 0;
+	if (!FileSystem::GetFileInfo(path, size, mtime))
+		return false;
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = entries.find(name);
+	if (it == entries.end() || it->second.size != size || it->second.mtime != mtime)
+		return false;
+	info = it->second;
+	return true;
+}
+// The file name, player names or puzzle script contain the filter.
+bool ReplayIndex::Match(const std::wstring& name, const wchar_t* filter) {
+	if (ContainsNoCase(name, ToLower(filter)))
+		return true;
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = entries.find(name);
+	return it != entries.end() && it->second.Match(filter);
+}
+void ReplayIndex::Build(std::vector<std::wstring> files) {
+	if (!is_loaded) {
+		Load();
+		is_loaded = true;
+	}
+	bool is_changed = false;
+	for (const auto& name : files) {
+		if (is_canceled)
+			break;
+		wchar_t path[1024];
+		if (myswprintf(path, L"./replay/%ls", name.c_str()) <= 0)
+			continue;
+		ReplayInfo info;
+		if (!FileSystem::GetFileInfo(path, info.size, info.mtime))
+			continue;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = entries.find(name);
+			if (it != entries.end() && it->second.size == info.size && it->second.mtime == info.mtime)
+				continue;
+		}
+		Replay replay;
+		if (!replay.OpenReplayInfo(path))
+			continue;
+		info.Load(replay);
+		std::lock_guard<std::mutex> lock(mutex);
+		entries[name] = std::move(info);
+		is_changed = true;
+	}
+	if (!is_canceled) {
+		std::set<std::wstring> listed(files.begin(), files.end());
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto it = entries.begin(); it != entries.end();) {
+			if (listed.count(it->first)) {
+				++it;
+				continue;
+			}
+			it = entries.erase(it);
+			is_changed = true;
+		}
+	}
+	if (is_changed)
+		Save();
+}
+void ReplayIndex::Load() {
+	FILE* fp = mywfopen(INDEX_FILE, "rb");
+	if (!fp)
+		return;
+	std::vector<unsigned char> data;
+	unsigned char buffer[0x4000];
+	size_t read_size;
+	while ((read_size = std::fread(buffer, 1, sizeof buffer, fp)) > 0)
+		data.insert(data.end(), buffer, buffer + read_size);
+	std::fclose(fp);
+	IndexReader reader{ data.data(), data.data() + data.size() };
+	if (reader.Read<uint32_t>() != INDEX_ID || reader.Read<uint32_t>() != INDEX_VERSION)
+		return;
+	uint32_t count = reader.Read<uint32_t>();
+	std::map<std::wstring, ReplayInfo> loaded;
+	for (uint32_t i = 0; i < count && reader.ok; ++i) {
+		std::wstring name = reader.ReadWideString();
+		ReplayInfo info;
+		info.size = reader.Read<uint64_t>();
+		info.mtime = reader.Read<int64_t>();
+		reader.ReadData(&info.header, sizeof info.header);
+		int player_count = reader.Read<uint8_t>();
+		for (int p = 0; p < player_count; ++p)
+			info.players.push_back(reader.ReadWideString());
+		reader.ReadData(&info.params, sizeof info.params);
+		info.script_name = reader.ReadString();
+		int deck_count = reader.Read<uint8_t>();
+		for (int d = 0; d < deck_count; ++d) {
+			uint16_t main = reader.Read<uint16_t>();
+			uint16_t area = reader.Read<uint16_t>();
+			info.decks.emplace_back(main, area);
+		}
+		info.turns = reader.Read<uint32_t>();
+		loaded[name] = std::move(info);
+	}
+	if (!reader.ok)
+		return;
+	std::lock_guard<std::mutex> lock(mutex);
+	entries.swap(loaded);
+}
+void ReplayIndex::Save() {
+	std::vector<unsigned char> data;
+	AppendValue<uint32_t>(data, INDEX_ID);
+	AppendValue<uint32_t>(data, INDEX_VERSION);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		AppendValue<uint32_t>(data, (uint32_t)entries.size());
+		for (const auto& entry : entries) {
+			const auto& info = entry.second;
+			AppendString(data, entry.first);
+			AppendValue(data, info.size);
+			AppendValue(data, info.mtime);
+			AppendValue(data, info.header);
+			AppendValue<uint8_t>(data, (uint8_t)info.players.size());
+			for (const auto& player : info.players)
+				AppendString(data, player);
+			AppendValue(data, info.params);
+			AppendString(data, info.script_name);
+			AppendValue<uint8_t>(data, (uint8_t)info.decks.size());
+			for (const auto& deck : info.decks) {
+				AppendValue(data, deck.first);
+				AppendValue(data, deck.second);
+			}
+			AppendValue(data, info.turns);
+		}
+	}
+	FILE* fp = mywfopen(INDEX_FILE, "wb");
+	if (!fp)
+		return;
+	std::fwrite(data.data(), data.size(), 1, fp);
+	std::fclose(fp);
+}
+void ReplayIndex::Stop() {
+	if (!worker.joinable())
+		return;
+	is_canceled = true;
+	worker.join();
+	is_canceled = false;
+}
+
+}
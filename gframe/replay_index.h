@@ -0,0 +1,63 @@
+#ifndef REPLAY_INDEX_H
+#define REPLAY_INDEX_H
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "replay.h"
+
+namespace ygo {
+
+// What the replay list shows of a replay, without the duel data.
+struct ReplayInfo {
+	uint64_t size{};
+	int64_t mtime{};
+	ExtendedReplayHeader header;
+	std::vector<std::wstring> players;
+	DuelParameters params;
+	std::string script_name;
+	// main and extra deck size of each player
+	std::vector<std::pair<uint16_t, uint16_t>> decks;
+	// 0 if the replay has no turn index
+	uint32_t turns{};
+
+	void Load(const Replay& replay);
+	bool Match(const wchar_t* filter) const;
+};
+
+/*
+* The info of the replays in ./replay, kept in a sidecar file.
+* An entry is valid while the size and modification time of its file are unchanged.
+* Update reads the missing entries on a background thread.
+*/
+class ReplayIndex {
+public:
+	static constexpr uint32_t INDEX_ID = 0x69707279;	// "yrpi"
+	static constexpr uint32_t INDEX_VERSION = 2;
+
+	~ReplayIndex();
+	void Update(const std::vector<std::wstring>& files);
+	bool GetInfo(const wchar_t* name, ReplayInfo& info);
+	bool Match(const std::wstring& name, const wchar_t* filter);
+
+private:
+	void Build(std::vector<std::wstring> files);
+	void Load();
+	void Save();
+	void Stop();
+
+	std::mutex mutex;
+	std::map<std::wstring, ReplayInfo> entries;
+	bool is_loaded{};
+	std::thread worker;
+	std::atomic<bool> is_canceled{};
+};
+
+extern ReplayIndex replayIndex;
+
+}
+
+#endif //REPLAY_INDEX_H
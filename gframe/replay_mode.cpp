@@ -2,6 +2,7 @@
 #include "duelclient.h"
 #include "game.h"
 #include "data_manager.h"
+#include <algorithm>
 #include <random>
 #include <thread>
 
@@ -19,6 +20,8 @@ bool ReplayMode::exit_pending = false;
 int ReplayMode::skip_turn = 0;
 int ReplayMode::current_step = 0;
 int ReplayMode::skip_step = 0;
+int ReplayMode::current_phase = 0;
+std::vector<ReplayKeyframe> ReplayMode::keyframes;
 
 bool ReplayMode::StartReplay(int skipturn) {
 	skip_turn = skipturn;
@@ -79,6 +82,8 @@ int ReplayMode::ReplayThread() {
 	engineBuffer.resize(SIZE_MESSAGE_BUFFER);
 	is_continuing = true;
 	skip_step = 0;
+	current_phase = 0;
+	keyframes.clear();
 	if(mainGame->dInfo.isSingleMode) {
 		int len = get_message(pduel, engineBuffer.data());
 		if (len > 0)
@@ -91,8 +96,11 @@ int ReplayMode::ReplayThread() {
 	}
 	exit_pending = false;
 	current_step = 0;
-	if(mainGame->dInfo.isReplaySkiping)
+	if(mainGame->dInfo.isReplaySkiping) {
 		mainGame->gMutex.lock();
+		if(is_continuing)
+			is_continuing = FastForward(engineBuffer);
+	}
 	while (is_continuing && !exit_pending) {
 		unsigned int result = process(pduel);
 		int len = result & PROCESSOR_BUFFER_LEN;
@@ -109,9 +117,14 @@ int ReplayMode::ReplayThread() {
 				int step = current_step - 1;
 				if(step < 0)
 					step = 0;
+				skip_step = 0;
+				if(auto key = FindKeyframe(step)) {
+					is_continuing = SeekKeyframe(*key, engineBuffer);
+					skip_step = step - key->step;
+					continue;
+				}
 				if(mainGame->dInfo.isSingleMode) {
 					is_continuing = true;
-					skip_step = 0;
 					int len = get_message(pduel, engineBuffer.data());
 					if (len > 0) {
 						is_continuing = ReplayAnalyze(engineBuffer.data(), len);
@@ -152,6 +165,10 @@ int ReplayMode::ReplayThread() {
 	skip_turn = 0;
 	current_step = 0;
 	skip_step = 0;
+	current_phase = 0;
+	keyframes.clear();
+	// unmap the file, it can be deleted or renamed now
+	cur_replay.Reset();
 	return 0;
 }
 bool ReplayMode::StartDuel() {
@@ -168,9 +185,9 @@ bool ReplayMode::StartDuel() {
 	}
 	if(rh.id == REPLAY_ID_YRP1) {
 		std::mt19937 rnd(rh.seed);
-		pduel = create_duel(rnd());
+		pduel = mycreate_duel(rnd());
 	} else {
-		pduel = create_duel_v2(cur_replay.pheader.seed_sequence);
+		pduel = mycreate_duel_v2(cur_replay.pheader.seed_sequence);
 	}
 	mainGame->dInfo.duel_rule = cur_replay.params.duel_flag >> 16;
 	set_player_info(pduel, 0, cur_replay.params.start_lp, cur_replay.params.start_hand, cur_replay.params.draw_count);
@@ -221,7 +238,7 @@ bool ReplayMode::StartDuel() {
 	return true;
 }
 void ReplayMode::EndDuel() {
-	end_duel(pduel);
+	myend_duel(pduel);
 	if(!is_closing) {
 		mainGame->actionSignal.Reset();
 		mainGame->gMutex.lock();
@@ -250,7 +267,7 @@ void ReplayMode::EndDuel() {
 	}
 }
 void ReplayMode::Restart(bool refresh) {
-	end_duel(pduel);
+	myend_duel(pduel);
 	mainGame->dInfo.isStarted = false;
 	mainGame->dInfo.isInDuel = false;
 	mainGame->dInfo.isFinished = true;
@@ -281,6 +298,203 @@ void ReplayMode::Undo() {
 	is_restarting = true;
 	Pause(false, false);
 }
+// The commands are points where no chain is open, so the field can be rebuilt from the engine alone.
+void ReplayMode::AddKeyframe() {
+	if(!keyframes.empty() && keyframes.back().step >= current_step)
+		return;
+	ReplayKeyframe key;
+	key.step = current_step;
+	key.position = cur_replay.GetPosition();
+	key.turn = mainGame->dInfo.turn;
+	key.phase = current_phase;
+	key.tag_player[0] = mainGame->dInfo.tag_player[0];
+	key.tag_player[1] = mainGame->dInfo.tag_player[1];
+	keyframes.push_back(key);
+}
+// the last keyframe before the step
+const ReplayKeyframe* ReplayMode::FindKeyframe(int step) {
+	auto it = std::lower_bound(keyframes.begin(), keyframes.end(), step, [](const ReplayKeyframe& key, int value) {
+		return key.step < value;
+	});
+	if(it == keyframes.begin())
+		return nullptr;
+	return &*(it - 1);
+}
+/*
+* Runs the restarted duel up to a keyframe without analyzing the messages,
+* the responses are fed whenever the engine waits for one.
+* Then the field is rebuilt once and the response of the keyframe is sent.
+*/
+bool ReplayMode::SeekKeyframe(const ReplayKeyframe& key, std::vector<unsigned char>& engineBuffer) {
+	if(mainGame->dInfo.isSingleMode)
+		get_message(pduel, engineBuffer.data());
+	for(;;) {
+		unsigned int result = process(pduel);
+		int len = result & PROCESSOR_BUFFER_LEN;
+		if (len > (int)engineBuffer.size())
+			engineBuffer.resize(len);
+		if (len > 0)
+			get_message(pduel, engineBuffer.data());
+		unsigned int flag = result & PROCESSOR_FLAG;
+		if(flag == PROCESSOR_END)
+			return false;
+		if(flag != PROCESSOR_WAITING)
+			continue;
+		if(cur_replay.GetPosition() >= key.position)
+			break;
+		if(!ReadReplayResponse())
+			return false;
+	}
+	if(cur_replay.GetPosition() != key.position)
+		return false;
+	current_step = key.step;
+	current_phase = key.phase;
+	mainGame->dInfo.turn = key.turn;
+	mainGame->dInfo.tag_player[0] = key.tag_player[0];
+	mainGame->dInfo.tag_player[1] = key.tag_player[1];
+	ReloadField(engineBuffer);
+	return ReadReplayResponse();
+}
+// Rebuilds the field from the engine, the turn, phase and tag players are already set.
+void ReplayMode::ReloadField(std::vector<unsigned char>& queryBuffer) {
+	int len = query_field_info(pduel, queryBuffer.data());
+	DuelClient::ClientAnalyze(queryBuffer.data(), len);
+	ReplayReload();
+	mainGame->dField.RefreshAllCards();
+	if(current_phase) {
+		unsigned char phase[3];
+		auto pbuf = phase;
+		BufferIO::Write<uint8_t>(pbuf, MSG_NEW_PHASE);
+		BufferIO::Write<uint16_t>(pbuf, (uint16_t)current_phase);
+		DuelClient::ClientAnalyze(phase, sizeof phase);
+	}
+}
+// the messages ReplayAnalyze counts as a step
+static bool IsStepMessage(int msg) {
+	switch(msg) {
+	case MSG_RETRY:
+	case MSG_WIN:
+	case MSG_SELECT_BATTLECMD:
+	case MSG_SELECT_IDLECMD:
+	case MSG_SELECT_EFFECTYN:
+	case MSG_SELECT_YESNO:
+	case MSG_SELECT_OPTION:
+	case MSG_SELECT_CARD:
+	case MSG_SELECT_TRIBUTE:
+	case MSG_SELECT_UNSELECT_CARD:
+	case MSG_SELECT_CHAIN:
+	case MSG_SELECT_PLACE:
+	case MSG_SELECT_DISFIELD:
+	case MSG_SELECT_FACE:
+	case MSG_SELECT_COUNTER:
+	case MSG_SELECT_SUM:
+	case MSG_SORT_CARD:
+	case MSG_ROCK_PAPER_SCISSORS:
+	case MSG_ANNOUNCE_RACE:
+	case MSG_ANNOUNCE_ATTRIB:
+	case MSG_ANNOUNCE_CARD:
+	case MSG_ANNOUNCE_NUMBER:
+	case MSG_SET:
+	case MSG_FIELD_DISABLED:
+	case MSG_SUMMONING:
+	case MSG_SPSUMMONING:
+	case MSG_FLIPSUMMONING:
+	case MSG_CHAIN_SOLVING:
+	case MSG_CHAIN_SOLVED:
+	case MSG_CHAIN_END:
+	case MSG_CARD_SELECTED:
+	case MSG_RANDOM_SELECTED:
+	case MSG_EQUIP:
+	case MSG_UNEQUIP:
+	case MSG_CARD_TARGET:
+	case MSG_CANCEL_TARGET:
+	case MSG_BATTLE:
+	case MSG_ATTACK_DISABLED:
+	case MSG_DAMAGE_STEP_START:
+	case MSG_DAMAGE_STEP_END:
+		return false;
+	default:
+		return true;
+	}
+}
+/*
+* Runs the duel to the turn skip_turn without analyzing the messages.
+* Only the turn, phase, tag players, steps and keyframes are followed while the client field stays as it is,
+* then the field is rebuilt once and MSG_NEW_TURN of the turn is analyzed as usual.
+* The messages after it in the same buffer are only seen through the rebuilt field,
+* except a select command or the end of the duel, which are analyzed too.
+*/
+bool ReplayMode::FastForward(std::vector<unsigned char>& engineBuffer) {
+	std::vector<unsigned char> queryBuffer;
+	queryBuffer.resize(SIZE_MESSAGE_BUFFER);
+	auto end_skip = [&]() {
+		ReloadField(queryBuffer);
+		mainGame->dInfo.isReplaySkiping = false;
+		mainGame->gMutex.unlock();
+	};
+	while(!exit_pending) {
+		unsigned int result = process(pduel);
+		int len = result & PROCESSOR_BUFFER_LEN;
+		if (len > (int)engineBuffer.size())
+			engineBuffer.resize(len);
+		if (len > 0)
+			get_message(pduel, engineBuffer.data());
+		unsigned int flag = result & PROCESSOR_FLAG;
+		unsigned char* msg = engineBuffer.data();
+		unsigned char* turn_msg = nullptr;
+		unsigned char* end_msg = nullptr;
+		unsigned char* last_msg = nullptr;
+		for(auto pbuf = msg; pbuf - msg < len;) {
+			int type = pbuf[0];
+			int length = MessageLength(pbuf);
+			if(type == MSG_WIN || type == MSG_RETRY || length < 0) {
+				end_msg = pbuf;
+				break;
+			}
+			last_msg = pbuf;
+			if(type == MSG_NEW_TURN && !turn_msg && --skip_turn == 0) {
+				turn_msg = pbuf;
+				pbuf += length;
+				continue;
+			}
+			if(type == MSG_NEW_TURN) {
+				int player = mainGame->LocalPlayer(pbuf[1]);
+				mainGame->dInfo.turn++;
+				if(mainGame->dInfo.isTag && mainGame->dInfo.turn != 1)
+					mainGame->dInfo.tag_player[player] = !mainGame->dInfo.tag_player[player];
+			} else if(type == MSG_NEW_PHASE) {
+				auto phase = pbuf + 1;
+				current_phase = BufferIO::Read<uint16_t>(phase);
+			}
+			if(IsStepMessage(type))
+				current_step++;
+			pbuf += length;
+		}
+		if(turn_msg || end_msg || flag == PROCESSOR_END) {
+			end_skip();
+			bool is_running = (flag != PROCESSOR_END);
+			if(turn_msg)
+				is_running = ReplayAnalyze(turn_msg, 2) && is_running;
+			auto tail = end_msg;
+			if(!tail && flag == PROCESSOR_WAITING && last_msg != turn_msg)
+				tail = last_msg;
+			if(tail && is_running)
+				return ReplayAnalyze(tail, (unsigned int)(len - (tail - msg)));
+			if(flag == PROCESSOR_WAITING && is_running)
+				return ReadReplayResponse();
+			return is_running;
+		}
+		if(flag == PROCESSOR_WAITING) {
+			if(last_msg && (last_msg[0] == MSG_SELECT_IDLECMD || last_msg[0] == MSG_SELECT_BATTLECMD))
+				AddKeyframe();
+			if(!ReadReplayResponse()) {
+				end_skip();
+				return false;
+			}
+		}
+	}
+	return false;
+}
 bool ReplayMode::ReplayAnalyze(unsigned char* msg, unsigned int len) {
 	unsigned char* pbuf = msg;
 	int player, count;
@@ -338,6 +552,7 @@ bool ReplayMode::ReplayAnalyze(unsigned char* msg, unsigned int len) {
 			count = BufferIO::Read<uint8_t>(pbuf);
 			pbuf += count * 8 + 2;
 			ReplayRefresh();
+			AddKeyframe();
 			return ReadReplayResponse();
 		}
 		case MSG_SELECT_IDLECMD: {
@@ -355,6 +570,7 @@ bool ReplayMode::ReplayAnalyze(unsigned char* msg, unsigned int len) {
 			count = BufferIO::Read<uint8_t>(pbuf);
 			pbuf += count * 11 + 3;
 			ReplayRefresh();
+			AddKeyframe();
 			return ReadReplayResponse();
 		}
 		case MSG_SELECT_EFFECTYN: {
@@ -502,20 +718,12 @@ bool ReplayMode::ReplayAnalyze(unsigned char* msg, unsigned int len) {
 			break;
 		}
 		case MSG_NEW_TURN: {
-			if(skip_turn) {
-				skip_turn--;
-				if(skip_turn == 0) {
-					mainGame->dInfo.isReplaySkiping = false;
-					mainGame->dField.RefreshAllCards();
-					mainGame->gMutex.unlock();
-				}
-			}
 			player = BufferIO::Read<uint8_t>(pbuf);
 			DuelClient::ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_NEW_PHASE: {
-			pbuf += 2;
+			current_phase = BufferIO::Read<uint16_t>(pbuf);
 			DuelClient::ClientAnalyze(offset, pbuf - offset);
 			ReplayRefresh();
 			break;
@@ -859,6 +1067,257 @@ bool ReplayMode::ReplayAnalyze(unsigned char* msg, unsigned int len) {
 	}
 	return true;
 }
+/*
+* The length of the message at msg, following ReplayAnalyze, or -1 for an unknown message.
+* For the places that walk the messages without analyzing them.
+*/
+int ReplayMode::MessageLength(unsigned char* msg) {
+	unsigned char* pbuf = msg;
+	int count;
+	switch (BufferIO::Read<uint8_t>(pbuf)) {
+	case MSG_RETRY: {
+		break;
+	}
+	case MSG_WIN: {
+		pbuf += 2;
+		break;
+	}
+	case MSG_NEW_TURN: {
+		pbuf += 1;
+		break;
+	}
+	case MSG_SELECT_BATTLECMD: {
+		pbuf++;
+		count = BufferIO::Read<uint8_t>(pbuf);
+		pbuf += count * 11;
+		count = BufferIO::Read<uint8_t>(pbuf);
+		pbuf += count * 8 + 2;
+		break;
+	}
+	case MSG_SELECT_IDLECMD: {
+		pbuf++;
+		for (int i = 0; i < 5; ++i) {
+			count = BufferIO::Read<uint8_t>(pbuf);
+			pbuf += count * 7;
+		}
+		count = BufferIO::Read<uint8_t>(pbuf);
+		pbuf += count * 11 + 3;
+		break;
+	}
+	case MSG_SELECT_EFFECTYN: {
+		pbuf += 13;
+		break;
+	}
+	case MSG_SELECT_YESNO: {
+		pbuf += 5;
+		break;
+	}
+	case MSG_SELECT_OPTION: {
+		pbuf++;
+		count = BufferIO::Read<uint8_t>(pbuf);
+		pbuf += count * 4;
+		break;
+	}
+	case MSG_SELECT_CARD:
+	case MSG_SELECT_TRIBUTE: {
+		pbuf += 4;
+		count = BufferIO::Read<uint8_t>(pbuf);
+		pbuf += count * 8;
+		break;
+	}
+	case MSG_SELECT_UNSELECT_CARD: {
+		pbuf += 5;
+		count = BufferIO::Read<uint8_t>(pbuf);
+		pbuf += count * 8;
+		count = BufferIO::Read<uint8_t>(pbuf);
+		pbuf += count * 8;
+		break;
+	}
+	case MSG_SELECT_CHAIN: {
+		pbuf++;
+		count = BufferIO::Read<uint8_t>(pbuf);
+		pbuf += 9 + count * 14;
+		break;
+	}
+	case MSG_SELECT_PLACE:
+	case MSG_SELECT_DISFIELD:
+	case MSG_SELECT_FACE:
+	case MSG_ANNOUNCE_RACE:
+	case MSG_ANNOUNCE_ATTRIB: {
+		pbuf += 6;
+		break;
+	}
+	case MSG_SELECT_COUNTER: {
+		pbuf += 5;
+		count = BufferIO::Read<uint8_t>(pbuf);
+		pbuf += count * 9;
+		break;
+	}
+	case MSG_SELECT_SUM: {
+		pbuf += 8;
+		count = BufferIO::Read<uint8_t>(pbuf);
+		pbuf += count * 11;
+		count = BufferIO::Read<uint8_t>(pbuf);
+		pbuf += count * 11;
+		break;
+	}
+	case MSG_SORT_CARD:
+	case MSG_CONFIRM_DECKTOP:
+	case MSG_CONFIRM_EXTRATOP: {
+		pbuf++;
+		count = BufferIO::Read<uint8_t>(pbuf);
+		pbuf += count * 7;
+		break;
+	}
+	case MSG_CONFIRM_CARDS: {
+		pbuf += 2;
+		count = BufferIO::Read<uint8_t>(pbuf);
+		pbuf += count * 7;
+		break;
+	}
+	case MSG_SHUFFLE_HAND:
+	case MSG_SHUFFLE_EXTRA:
+	case MSG_CARD_SELECTED:
+	case MSG_RANDOM_SELECTED:
+	case MSG_DRAW:
+	case MSG_ANNOUNCE_CARD:
+	case MSG_ANNOUNCE_NUMBER: {
+		pbuf++;
+		count = BufferIO::Read<uint8_t>(pbuf);
+		pbuf += count * 4;
+		break;
+	}
+	case MSG_SHUFFLE_SET_CARD: {
+		pbuf++;
+		count = BufferIO::Read<uint8_t>(pbuf);
+		pbuf += count * 8;
+		break;
+	}
+	case MSG_BECOME_TARGET: {
+		count = BufferIO::Read<uint8_t>(pbuf);
+		pbuf += count * 4;
+		break;
+	}
+	case MSG_TOSS_COIN:
+	case MSG_TOSS_DICE: {
+		pbuf++;
+		count = BufferIO::Read<uint8_t>(pbuf);
+		pbuf += count;
+		break;
+	}
+	case MSG_SHUFFLE_DECK:
+	case MSG_REFRESH_DECK:
+	case MSG_SWAP_GRAVE_DECK:
+	case MSG_CHAINED:
+	case MSG_CHAIN_SOLVING:
+	case MSG_CHAIN_SOLVED:
+	case MSG_CHAIN_NEGATED:
+	case MSG_CHAIN_DISABLED:
+	case MSG_ROCK_PAPER_SCISSORS:
+	case MSG_HAND_RES: {
+		pbuf += 1;
+		break;
+	}
+	case MSG_NEW_PHASE: {
+		pbuf += 2;
+		break;
+	}
+	case MSG_FIELD_DISABLED:
+	case MSG_UNEQUIP:
+	case MSG_MATCH_KILL: {
+		pbuf += 4;
+		break;
+	}
+	case MSG_DAMAGE:
+	case MSG_RECOVER:
+	case MSG_LPUPDATE:
+	case MSG_PAY_LPCOST: {
+		pbuf += 5;
+		break;
+	}
+	case MSG_HINT:
+	case MSG_DECK_TOP:
+	case MSG_PLAYER_HINT: {
+		pbuf += 6;
+		break;
+	}
+	case MSG_ADD_COUNTER:
+	case MSG_REMOVE_COUNTER: {
+		pbuf += 7;
+		break;
+	}
+	case MSG_SET:
+	case MSG_SUMMONING:
+	case MSG_SPSUMMONING:
+	case MSG_FLIPSUMMONING:
+	case MSG_EQUIP:
+	case MSG_CARD_TARGET:
+	case MSG_CANCEL_TARGET:
+	case MSG_ATTACK:
+	case MSG_MISSED_EFFECT: {
+		pbuf += 8;
+		break;
+	}
+	case MSG_POS_CHANGE:
+	case MSG_CARD_HINT: {
+		pbuf += 9;
+		break;
+	}
+	case MSG_MOVE:
+	case MSG_SWAP:
+	case MSG_CHAINING: {
+		pbuf += 16;
+		break;
+	}
+	case MSG_BATTLE: {
+		pbuf += 26;
+		break;
+	}
+	case MSG_REVERSE_DECK:
+	case MSG_SUMMONED:
+	case MSG_SPSUMMONED:
+	case MSG_FLIPSUMMONED:
+	case MSG_CHAIN_END:
+	case MSG_ATTACK_DISABLED:
+	case MSG_DAMAGE_STEP_START:
+	case MSG_DAMAGE_STEP_END: {
+		break;
+	}
+	case MSG_TAG_SWAP: {
+		pbuf += pbuf[2] * 4 + pbuf[4] * 4 + 9;
+		break;
+	}
+	case MSG_RELOAD_FIELD: {
+		pbuf++;
+		for (int p = 0; p < 2; ++p) {
+			pbuf += 4;
+			for (int seq = 0; seq < 7; ++seq) {
+				int val = BufferIO::Read<uint8_t>(pbuf);
+				if (val)
+					pbuf += 2;
+			}
+			for (int seq = 0; seq < 8; ++seq) {
+				int val = BufferIO::Read<uint8_t>(pbuf);
+				if (val)
+					pbuf++;
+			}
+			pbuf += 6;
+		}
+		pbuf++;
+		break;
+	}
+	case MSG_AI_NAME:
+	case MSG_SHOW_HINT: {
+		int len = BufferIO::Read<uint16_t>(pbuf);
+		pbuf += len + 1;
+		break;
+	}
+	default: {
+		return -1;
+	}
+	}
+	return (int)(pbuf - msg);
+}
 inline void ReplayMode::ReloadLocation(int player, int location, int flag, std::vector<unsigned char>& queryBuffer) {
 	query_field_card(pduel, player, location, flag, queryBuffer.data(), 0);
 	mainGame->dField.UpdateFieldCard(mainGame->LocalPlayer(player), location, queryBuffer.data());
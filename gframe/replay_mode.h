@@ -7,6 +7,15 @@
 
 namespace ygo {
 
+// A select command of the replay where the playback can resume after running the engine alone.
+struct ReplayKeyframe {
+	int step{};
+	size_t position{};	// the response to the select command
+	int turn{};
+	int phase{};
+	bool tag_player[2]{};
+};
+
 class ReplayMode {
 private:
 	static intptr_t pduel;
@@ -20,6 +29,8 @@ private:
 	static int skip_turn;
 	static int current_step;
 	static int skip_step;
+	static int current_phase;
+	static std::vector<ReplayKeyframe> keyframes;
 	static void ReloadLocation(int player, int location, int flag, std::vector<unsigned char>& queryBuffer);
 
 public:
@@ -35,7 +46,13 @@ public:
 	static void EndDuel();
 	static void Restart(bool refresh);
 	static void Undo();
+	static void AddKeyframe();
+	static const ReplayKeyframe* FindKeyframe(int step);
+	static bool SeekKeyframe(const ReplayKeyframe& key, std::vector<unsigned char>& engineBuffer);
+	static void ReloadField(std::vector<unsigned char>& queryBuffer);
+	static bool FastForward(std::vector<unsigned char>& engineBuffer);
 	static bool ReplayAnalyze(unsigned char* msg, unsigned int len);
+	static int MessageLength(unsigned char* msg);
 	
 	static void ReplayRefresh(int flag = 0xf81fff);
 	static void ReplayRefreshLocation(int player, int location, int flag);
@@ -0,0 +1,191 @@
+#include "replay_verifier.h"
+#include "replay_mode.h"
+#include "game.h"
+#include "data_manager.h"
+#include "myfilesystem.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+namespace ygo {
+
+int ReplayVerifier::Run(const wchar_t* dir, unsigned int threads) {
+	std::vector<ReplayCheck> checks;
+	FileSystem::TraversalDir(dir, [&checks](const wchar_t* name, bool isdir) {
+		if (isdir || !IsExtension(name, L".yrp"))
+			return;
+		checks.emplace_back();
+		checks.back().name = name;
+	});
+	set_script_reader(DataManager::ScriptReaderEx);
+	set_card_reader(DataManager::CardReader);
+	set_message_handler(ReplayVerifier::MessageHandler);
+	if (threads == 0)
+		threads = 1;
+	if (threads > checks.size())
+		threads = (unsigned int)checks.size();
+	std::atomic<size_t> next{ 0 };
+	std::vector<std::thread> workers;
+	for (unsigned int i = 0; i < threads; ++i) {
+		workers.emplace_back([dir, &checks, &next]() {
+			for (size_t index = next++; index < checks.size(); index = next++)
+				Verify(dir, checks[index]);
+		});
+	}
+	for (auto& worker : workers)
+		worker.join();
+	static const char* result_names[] = { "win", "unfinished", "error" };
+	size_t count[3]{};
+	uint64_t total_us = 0;
+	std::printf("replay\tresult\tturns\tsteps\tresponses\tprocess_us\n");
+	for (const auto& check : checks) {
+		char name[1024];
+		BufferIO::EncodeUTF8(check.name.c_str(), name);
+		std::printf("%s\t%s\t%d\t%u\t%u\t%llu\n", name, result_names[check.result], check.turns, check.steps,
+		            check.responses, (unsigned long long)check.process_us);
+		++count[check.result];
+		total_us += check.process_us;
+	}
+	std::printf("total %u, win %u, unfinished %u, error %u, process_us %llu\n", (unsigned int)checks.size(),
+	            (unsigned int)count[RESULT_WIN], (unsigned int)count[RESULT_UNFINISHED], (unsigned int)count[RESULT_ERROR],
+	            (unsigned long long)total_us);
+	return count[RESULT_WIN] == checks.size() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+void ReplayVerifier::Verify(const wchar_t* dir, ReplayCheck& check) {
+	check.result = RESULT_ERROR;
+	wchar_t fname[1024];
+	if (myswprintf(fname, L"%ls/%ls", dir, check.name.c_str()) <= 0)
+		return;
+	Replay replay;
+	if (!replay.OpenReplay(fname))
+		return;
+	intptr_t pduel = CreateDuel(replay);
+	if (!pduel)
+		return;
+	check.result = RESULT_UNFINISHED;
+	std::vector<unsigned char> engineBuffer;
+	engineBuffer.resize(SIZE_MESSAGE_BUFFER);
+	bool is_continuing = true;
+	int checked_turns = 0;
+	if (replay.pheader.base.flag & REPLAY_SINGLE_MODE) {
+		int len = get_message(pduel, engineBuffer.data());
+		if (len > 0)
+			is_continuing = ScanMessages(engineBuffer.data(), len, check);
+	}
+	while (is_continuing) {
+		auto start = std::chrono::steady_clock::now();
+		unsigned int result = process(pduel);
+		auto elapsed = std::chrono::steady_clock::now() - start;
+		check.process_us += std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+		++check.steps;
+		int len = result & PROCESSOR_BUFFER_LEN;
+		if (len > (int)engineBuffer.size())
+			engineBuffer.resize(len);
+		if (len > 0) {
+			get_message(pduel, engineBuffer.data());
+			bool is_running = ScanMessages(engineBuffer.data(), len, check);
+			// the turns recorded in a YRP3 index must start where the duel starts them
+			size_t position;
+			if (check.turns != checked_turns && replay.GetTurnPosition(check.turns, position) && position != replay.GetPosition()) {
+				check.result = RESULT_ERROR;
+				break;
+			}
+			checked_turns = check.turns;
+			if (!is_running)
+				break;
+		}
+		unsigned int flag = result & PROCESSOR_FLAG;
+		if (flag == PROCESSOR_END)
+			break;
+		if (flag == PROCESSOR_WAITING) {
+			unsigned char resp[SIZE_RETURN_VALUE];
+			if (!replay.ReadNextResponse(resp))
+				break;
+			set_responseb(pduel, resp);
+			++check.responses;
+		}
+	}
+	myend_duel(pduel);
+}
+// the engine side of ReplayMode::StartDuel
+intptr_t ReplayVerifier::CreateDuel(Replay& replay) {
+	const auto& rh = replay.pheader.base;
+	replay.SkipInfo();
+	intptr_t pduel;
+	if (rh.id == REPLAY_ID_YRP1) {
+		std::mt19937 rnd(rh.seed);
+		pduel = mycreate_duel(rnd());
+	} else {
+		pduel = mycreate_duel_v2(replay.pheader.seed_sequence);
+	}
+	set_player_info(pduel, 0, replay.params.start_lp, replay.params.start_hand, replay.params.draw_count);
+	set_player_info(pduel, 1, replay.params.start_lp, replay.params.start_hand, replay.params.draw_count);
+	if (rh.flag & REPLAY_SINGLE_MODE) {
+		char filename[256]{};
+		mysnprintf(filename, "./single/%s", replay.script_name.c_str());
+		if (!preload_script(pduel, filename)) {
+			myend_duel(pduel);
+			return 0;
+		}
+	} else if (!(rh.flag & REPLAY_TAG)) {
+		for (int i = 0; i < 2; ++i) {
+			for (const auto& code : replay.decks[i].main)
+				new_card(pduel, code, i, i, LOCATION_DECK, 0, POS_FACEDOWN_DEFENSE);
+			for (const auto& code : replay.decks[i].area)
+				new_card(pduel, code, i, i, LOCATION_ADECK, 0, POS_FACEDOWN_DEFENSE);
+		}
+	} else {
+		for (int i = 0; i < 2; ++i) {
+			const auto& deck = replay.decks[i * 2];
+			const auto& tag_deck = replay.decks[i * 2 + 1];
+			for (const auto& code : deck.main)
+				new_card(pduel, code, i, i, LOCATION_DECK, 0, POS_FACEDOWN_DEFENSE);
+			for (const auto& code : deck.area)
+				new_card(pduel, code, i, i, LOCATION_ADECK, 0, POS_FACEDOWN_DEFENSE);
+			for (const auto& code : tag_deck.main)
+				new_tag_card(pduel, code, i, LOCATION_DECK);
+			for (const auto& code : tag_deck.area)
+				new_tag_card(pduel, code, i, LOCATION_ADECK);
+		}
+	}
+	start_duel(pduel, replay.params.duel_flag);
+	return pduel;
+}
+/*
+* Walks the messages of an engine buffer.
+* Returns false when the duel is decided or the replay cannot go on.
+*/
+bool ReplayVerifier::ScanMessages(unsigned char* msg, int len, ReplayCheck& check) {
+	unsigned char* pbuf = msg;
+	while (pbuf - msg < len) {
+		switch (pbuf[0]) {
+		case MSG_RETRY: {
+			check.result = RESULT_ERROR;
+			return false;
+		}
+		case MSG_WIN: {
+			check.result = RESULT_WIN;
+			return false;
+		}
+		case MSG_NEW_TURN: {
+			++check.turns;
+			break;
+		}
+		}
+		int length = ReplayMode::MessageLength(pbuf);
+		if (length < 0) {
+			check.result = RESULT_ERROR;
+			return false;
+		}
+		pbuf += length;
+	}
+	return true;
+}
+uint32_t ReplayVerifier::MessageHandler(intptr_t fduel, uint32_t type) {
+	return 0;
+}
+
+}
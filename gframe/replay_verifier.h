@@ -0,0 +1,41 @@
+#ifndef REPLAY_VERIFIER_H
+#define REPLAY_VERIFIER_H
+
+#include <cstdint>
+#include <string>
+#include "replay.h"
+
+namespace ygo {
+
+struct ReplayCheck {
+	std::wstring name;
+	int result{};
+	int turns{};
+	uint32_t steps{};		// calls of process()
+	uint32_t responses{};
+	uint64_t process_us{};	// time spent in process()
+};
+
+/*
+* Re-simulates every replay of a folder through the engine, without the client.
+* Each worker thread runs one duel at a time.
+* A replay passes if the recorded responses lead the duel to MSG_WIN.
+*/
+class ReplayVerifier {
+public:
+	static constexpr int RESULT_WIN = 0;
+	// the responses ran out before MSG_WIN, e.g. a surrender
+	static constexpr int RESULT_UNFINISHED = 1;
+	// unreadable replay, rejected response or unknown message
+	static constexpr int RESULT_ERROR = 2;
+
+	static int Run(const wchar_t* dir, unsigned int threads);
+	static void Verify(const wchar_t* dir, ReplayCheck& check);
+	static intptr_t CreateDuel(Replay& replay);
+	static bool ScanMessages(unsigned char* msg, int len, ReplayCheck& check);
+	static uint32_t MessageHandler(intptr_t fduel, uint32_t type);
+};
+
+}
+
+#endif //REPLAY_VERIFIER_H
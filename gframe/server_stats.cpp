@@ -0,0 +1,64 @@
+#include "server_stats.h"
+
+namespace ygo {
+
+StatsHistogram ServerStats::engine_step;
+StatsHistogram ServerStats::analyze;
+StatsHistogram ServerStats::query_field;
+StatsHistogram ServerStats::replay_compress;
+std::atomic<uint64_t> ServerStats::messages{ 0 };
+std::atomic<uint64_t> ServerStats::bytes_sent{ 0 };
+std::atomic<uint64_t> ServerStats::replay_bytes{ 0 };
+std::atomic<uint64_t> ServerStats::replay_compressed_bytes{ 0 };
+wchar_t ServerStats::output[256] = {};
+
+void StatsHistogram::Add(uint64_t value) {
+	int bucket = 0;
+	while (bucket < BUCKETS - 1 && (value >> (bucket + 1)))
+		++bucket;
+	buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	total.fetch_add(value, std::memory_order_relaxed);
+	uint64_t current = max.load(std::memory_order_relaxed);
+	while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+		;
+}
+/*
+* Each field is taken on its own, a value added meanwhile may be counted in the next sample by some fields.
+*/
+StatsHistogram::Sample StatsHistogram::Take() {
+	Sample sample;
+	for (int i = 0; i < BUCKETS; ++i)
+		sample.buckets[i] = buckets[i].exchange(0, std::memory_order_relaxed);
+	sample.count = count.exchange(0, std::memory_order_relaxed);
+	sample.total = total.exchange(0, std::memory_order_relaxed);
+	sample.max = max.exchange(0, std::memory_order_relaxed);
+	return sample;
+}
+// the upper bound of the bucket holding the percentile
+uint64_t StatsHistogram::Sample::Percentile(uint64_t percent) const {
+	uint64_t target = (count * percent + 99) / 100;
+	uint64_t seen = 0;
+	for (int i = 0; i < BUCKETS; ++i) {
+		seen += buckets[i];
+		if (seen && seen >= target)
+			return (uint64_t)1 << (i + 1);
+	}
+	return max;
+}
+void StatsHistogram::Sample::Print(FILE* fp, const char* name) const {
+	uint64_t mean = count ? total / count : 0;
+	std::fprintf(fp, "%s count=%llu mean_us=%llu p50_us=%llu p99_us=%llu max_us=%llu\n", name,
+	             (unsigned long long)count, (unsigned long long)mean, (unsigned long long)Percentile(50),
+	             (unsigned long long)Percentile(99), (unsigned long long)max);
+}
+void ServerStats::SetOutput(const wchar_t* file) {
+	BufferIO::CopyWideString(file, output);
+}
+FILE* ServerStats::OpenOutput() {
+	if (!IsEnabled())
+		return nullptr;
+	return mywfopen(output, "w");
+}
+
+}
@@ -0,0 +1,80 @@
+#ifndef SERVER_STATS_H
+#define SERVER_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include "config.h"
+
+namespace ygo {
+
+// Durations in microseconds, bucket i counts the values below 2^(i+1).
+struct StatsHistogram {
+	static constexpr int BUCKETS = 24;
+
+	// the values added in one report interval
+	struct Sample {
+		uint64_t buckets[BUCKETS]{};
+		uint64_t count{};
+		uint64_t total{};
+		uint64_t max{};
+
+		uint64_t Percentile(uint64_t percent) const;
+		void Print(FILE* fp, const char* name) const;
+	};
+
+	std::atomic<uint64_t> buckets[BUCKETS]{};
+	std::atomic<uint64_t> count{};
+	std::atomic<uint64_t> total{};
+	std::atomic<uint64_t> max{};
+
+	void Add(uint64_t value);
+	// the values added since the last call, the histogram starts over
+	Sample Take();
+};
+
+// Adds the lifetime of the timer to a histogram.
+class StatsTimer {
+public:
+	explicit StatsTimer(StatsHistogram& histogram) : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+	~StatsTimer() {
+		auto elapsed = std::chrono::steady_clock::now() - start;
+		histogram.Add(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+	}
+
+private:
+	StatsHistogram& histogram;
+	std::chrono::steady_clock::time_point start;
+};
+
+/*
+* Counters of the server, shared by all loops.
+* NetServer writes them to the stats file every REPORT_INTERVAL seconds.
+*/
+class ServerStats {
+public:
+	static constexpr int REPORT_INTERVAL = 10;
+
+	static StatsHistogram engine_step;
+	static StatsHistogram analyze;
+	static StatsHistogram query_field;
+	static StatsHistogram replay_compress;
+	static std::atomic<uint64_t> messages;
+	static std::atomic<uint64_t> bytes_sent;
+	// size of the finished replays before and after compression
+	static std::atomic<uint64_t> replay_bytes;
+	static std::atomic<uint64_t> replay_compressed_bytes;
+
+	static void SetOutput(const wchar_t* file);
+	static bool IsEnabled() {
+		return output[0] != 0;
+	}
+	static FILE* OpenOutput();
+
+private:
+	static wchar_t output[256];
+};
+
+}
+
+#endif //SERVER_STATS_H
@@ -17,10 +17,10 @@ void SingleDuel::Chat(DuelPlayer* dp, unsigned char* pdata, int len) {
 	const auto scc_size = NetServer::CreateChatPacket(pdata, len, scc, dp->type);
 	if (!scc_size)
 		return;
-	NetServer::SendBufferToPlayer(players[0], STOC_CHAT, scc, scc_size);
-	NetServer::ReSendToPlayer(players[1]);
+	auto packet = NetServer::SendBufferToPlayer(players[0], STOC_CHAT, scc, scc_size);
+	NetServer::ReSendToPlayer(players[1], packet);
 	for(auto pit = observers.begin(); pit != observers.end(); ++pit)
-		NetServer::ReSendToPlayer(*pit);
+		NetServer::ReSendToPlayer(*pit, packet);
 }
 void SingleDuel::JoinGame(DuelPlayer* dp, unsigned char* pdata, bool is_creater) {
 	if(!is_creater) {
@@ -127,11 +127,20 @@ void SingleDuel::JoinGame(DuelPlayer* dp, unsigned char* pdata, bool is_creater)
 		scwc.watch_count = (unsigned short)observers.size();
 		NetServer::SendPacketToPlayer(dp, STOC_HS_WATCH_CHANGE, scwc);
 	}
+	if(dp->type == NETPLAYER_TYPE_OBSERVER && duel_stage == DUEL_STAGE_DUELING) {
+		RequestField(dp);
+		dp->state = CTOS_LEAVE_GAME;
+	} else if(dp->type == NETPLAYER_TYPE_OBSERVER && duel_stage != DUEL_STAGE_BEGIN && duel_stage != DUEL_STAGE_END) {
+		// the duel has not started yet, the observer gets it from MSG_START like the others
+		NetServer::SendPacketToPlayer(dp, STOC_DUEL_START);
+		if(duel_stage == DUEL_STAGE_SIDING)
+			NetServer::SendPacketToPlayer(dp, STOC_WAITING_SIDE);
+		dp->state = CTOS_LEAVE_GAME;
+	}
 }
 void SingleDuel::LeaveGame(DuelPlayer* dp) {
 	if(dp == host_player) {
-		EndDuel();
-		NetServer::StopServer();
+		NetServer::CloseRoom(this);
 	} else if(dp->type == NETPLAYER_TYPE_OBSERVER) {
 		observers.erase(dp);
 		if(duel_stage == DUEL_STAGE_BEGIN) {
@@ -170,15 +179,15 @@ void SingleDuel::LeaveGame(DuelPlayer* dp) {
 				wbuf[0] = MSG_WIN;
 				wbuf[1] = 1 - dp->type;
 				wbuf[2] = 0x4;
-				NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, wbuf, 3);
-				NetServer::ReSendToPlayer(players[1]);
+				auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, wbuf, 3);
+				NetServer::ReSendToPlayer(players[1], packet);
 				for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-					NetServer::ReSendToPlayer(*oit);
+					NetServer::ReSendToPlayer(*oit, packet);
 				EndDuel();
-				NetServer::SendPacketToPlayer(players[0], STOC_DUEL_END);
-				NetServer::ReSendToPlayer(players[1]);
+				packet = NetServer::SendPacketToPlayer(players[0], STOC_DUEL_END);
+				NetServer::ReSendToPlayer(players[1], packet);
 				for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-					NetServer::ReSendToPlayer(*oit);
+					NetServer::ReSendToPlayer(*oit, packet);
 			}
 			NetServer::DisconnectPlayer(dp);
 		}
@@ -322,11 +331,11 @@ void SingleDuel::StartDuel(DuelPlayer* dp) {
 		return;
 	NetServer::StopListen();
 	//NetServer::StopBroadcast();
-	NetServer::SendPacketToPlayer(players[0], STOC_DUEL_START);
-	NetServer::ReSendToPlayer(players[1]);
+	auto packet = NetServer::SendPacketToPlayer(players[0], STOC_DUEL_START);
+	NetServer::ReSendToPlayer(players[1], packet);
 	for(auto oit = observers.begin(); oit != observers.end(); ++oit) {
 		(*oit)->state = CTOS_LEAVE_GAME;
-		NetServer::ReSendToPlayer(*oit);
+		NetServer::ReSendToPlayer(*oit, packet);
 	}
 	unsigned char deckbuff[12];
 	auto pbuf = deckbuff;
@@ -342,8 +351,8 @@ void SingleDuel::StartDuel(DuelPlayer* dp) {
 	std::memcpy(deckbuff, deckbuff + 6, 6);
 	std::memcpy(deckbuff + 6, tempbuff, 6);
 	NetServer::SendBufferToPlayer(players[1], STOC_DECK_COUNT, deckbuff, 12);
-	NetServer::SendPacketToPlayer(players[0], STOC_SELECT_HAND);
-	NetServer::ReSendToPlayer(players[1]);
+	packet = NetServer::SendPacketToPlayer(players[0], STOC_SELECT_HAND);
+	NetServer::ReSendToPlayer(players[1], packet);
 	hand_result[0] = 0;
 	hand_result[1] = 0;
 	players[0]->state = CTOS_HAND_RESULT;
@@ -360,15 +369,15 @@ void SingleDuel::HandResult(DuelPlayer* dp, unsigned char res) {
 		STOC_HandResult schr;
 		schr.res1 = hand_result[0];
 		schr.res2 = hand_result[1];
-		NetServer::SendPacketToPlayer(players[0], STOC_HAND_RESULT, schr);
+		auto packet = NetServer::SendPacketToPlayer(players[0], STOC_HAND_RESULT, schr);
 		for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-			NetServer::ReSendToPlayer(*oit);
+			NetServer::ReSendToPlayer(*oit, packet);
 		schr.res1 = hand_result[1];
 		schr.res2 = hand_result[0];
 		NetServer::SendPacketToPlayer(players[1], STOC_HAND_RESULT, schr);
 		if(hand_result[0] == hand_result[1]) {
-			NetServer::SendPacketToPlayer(players[0], STOC_SELECT_HAND);
-			NetServer::ReSendToPlayer(players[1]);
+			packet = NetServer::SendPacketToPlayer(players[0], STOC_SELECT_HAND);
+			NetServer::ReSendToPlayer(players[1], packet);
 			hand_result[0] = 0;
 			hand_result[1] = 0;
 			players[0]->state = CTOS_HAND_RESULT;
@@ -418,7 +427,7 @@ void SingleDuel::TPResult(DuelPlayer* dp, unsigned char tp) {
 	for (auto& x : rh.seed_sequence)
 		x = rd();
 	mtrandom rnd(rh.seed_sequence, SEED_COUNT);
-	last_replay.BeginRecord();
+	last_replay.BeginRecord(!NetServer::IsMultiRoom());
 	last_replay.WriteHeader(rh);
 	last_replay.WriteData(players[0]->name, 40, false);
 	last_replay.WriteData(players[1]->name, 40, false);
@@ -431,7 +440,7 @@ void SingleDuel::TPResult(DuelPlayer* dp, unsigned char tp) {
 	set_script_reader(DataManager::ScriptReaderEx);
 	set_card_reader(DataManager::CardReader);
 	set_message_handler(SingleDuel::MessageHandler);
-	pduel = create_duel_v2(rh.seed_sequence);
+	pduel = mycreate_duel_v2(rh.seed_sequence);
 	set_player_info(pduel, 0, host_info.start_energy, host_info.start_hand, host_info.draw_count);
 	set_player_info(pduel, 1, host_info.start_energy, host_info.start_hand, host_info.draw_count);
 	unsigned int opt = (unsigned int)host_info.duel_rule << 16;
@@ -445,14 +454,15 @@ void SingleDuel::TPResult(DuelPlayer* dp, unsigned char tp) {
 	auto load = [&](const std::vector<code_pointer>& deck_container, uint8_t p, uint8_t location) {
 		last_replay.WriteInt32(deck_container.size(), false);
 		for (auto cit = deck_container.rbegin(); cit != deck_container.rend(); ++cit) {
-			new_card(pduel, (*cit)->first, p, p, location, 0, POS_FACEDOWN_DEFENSE);
-			last_replay.WriteInt32((*cit)->first, false);
+			new_card(pduel, (*cit)->code, p, p, location, 0, POS_FACEDOWN_DEFENSE);
+			last_replay.WriteInt32((*cit)->code, false);
 		}
 	};
 	load(pdeck[0].main, 0, LOCATION_DECK);
 	load(pdeck[0].area, 0, LOCATION_ADECK);
 	load(pdeck[1].main, 1, LOCATION_DECK);
 	load(pdeck[1].area, 1, LOCATION_ADECK);
+	last_replay.EndInfo();
 	last_replay.Flush();
 	unsigned char startbuf[32]{};
 	auto pbuf = startbuf;
@@ -485,6 +495,8 @@ void SingleDuel::TPResult(DuelPlayer* dp, unsigned char tp) {
 	Process();
 }
 void SingleDuel::Process() {
+	field_snapshot.clear();
+	NetServer::BeginBatch();
 	std::vector<unsigned char> engineBuffer;
 	engineBuffer.reserve(SIZE_MESSAGE_BUFFER);
 	unsigned int engFlag = 0;
@@ -493,25 +505,31 @@ void SingleDuel::Process() {
 	while (!stop) {
 		if (engFlag == PROCESSOR_END)
 			break;
-		unsigned int result = process(pduel);
+		unsigned int result;
+		{
+			StatsTimer timer(ServerStats::engine_step);
+			result = process(pduel);
+		}
 		engLen = result & PROCESSOR_BUFFER_LEN;
 		engFlag = result & PROCESSOR_FLAG;
 		if (engLen > 0) {
 			if (engLen > (int)engineBuffer.size())
 				engineBuffer.resize(engLen);
 			get_message(pduel, engineBuffer.data());
+			StatsTimer timer(ServerStats::analyze);
 			stop = Analyze(engineBuffer.data(), engLen);
 		}
 	}
 	if(stop == 2)
 		DuelEndProc();
+	NetServer::EndBatch();
 }
 void SingleDuel::DuelEndProc() {
 	if(!match_mode) {
-		NetServer::SendPacketToPlayer(players[0], STOC_DUEL_END);
-		NetServer::ReSendToPlayer(players[1]);
+		auto packet = NetServer::SendPacketToPlayer(players[0], STOC_DUEL_END);
+		NetServer::ReSendToPlayer(players[1], packet);
 		for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-			NetServer::ReSendToPlayer(*oit);
+			NetServer::ReSendToPlayer(*oit, packet);
 		duel_stage = DUEL_STAGE_END;
 	} else {
 		int winc[3] = {0, 0, 0};
@@ -521,10 +539,10 @@ void SingleDuel::DuelEndProc() {
 		        || (winc[0] == 2 || (winc[0] == 1 && winc[2] == 2))
 		        || (winc[1] == 2 || (winc[1] == 1 && winc[2] == 2))
 		        || (winc[2] == 3 || (winc[0] == 1 && winc[1] == 1 && winc[2] == 1)) ) {
-			NetServer::SendPacketToPlayer(players[0], STOC_DUEL_END);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendPacketToPlayer(players[0], STOC_DUEL_END);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			duel_stage = DUEL_STAGE_END;
 		} else {
 			if(players[0] != pplayer[0]) {
@@ -556,10 +574,10 @@ void SingleDuel::Surrender(DuelPlayer* dp) {
 	wbuf[0] = MSG_WIN;
 	wbuf[1] = 1 - player;
 	wbuf[2] = 0;
-	NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, wbuf, 3);
-	NetServer::ReSendToPlayer(players[1]);
+	auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, wbuf, 3);
+	NetServer::ReSendToPlayer(players[1], packet);
 	for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-		NetServer::ReSendToPlayer(*oit);
+		NetServer::ReSendToPlayer(*oit, packet);
 	if(players[player] == pplayer[player]) {
 		match_result[duel_count++] = 1 - player;
 		tp_player = player;
@@ -577,6 +595,9 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 	int player, count, type;
 	while (pbuf - msgbuffer < (int)len) {
 		offset = pbuf;
+		update_cache.CheckMessage(offset);
+		messages.fetch_add(1, std::memory_order_relaxed);
+		ServerStats::messages.fetch_add(1, std::memory_order_relaxed);
 		unsigned char engType = BufferIO::Read<uint8_t>(pbuf);
 		switch (engType) {
 		case MSG_RETRY: {
@@ -602,16 +623,16 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			case 8:
 			case 9:
 			case 11: {
-				NetServer::SendBufferToPlayer(players[1 - player], STOC_GAME_MSG, offset, pbuf - offset);
+				auto packet = NetServer::SendBufferToPlayer(players[1 - player], STOC_GAME_MSG, offset, pbuf - offset);
 				for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-					NetServer::ReSendToPlayer(*oit);
+					NetServer::ReSendToPlayer(*oit, packet);
 				break;
 			}
 			case 10: {
 				NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-				NetServer::SendBufferToPlayer(players[1], STOC_GAME_MSG, offset, pbuf - offset);
+				auto packet = NetServer::SendBufferToPlayer(players[1], STOC_GAME_MSG, offset, pbuf - offset);
 				for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-					NetServer::ReSendToPlayer(*oit);
+					NetServer::ReSendToPlayer(*oit, packet);
 				break;
 			}
 			}
@@ -620,10 +641,10 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 		case MSG_WIN: {
 			player = BufferIO::Read<uint8_t>(pbuf);
 			type = BufferIO::Read<uint8_t>(pbuf);
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			if(player > 1) {
 				match_result[duel_count++] = 2;
 				tp_player = 1 - tp_player;
@@ -802,20 +823,20 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			player = BufferIO::Read<uint8_t>(pbuf);
 			count = BufferIO::Read<uint8_t>(pbuf);
 			pbuf += count * 7;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_CONFIRM_EXTRATOP: {
 			player = BufferIO::Read<uint8_t>(pbuf);
 			count = BufferIO::Read<uint8_t>(pbuf);
 			pbuf += count * 7;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for (auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_CONFIRM_CARDS: {
@@ -824,10 +845,10 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			count = BufferIO::Read<uint8_t>(pbuf);
 			if(pbuf[5] != LOCATION_DECK) {
 				pbuf += count * 7;
-				NetServer::SendBufferToPlayer(players[player], STOC_GAME_MSG, offset, pbuf - offset);
-				NetServer::ReSendToPlayer(players[1 - player]);
+				auto packet = NetServer::SendBufferToPlayer(players[player], STOC_GAME_MSG, offset, pbuf - offset);
+				NetServer::ReSendToPlayer(players[1 - player], packet);
 				for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-					NetServer::ReSendToPlayer(*oit);
+					NetServer::ReSendToPlayer(*oit, packet);
 			} else {
 				pbuf += count * 7;
 				NetServer::SendBufferToPlayer(players[player], STOC_GAME_MSG, offset, pbuf - offset);
@@ -836,10 +857,10 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 		}
 		case MSG_SHUFFLE_DECK: {
 			player = BufferIO::Read<uint8_t>(pbuf);
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_SHUFFLE_HAND: {
@@ -848,9 +869,9 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			NetServer::SendBufferToPlayer(players[player], STOC_GAME_MSG, offset, (pbuf - offset) + count * 4);
 			for(int i = 0; i < count; ++i)
 				BufferIO::Write<int32_t>(pbuf, 0);
-			NetServer::SendBufferToPlayer(players[1 - player], STOC_GAME_MSG, offset, pbuf - offset);
+			auto packet = NetServer::SendBufferToPlayer(players[1 - player], STOC_GAME_MSG, offset, pbuf - offset);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshHand(player, 0x781fff, 0);
 			break;
 		}
@@ -860,52 +881,52 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			NetServer::SendBufferToPlayer(players[player], STOC_GAME_MSG, offset, (pbuf - offset) + count * 4);
 			for (int i = 0; i < count; ++i)
 				BufferIO::Write<int32_t>(pbuf, 0);
-			NetServer::SendBufferToPlayer(players[1 - player], STOC_GAME_MSG, offset, pbuf - offset);
+			auto packet = NetServer::SendBufferToPlayer(players[1 - player], STOC_GAME_MSG, offset, pbuf - offset);
 			for (auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshExtra(player);
 			break;
 		}
 		case MSG_REFRESH_DECK: {
 			pbuf++;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_SWAP_GRAVE_DECK: {
 			player = BufferIO::Read<uint8_t>(pbuf);
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshGrave(player);
 			break;
 		}
 		case MSG_REVERSE_DECK: {
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_DECK_TOP: {
 			pbuf += 6;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_SHUFFLE_SET_CARD: {
 			unsigned int loc = BufferIO::Read<uint8_t>(pbuf);
 			count = BufferIO::Read<uint8_t>(pbuf);
 			pbuf += count * 8;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			if(loc == LOCATION_MZONE) {
 				RefreshMzone(0, 0x181fff, 0);
 				RefreshMzone(1, 0x181fff, 0);
@@ -924,20 +945,21 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			RefreshHand(0);
 			RefreshHand(1);
 			pbuf++;
+			last_replay.MarkTurn();
 			time_limit[0] = host_info.time_limit;
 			time_limit[1] = host_info.time_limit;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_NEW_PHASE: {
 			pbuf += 2;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshMzone(0);
 			RefreshMzone(1);
 			RefreshSzone(0);
@@ -960,9 +982,9 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			NetServer::SendBufferToPlayer(players[cc], STOC_GAME_MSG, offset, pbuf - offset);
 			if (!(cl & (LOCATION_DROP + LOCATION_GENE)) && ((cl & (LOCATION_DECK + LOCATION_HAND)) || (cp & FACE_DOWN)))
 				BufferIO::Write<int32_t>(pbufw, 0);
-			NetServer::SendBufferToPlayer(players[1 - cc], STOC_GAME_MSG, offset, pbuf - offset);
+			auto packet = NetServer::SendBufferToPlayer(players[1 - cc], STOC_GAME_MSG, offset, pbuf - offset);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			if (cl != 0 && (cl & LOCATION_GENE) == 0 && (cl != pl || pc != cc))
 				RefreshSingle(cc, cl, cs);
 			break;
@@ -974,10 +996,10 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			int pp = pbuf[7];
 			int cp = pbuf[8];
 			pbuf += 9;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			if((pp & FACE_DOWN) && (cp & FACE_UP))
 				RefreshSingle(cc, cl, cs);
 			break;
@@ -985,10 +1007,10 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 		case MSG_SET: {
 			BufferIO::Write<int32_t>(pbuf, 0);
 			pbuf += 4;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_SWAP: {
@@ -999,35 +1021,35 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			int l2 = pbuf[13];
 			int s2 = pbuf[14];
 			pbuf += 16;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshSingle(c1, l1, s1);
 			RefreshSingle(c2, l2, s2);
 			break;
 		}
 		case MSG_FIELD_DISABLED: {
 			pbuf += 4;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_SUMMONING: {
 			pbuf += 8;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_SUMMONED: {
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshMzone(0);
 			RefreshMzone(1);
 			RefreshSzone(0);
@@ -1044,16 +1066,16 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			NetServer::SendBufferToPlayer(players[cc], STOC_GAME_MSG, offset, pbuf - offset);
 			if (cp & FACE_DOWN)
 				BufferIO::Write<int32_t>(pbufw, 0);
-			NetServer::SendBufferToPlayer(players[1 - cc], STOC_GAME_MSG, offset, pbuf - offset);
+			auto packet = NetServer::SendBufferToPlayer(players[1 - cc], STOC_GAME_MSG, offset, pbuf - offset);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_SPSUMMONED: {
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshMzone(0);
 			RefreshMzone(1);
 			RefreshSzone(0);
@@ -1063,17 +1085,17 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 		case MSG_FLIPSUMMONING: {
 			RefreshSingle(pbuf[4], pbuf[5], pbuf[6]);
 			pbuf += 8;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_FLIPSUMMONED: {
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshMzone(0);
 			RefreshMzone(1);
 			RefreshSzone(0);
@@ -1082,18 +1104,18 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 		}
 		case MSG_CHAINING: {
 			pbuf += 16;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_CHAINED: {
 			pbuf++;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshMzone(0);
 			RefreshMzone(1);
 			RefreshSzone(0);
@@ -1104,18 +1126,18 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 		}
 		case MSG_CHAIN_SOLVING: {
 			pbuf++;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_CHAIN_SOLVED: {
 			pbuf++;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshMzone(0);
 			RefreshMzone(1);
 			RefreshSzone(0);
@@ -1125,10 +1147,10 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			break;
 		}
 		case MSG_CHAIN_END: {
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshMzone(0);
 			RefreshMzone(1);
 			RefreshSzone(0);
@@ -1139,18 +1161,18 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 		}
 		case MSG_CHAIN_NEGATED: {
 			pbuf++;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_CHAIN_DISABLED: {
 			pbuf++;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_CARD_SELECTED: {
@@ -1163,19 +1185,19 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			player = BufferIO::Read<uint8_t>(pbuf);
 			count = BufferIO::Read<uint8_t>(pbuf);
 			pbuf += count * 4;
-			NetServer::SendBufferToPlayer(players[player], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[player], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_BECOME_TARGET: {
 			count = BufferIO::Read<uint8_t>(pbuf);
 			pbuf += count * 4;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_DRAW: {
@@ -1190,128 +1212,128 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 				else
 					pbufw += 4;
 			}
-			NetServer::SendBufferToPlayer(players[1 - player], STOC_GAME_MSG, offset, pbuf - offset);
+			auto packet = NetServer::SendBufferToPlayer(players[1 - player], STOC_GAME_MSG, offset, pbuf - offset);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_DAMAGE: {
 			pbuf += 5;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_RECOVER: {
 			pbuf += 5;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_EQUIP: {
 			pbuf += 8;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_LPUPDATE: {
 			pbuf += 5;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_UNEQUIP: {
 			pbuf += 4;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_CARD_TARGET: {
 			pbuf += 8;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_CANCEL_TARGET: {
 			pbuf += 8;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_PAY_LPCOST: {
 			pbuf += 5;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_ADD_COUNTER: {
 			pbuf += 7;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_REMOVE_COUNTER: {
 			pbuf += 7;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_ATTACK: {
 			pbuf += 8;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_BATTLE: {
 			pbuf += 26;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_ATTACK_DISABLED: {
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_DAMAGE_STEP_START: {
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshMzone(0);
 			RefreshMzone(1);
 			break;
 		}
 		case MSG_DAMAGE_STEP_END: {
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshMzone(0);
 			RefreshMzone(1);
 			break;
@@ -1326,20 +1348,20 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			player = BufferIO::Read<uint8_t>(pbuf);
 			count = BufferIO::Read<uint8_t>(pbuf);
 			pbuf += count;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_TOSS_DICE: {
 			player = BufferIO::Read<uint8_t>(pbuf);
 			count = BufferIO::Read<uint8_t>(pbuf);
 			pbuf += count;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_ROCK_PAPER_SCISSORS: {
@@ -1350,10 +1372,10 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 		}
 		case MSG_HAND_RES: {
 			pbuf += 1;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for (auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_ANNOUNCE_RACE: {
@@ -1381,28 +1403,28 @@ int SingleDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 		}
 		case MSG_CARD_HINT: {
 			pbuf += 9;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_PLAYER_HINT: {
 			pbuf += 6;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_MATCH_KILL: {
 			int code = BufferIO::Read<int32_t>(pbuf);
 			if(match_mode) {
 				match_kill = code;
-				NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-				NetServer::ReSendToPlayer(players[1]);
+				auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+				NetServer::ReSendToPlayer(players[1], packet);
 				for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-					NetServer::ReSendToPlayer(*oit);
+					NetServer::ReSendToPlayer(*oit, packet);
 			}
 			break;
 		}
@@ -1430,18 +1452,62 @@ void SingleDuel::GetResponse(DuelPlayer* dp, unsigned char* pdata, unsigned int
 void SingleDuel::EndDuel() {
 	if(!pduel)
 		return;
-	last_replay.EndRecord();
-	char replaybuf[0x2000], *pbuf = replaybuf;
-	std::memcpy(pbuf, &last_replay.pheader, sizeof last_replay.pheader);
-	pbuf += sizeof last_replay.pheader;
-	std::memcpy(pbuf, last_replay.comp_data, last_replay.comp_size);
-	NetServer::SendBufferToPlayer(players[0], STOC_REPLAY, replaybuf, sizeof last_replay.pheader + last_replay.comp_size);
-	NetServer::ReSendToPlayer(players[1]);
-	for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-		NetServer::ReSendToPlayer(*oit);
-	end_duel(pduel);
+	std::vector<DuelPlayer*> recipients{ players[0], players[1] };
+	recipients.insert(recipients.end(), observers.begin(), observers.end());
+	NetServer::SendReplay(this, last_replay, recipients);
+	myend_duel(pduel);
 	event_del(etimer);
 	pduel = 0;
+	update_cache.Clear();
+	field_snapshot.clear();
+}
+/*
+* Send the field to an observer joining during the duel, followed by the usual message stream.
+* The snapshot is built once and shared by every observer joining before the field changes.
+*/
+void SingleDuel::RequestField(DuelPlayer* dp) {
+	if(dp->type != NETPLAYER_TYPE_OBSERVER || !pduel)
+		return;
+	if(field_snapshot.empty()) {
+		// push pending changes first, the full queries below reset the query cache
+		observers.erase(dp);
+		for(int i = 0; i < 2; ++i) {
+			RefreshMzone(i);
+			RefreshSzone(i);
+			RefreshHand(i);
+			RefreshGrave(i);
+			RefreshExtra(i);
+		}
+		observers.insert(dp);
+		// the late observer never saw the records the refreshes compare against
+		update_cache.Clear();
+		unsigned char startbuf[32]{};
+		auto pbuf = startbuf;
+		BufferIO::Write<uint8_t>(pbuf, MSG_START);
+		BufferIO::Write<uint8_t>(pbuf, (players[0] == pplayer[0]) ? 0x10 : 0x11);
+		BufferIO::Write<uint8_t>(pbuf, host_info.duel_rule);
+		BufferIO::Write<int32_t>(pbuf, host_info.start_energy);
+		BufferIO::Write<int32_t>(pbuf, host_info.start_energy);
+		BufferIO::Write<uint16_t>(pbuf, query_field_count(pduel, 0, LOCATION_DECK));
+		BufferIO::Write<uint16_t>(pbuf, query_field_count(pduel, 0, LOCATION_ADECK));
+		BufferIO::Write<uint16_t>(pbuf, query_field_count(pduel, 1, LOCATION_DECK));
+		BufferIO::Write<uint16_t>(pbuf, query_field_count(pduel, 1, LOCATION_ADECK));
+		field_snapshot.push_back(NetServer::CreatePacket(STOC_DUEL_START));
+		field_snapshot.push_back(NetServer::CreatePacket(STOC_GAME_MSG, startbuf, 19));
+		std::vector<unsigned char> query_buffer(SIZE_QUERY_BUFFER);
+		int len = query_field_info(pduel, query_buffer.data());
+		field_snapshot.push_back(NetServer::CreatePacket(STOC_GAME_MSG, query_buffer.data(), len));
+		for(int i = 0; i < 2; ++i) {
+			field_snapshot.push_back(QueryObserverData(i, LOCATION_MZONE, 0xefffff));
+			field_snapshot.push_back(QueryObserverData(i, LOCATION_CALL, 0xefffff));
+			field_snapshot.push_back(QueryObserverData(i, LOCATION_HAND, 0x681fff));
+			field_snapshot.push_back(QueryObserverData(i, LOCATION_DROP, 0x81fff));
+			field_snapshot.push_back(QueryObserverData(i, LOCATION_VOID, 0x81fff));
+			field_snapshot.push_back(QueryObserverData(i, LOCATION_ADECK, 0xe81fff));
+		}
+	}
+	for(auto& packet : field_snapshot)
+		NetServer::ReSendToPlayer(dp, packet);
 }
 void SingleDuel::WaitforResponse(int playerid) {
 	last_response = playerid;
@@ -1471,15 +1537,26 @@ inline int SingleDuel::WriteUpdateData(int& player, int location, int& flag, uns
 	BufferIO::Write<uint8_t>(qbuf, MSG_UPDATE_DATA);
 	BufferIO::Write<uint8_t>(qbuf, player);
 	BufferIO::Write<uint8_t>(qbuf, location);
+	StatsTimer timer(ServerStats::query_field);
 	int len = query_field_card(pduel, player, location, flag, qbuf, use_cache);
 	return len;
 }
+NetPacket SingleDuel::QueryObserverData(int player, int location, int flag) {
+	std::vector<unsigned char> query_buffer;
+	query_buffer.resize(SIZE_QUERY_BUFFER);
+	auto qbuf = query_buffer.data();
+	int use_cache = 0;
+	auto len = WriteUpdateData(player, location, flag, qbuf, use_cache);
+	if(location != LOCATION_DROP)
+		HideQueryData(qbuf, len, location == LOCATION_HAND || location == LOCATION_ADECK);
+	return NetServer::CreatePacket(STOC_GAME_MSG, query_buffer.data(), len + 3);
+}
 void SingleDuel::RefreshMzone(int player, int flag, int use_cache) {
 	std::vector<unsigned char> query_buffer;
 	query_buffer.resize(SIZE_QUERY_BUFFER);
 	auto qbuf = query_buffer.data();
 	auto len = WriteUpdateData(player, LOCATION_MZONE, flag, qbuf, use_cache);
-	NetServer::SendBufferToPlayer(players[player], STOC_GAME_MSG, query_buffer.data(), len + 3);
+	update_cache.CreatePacket(UpdateCache::VIEW_OWNER, query_buffer.data(), len + 3).SendTo(players[player]);
 	int qlen = 0;
 	while(qlen < len) {
 		const int clen = BufferIO::Read<int32_t>(qbuf);
@@ -1491,16 +1568,17 @@ void SingleDuel::RefreshMzone(int player, int flag, int use_cache) {
 			std::memset(qbuf, 0, clen - 4);
 		qbuf += clen - 4;
 	}
-	NetServer::SendBufferToPlayer(players[1 - player], STOC_GAME_MSG, query_buffer.data(), len + 3);
+	auto packet = update_cache.CreatePacket(UpdateCache::VIEW_PUBLIC, query_buffer.data(), len + 3);
+	packet.SendTo(players[1 - player]);
 	for(auto pit = observers.begin(); pit != observers.end(); ++pit)
-		NetServer::ReSendToPlayer(*pit);
+		packet.SendTo(*pit);
 }
 void SingleDuel::RefreshSzone(int player, int flag, int use_cache) {
 	std::vector<unsigned char> query_buffer;
 	query_buffer.resize(SIZE_QUERY_BUFFER);
 	auto qbuf = query_buffer.data();
 	auto len = WriteUpdateData(player, LOCATION_CALL, flag, qbuf, use_cache);
-	NetServer::SendBufferToPlayer(players[player], STOC_GAME_MSG, query_buffer.data(), len + 3);
+	update_cache.CreatePacket(UpdateCache::VIEW_OWNER, query_buffer.data(), len + 3).SendTo(players[player]);
 	int qlen = 0;
 	while(qlen < len) {
 		const int clen = BufferIO::Read<int32_t>(qbuf);
@@ -1512,16 +1590,17 @@ void SingleDuel::RefreshSzone(int player, int flag, int use_cache) {
 			std::memset(qbuf, 0, clen - 4);
 		qbuf += clen - 4;
 	}
-	NetServer::SendBufferToPlayer(players[1 - player], STOC_GAME_MSG, query_buffer.data(), len + 3);
+	auto packet = update_cache.CreatePacket(UpdateCache::VIEW_PUBLIC, query_buffer.data(), len + 3);
+	packet.SendTo(players[1 - player]);
 	for(auto pit = observers.begin(); pit != observers.end(); ++pit)
-		NetServer::ReSendToPlayer(*pit);
+		packet.SendTo(*pit);
 }
 void SingleDuel::RefreshHand(int player, int flag, int use_cache) {
 	std::vector<unsigned char> query_buffer;
 	query_buffer.resize(SIZE_QUERY_BUFFER);
 	auto qbuf = query_buffer.data();
 	auto len = WriteUpdateData(player, LOCATION_HAND, flag, qbuf, use_cache);
-	NetServer::SendBufferToPlayer(players[player], STOC_GAME_MSG, query_buffer.data(), len + 3);
+	update_cache.CreatePacket(UpdateCache::VIEW_OWNER, query_buffer.data(), len + 3).SendTo(players[player]);
 	int qlen = 0;
 	while(qlen < len) {
 		const int slen = BufferIO::Read<int32_t>(qbuf);
@@ -1533,28 +1612,31 @@ void SingleDuel::RefreshHand(int player, int flag, int use_cache) {
 			std::memset(qbuf, 0, slen - 4);
 		qbuf += slen - 4;
 	}
-	NetServer::SendBufferToPlayer(players[1 - player], STOC_GAME_MSG, query_buffer.data(), len + 3);
+	auto packet = update_cache.CreatePacket(UpdateCache::VIEW_PUBLIC, query_buffer.data(), len + 3);
+	packet.SendTo(players[1 - player]);
 	for(auto pit = observers.begin(); pit != observers.end(); ++pit)
-		NetServer::ReSendToPlayer(*pit);
+		packet.SendTo(*pit);
 }
 void SingleDuel::RefreshGrave(int player, int flag, int use_cache) {
 	std::vector<unsigned char> query_buffer;
 	query_buffer.resize(SIZE_QUERY_BUFFER);
 	auto qbuf = query_buffer.data();
 	auto len = WriteUpdateData(player, LOCATION_DROP, flag, qbuf, use_cache);
-	NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, query_buffer.data(), len + 3);
-	NetServer::ReSendToPlayer(players[1]);
+	auto packet = update_cache.CreatePacket(UpdateCache::VIEW_PUBLIC, query_buffer.data(), len + 3);
+	packet.SendTo(players[0]);
+	packet.SendTo(players[1]);
 	for(auto pit = observers.begin(); pit != observers.end(); ++pit)
-		NetServer::ReSendToPlayer(*pit);
+		packet.SendTo(*pit);
 }
 void SingleDuel::RefreshExtra(int player, int flag, int use_cache) {
 	std::vector<unsigned char> query_buffer;
 	query_buffer.resize(SIZE_QUERY_BUFFER);
 	auto qbuf = query_buffer.data();
 	auto len = WriteUpdateData(player, LOCATION_ADECK, flag, qbuf, use_cache);
-	NetServer::SendBufferToPlayer(players[player], STOC_GAME_MSG, query_buffer.data(), len + 3);
+	update_cache.CreatePacket(UpdateCache::VIEW_OWNER, query_buffer.data(), len + 3).SendTo(players[player]);
 }
 void SingleDuel::RefreshSingle(int player, int location, int sequence, int flag) {
+	update_cache.Invalidate(player, location);
 	flag |= (QUERY_CODE | QUERY_POSITION);
 	unsigned char query_buffer[0x1000];
 	auto qbuf = query_buffer;
@@ -1573,9 +1655,9 @@ void SingleDuel::RefreshSingle(int player, int location, int sequence, int flag)
 		BufferIO::Write<int32_t>(qbuf, 0);
 		std::memset(qbuf, 0, clen - 12);
 	}
-	NetServer::SendBufferToPlayer(players[1 - player], STOC_GAME_MSG, query_buffer, len + 4);
+	auto packet = NetServer::SendBufferToPlayer(players[1 - player], STOC_GAME_MSG, query_buffer, len + 4);
 	for (auto pit = observers.begin(); pit != observers.end(); ++pit)
-		NetServer::ReSendToPlayer(*pit);
+		NetServer::ReSendToPlayer(*pit, packet);
 }
 uint32_t SingleDuel::MessageHandler(intptr_t fduel, uint32_t type) {
 	if(!enable_log)
@@ -1594,10 +1676,10 @@ void SingleDuel::SingleTimer(evutil_socket_t fd, short events, void* arg) {
 		wbuf[0] = MSG_WIN;
 		wbuf[1] = 1 - player;
 		wbuf[2] = 0x3;
-		NetServer::SendBufferToPlayer(sd->players[0], STOC_GAME_MSG, wbuf, 3);
-		NetServer::ReSendToPlayer(sd->players[1]);
+		auto packet = NetServer::SendBufferToPlayer(sd->players[0], STOC_GAME_MSG, wbuf, 3);
+		NetServer::ReSendToPlayer(sd->players[1], packet);
 		for(auto oit = sd->observers.begin(); oit != sd->observers.end(); ++oit)
-			NetServer::ReSendToPlayer(*oit);
+			NetServer::ReSendToPlayer(*oit, packet);
 		if(sd->players[player] == sd->pplayer[player]) {
 			sd->match_result[sd->duel_count++] = 1 - player;
 			sd->tp_player = player;
@@ -3,8 +3,10 @@
 
 #include <set>
 #include "network.h"
+#include "netserver.h"
 #include "deck_manager.h"
 #include "replay.h"
+#include "update_cache.h"
 
 namespace ygo {
 
@@ -29,6 +31,7 @@ public:
 	void GetResponse(DuelPlayer* dp, unsigned char* pdata, unsigned int len) override;
 	void TimeConfirm(DuelPlayer* dp) override;
 	void EndDuel() override;
+	void RequestField(DuelPlayer* dp) override;
 	
 	void DuelEndProc();
 	void WaitforResponse(int playerid);
@@ -44,6 +47,7 @@ public:
 
 private:
 	int WriteUpdateData(int& player, int location, int& flag, unsigned char*& qbuf, int& use_cache);
+	NetPacket QueryObserverData(int player, int location, int flag);
 	
 protected:
 	DuelPlayer* players[2]{};
@@ -62,6 +66,9 @@ protected:
 	unsigned char match_result[3]{};
 	short time_limit[2]{};
 	short time_elapsed{ 0 };
+	// packets bringing a late observer up to date, valid until the field changes
+	std::vector<NetPacket> field_snapshot;
+	UpdateCache update_cache;
 };
 
 }
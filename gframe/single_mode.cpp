@@ -51,7 +51,7 @@ int SingleMode::SinglePlayThread() {
 	set_script_reader(DataManager::ScriptReaderEx);
 	set_card_reader(DataManager::CardReader);
 	set_message_handler(SingleMode::MessageHandler);
-	pduel = create_duel_v2(duel_seed);
+	pduel = mycreate_duel_v2(duel_seed);
 	set_player_info(pduel, 0, start_lp, start_hand, draw_count);
 	set_player_info(pduel, 1, start_lp, start_hand, draw_count);
 	mainGame->dInfo.lp[0] = start_lp;
@@ -86,7 +86,7 @@ int SingleMode::SinglePlayThread() {
 			slen = 0;
 	}
 	if(slen == 0) {
-		end_duel(pduel);
+		myend_duel(pduel);
 		return 0;
 	}
 	mainGame->gMutex.lock();
@@ -125,6 +125,7 @@ int SingleMode::SinglePlayThread() {
 	last_replay.WriteInt32(opt, false);
 	last_replay.Write<uint16_t>(slen, false);
 	last_replay.WriteData(filename, slen, false);
+	last_replay.EndInfo();
 	last_replay.Flush();
 	start_duel(pduel, opt);
 	while (is_continuing) {
@@ -160,7 +161,7 @@ int SingleMode::SinglePlayThread() {
 	}
 	if(mainGame->actionParam)
 		last_replay.SaveReplay(mainGame->ebRSName->getText());
-	end_duel(pduel);
+	myend_duel(pduel);
 	if(!is_closing) {
 		mainGame->gMutex.lock();
 		mainGame->dInfo.isStarted = false;
@@ -435,6 +436,7 @@ bool SingleMode::SinglePlayAnalyze(unsigned char* msg, unsigned int len) {
 		}
 		case MSG_NEW_TURN: {
 			player = BufferIO::Read<uint8_t>(pbuf);
+			last_replay.MarkTurn();
 			DuelClient::ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
@@ -0,0 +1,54 @@
+#ifndef STRING_ARENA_H
+#define STRING_ARENA_H
+
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "bufferio.h"
+
+namespace ygo {
+
+/*
+* Null-terminated strings kept in large blocks instead of one allocation each.
+* A block is never moved, so the returned pointers stay valid as long as the arena.
+*/
+class StringArena {
+public:
+	static constexpr size_t BLOCK_SIZE = 0x10000;	// in wchar_t
+
+	const wchar_t* Add(const wchar_t* str) {
+		size_t len = std::wcslen(str);
+		wchar_t* dst = Reserve(len + 1);
+		std::wmemcpy(dst, str, len + 1);
+		used += len + 1;
+		return dst;
+	}
+	// Decodes a UTF-8 string in place, it has at most one wchar_t per byte.
+	const wchar_t* AddUTF8(const char* str) {
+		if (!str || !str[0])
+			return L"";
+		size_t len = std::strlen(str);
+		wchar_t* dst = Reserve(len + 1);
+		int count = BufferIO::DecodeUTF8String(str, dst, len + 1);
+		used += count + 1;
+		return dst;
+	}
+
+private:
+	wchar_t* Reserve(size_t len) {
+		if (blocks.empty() || capacity - used < len) {
+			capacity = len > BLOCK_SIZE ? len : BLOCK_SIZE;
+			blocks.emplace_back(new wchar_t[capacity]);
+			used = 0;
+		}
+		return blocks.back().get() + used;
+	}
+
+	std::vector<std::unique_ptr<wchar_t[]>> blocks;
+	size_t used{};
+	size_t capacity{};
+};
+
+}
+
+#endif //STRING_ARENA_H
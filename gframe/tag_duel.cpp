@@ -21,10 +21,11 @@ void TagDuel::Chat(DuelPlayer* dp, unsigned char* pdata, int len) {
 	const auto scc_size = NetServer::CreateChatPacket(pdata, len, scc, dp->type);
 	if (!scc_size)
 		return;
+	auto packet = NetServer::CreatePacket(STOC_CHAT, scc, scc_size);
 	for(int i = 0; i < 4; ++i)
-		NetServer::SendBufferToPlayer(players[i], STOC_CHAT, scc, scc_size);
+		NetServer::ReSendToPlayer(players[i], packet);
 	for(auto pit = observers.begin(); pit != observers.end(); ++pit)
-		NetServer::ReSendToPlayer(*pit);
+		NetServer::ReSendToPlayer(*pit, packet);
 }
 void TagDuel::JoinGame(DuelPlayer* dp, unsigned char* pdata, bool is_creater) {
 	if(!is_creater) {
@@ -115,11 +116,18 @@ void TagDuel::JoinGame(DuelPlayer* dp, unsigned char* pdata, bool is_creater) {
 		scwc.watch_count = (unsigned short)observers.size();
 		NetServer::SendPacketToPlayer(dp, STOC_HS_WATCH_CHANGE, scwc);
 	}
+	if(dp->type == NETPLAYER_TYPE_OBSERVER && duel_stage == DUEL_STAGE_DUELING) {
+		RequestField(dp);
+		dp->state = CTOS_LEAVE_GAME;
+	} else if(dp->type == NETPLAYER_TYPE_OBSERVER && duel_stage != DUEL_STAGE_BEGIN && duel_stage != DUEL_STAGE_END) {
+		// the duel has not started yet, the observer gets it from MSG_START like the others
+		NetServer::SendPacketToPlayer(dp, STOC_DUEL_START);
+		dp->state = CTOS_LEAVE_GAME;
+	}
 }
 void TagDuel::LeaveGame(DuelPlayer* dp) {
 	if(dp == host_player) {
-		EndDuel();
-		NetServer::StopServer();
+		NetServer::CloseRoom(this);
 	} else if(dp->type == NETPLAYER_TYPE_OBSERVER) {
 		observers.erase(dp);
 		if(duel_stage == DUEL_STAGE_BEGIN) {
@@ -287,11 +295,12 @@ void TagDuel::StartDuel(DuelPlayer* dp) {
 		return;
 	NetServer::StopListen();
 	//NetServer::StopBroadcast();
+	auto packet = NetServer::CreatePacket(STOC_DUEL_START);
 	for(int i = 0; i < 4; ++i)
-		NetServer::SendPacketToPlayer(players[i], STOC_DUEL_START);
+		NetServer::ReSendToPlayer(players[i], packet);
 	for(auto oit = observers.begin(); oit != observers.end(); ++oit) {
 		(*oit)->state = CTOS_LEAVE_GAME;
-		NetServer::ReSendToPlayer(*oit);
+		NetServer::ReSendToPlayer(*oit, packet);
 	}
 	unsigned char deckbuff[12];
 	auto pbuf = deckbuff;
@@ -301,16 +310,16 @@ void TagDuel::StartDuel(DuelPlayer* dp) {
 	BufferIO::Write<uint16_t>(pbuf, (uint16_t)pdeck[2].main.size());
 	BufferIO::Write<uint16_t>(pbuf, (uint16_t)pdeck[2].area.size());
 	BufferIO::Write<uint16_t>(pbuf, (uint16_t)pdeck[2].side.size());
-	NetServer::SendBufferToPlayer(players[0], STOC_DECK_COUNT, deckbuff, 12);
-	NetServer::ReSendToPlayer(players[1]);
+	packet = NetServer::SendBufferToPlayer(players[0], STOC_DECK_COUNT, deckbuff, 12);
+	NetServer::ReSendToPlayer(players[1], packet);
 	char tempbuff[6];
 	std::memcpy(tempbuff, deckbuff, 6);
 	std::memcpy(deckbuff, deckbuff + 6, 6);
 	std::memcpy(deckbuff + 6, tempbuff, 6);
-	NetServer::SendBufferToPlayer(players[2], STOC_DECK_COUNT, deckbuff, 12);
-	NetServer::ReSendToPlayer(players[3]);
-	NetServer::SendPacketToPlayer(players[0], STOC_SELECT_HAND);
-	NetServer::ReSendToPlayer(players[2]);
+	packet = NetServer::SendBufferToPlayer(players[2], STOC_DECK_COUNT, deckbuff, 12);
+	NetServer::ReSendToPlayer(players[3], packet);
+	packet = NetServer::SendPacketToPlayer(players[0], STOC_SELECT_HAND);
+	NetServer::ReSendToPlayer(players[2], packet);
 	hand_result[0] = 0;
 	hand_result[1] = 0;
 	players[0]->state = CTOS_HAND_RESULT;
@@ -328,17 +337,17 @@ void TagDuel::HandResult(DuelPlayer* dp, unsigned char res) {
 		STOC_HandResult schr;
 		schr.res1 = hand_result[0];
 		schr.res2 = hand_result[1];
-		NetServer::SendPacketToPlayer(players[0], STOC_HAND_RESULT, schr);
-		NetServer::ReSendToPlayer(players[1]);
+		auto packet = NetServer::SendPacketToPlayer(players[0], STOC_HAND_RESULT, schr);
+		NetServer::ReSendToPlayer(players[1], packet);
 		for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-			NetServer::ReSendToPlayer(*oit);
+			NetServer::ReSendToPlayer(*oit, packet);
 		schr.res1 = hand_result[1];
 		schr.res2 = hand_result[0];
-		NetServer::SendPacketToPlayer(players[2], STOC_HAND_RESULT, schr);
-		NetServer::ReSendToPlayer(players[3]);
+		packet = NetServer::SendPacketToPlayer(players[2], STOC_HAND_RESULT, schr);
+		NetServer::ReSendToPlayer(players[3], packet);
 		if(hand_result[0] == hand_result[1]) {
-			NetServer::SendPacketToPlayer(players[0], STOC_SELECT_HAND);
-			NetServer::ReSendToPlayer(players[2]);
+			packet = NetServer::SendPacketToPlayer(players[0], STOC_SELECT_HAND);
+			NetServer::ReSendToPlayer(players[2], packet);
 			hand_result[0] = 0;
 			hand_result[1] = 0;
 			players[0]->state = CTOS_HAND_RESULT;
@@ -391,7 +400,7 @@ void TagDuel::TPResult(DuelPlayer* dp, unsigned char tp) {
 	for (auto& x : rh.seed_sequence)
 		x = rd();
 	mtrandom rnd(rh.seed_sequence, SEED_COUNT);
-	last_replay.BeginRecord();
+	last_replay.BeginRecord(!NetServer::IsMultiRoom());
 	last_replay.WriteHeader(rh);
 	last_replay.WriteData(players[0]->name, 40, false);
 	last_replay.WriteData(players[1]->name, 40, false);
@@ -408,7 +417,7 @@ void TagDuel::TPResult(DuelPlayer* dp, unsigned char tp) {
 	set_script_reader(DataManager::ScriptReaderEx);
 	set_card_reader(DataManager::CardReader);
 	set_message_handler(TagDuel::MessageHandler);
-	pduel = create_duel_v2(rh.seed_sequence);
+	pduel = mycreate_duel_v2(rh.seed_sequence);
 	set_player_info(pduel, 0, host_info.start_energy, host_info.start_hand, host_info.draw_count);
 	set_player_info(pduel, 1, host_info.start_energy, host_info.start_hand, host_info.draw_count);
 	unsigned int opt = (unsigned int)host_info.duel_rule << 16;
@@ -423,15 +432,15 @@ void TagDuel::TPResult(DuelPlayer* dp, unsigned char tp) {
 	auto load_single = [&](const std::vector<code_pointer>& deck_container, uint8_t p, uint8_t location) {
 		last_replay.WriteInt32(deck_container.size(), false);
 		for (auto cit = deck_container.rbegin(); cit != deck_container.rend(); ++cit) {
-			new_card(pduel, (*cit)->first, p, p, location, 0, POS_FACEDOWN_DEFENSE);
-			last_replay.WriteInt32((*cit)->first, false);
+			new_card(pduel, (*cit)->code, p, p, location, 0, POS_FACEDOWN_DEFENSE);
+			last_replay.WriteInt32((*cit)->code, false);
 		}
 	};
 	auto load_tag = [&](const std::vector<code_pointer>& deck_container, uint8_t p, uint8_t location) {
 		last_replay.WriteInt32(deck_container.size(), false);
 		for (auto cit = deck_container.rbegin(); cit != deck_container.rend(); ++cit) {
-			new_tag_card(pduel, (*cit)->first, p, location);
-			last_replay.WriteInt32((*cit)->first, false);
+			new_tag_card(pduel, (*cit)->code, p, location);
+			last_replay.WriteInt32((*cit)->code, false);
 		}
 	};
 	load_single(pdeck[0].main, 0, LOCATION_DECK);
@@ -442,6 +451,7 @@ void TagDuel::TPResult(DuelPlayer* dp, unsigned char tp) {
 	load_single(pdeck[3].area, 1, LOCATION_ADECK);
 	load_tag(pdeck[2].main, 1, LOCATION_DECK);
 	load_tag(pdeck[2].area, 1, LOCATION_ADECK);
+	last_replay.EndInfo();
 	last_replay.Flush();
 	unsigned char startbuf[32]{};
 	auto pbuf = startbuf;
@@ -454,11 +464,11 @@ void TagDuel::TPResult(DuelPlayer* dp, unsigned char tp) {
 	BufferIO::Write<uint16_t>(pbuf, query_field_count(pduel, 0, LOCATION_ADECK));
 	BufferIO::Write<uint16_t>(pbuf, query_field_count(pduel, 1, LOCATION_DECK));
 	BufferIO::Write<uint16_t>(pbuf, query_field_count(pduel, 1, LOCATION_ADECK));
-	NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, startbuf, 19);
-	NetServer::ReSendToPlayer(players[1]);
+	auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, startbuf, 19);
+	NetServer::ReSendToPlayer(players[1], packet);
 	startbuf[1] = 1;
-	NetServer::SendBufferToPlayer(players[2], STOC_GAME_MSG, startbuf, 19);
-	NetServer::ReSendToPlayer(players[3]);
+	packet = NetServer::SendBufferToPlayer(players[2], STOC_GAME_MSG, startbuf, 19);
+	NetServer::ReSendToPlayer(players[3], packet);
 	if(!swapped)
 		startbuf[1] = 0x10;
 	else startbuf[1] = 0x11;
@@ -475,6 +485,8 @@ void TagDuel::TPResult(DuelPlayer* dp, unsigned char tp) {
 	Process();
 }
 void TagDuel::Process() {
+	field_snapshot.clear();
+	NetServer::BeginBatch();
 	std::vector<unsigned char> engineBuffer;
 	engineBuffer.reserve(SIZE_MESSAGE_BUFFER);
 	unsigned int engFlag = 0;
@@ -483,26 +495,32 @@ void TagDuel::Process() {
 	while (!stop) {
 		if (engFlag == PROCESSOR_END)
 			break;
-		unsigned int result = process(pduel);
+		unsigned int result;
+		{
+			StatsTimer timer(ServerStats::engine_step);
+			result = process(pduel);
+		}
 		engLen = result & PROCESSOR_BUFFER_LEN;
 		engFlag = result & PROCESSOR_FLAG;
 		if (engLen > 0) {
 			if (engLen > (int)engineBuffer.size())
 				engineBuffer.resize(engLen);
 			get_message(pduel, engineBuffer.data());
+			StatsTimer timer(ServerStats::analyze);
 			stop = Analyze(engineBuffer.data(), engLen);
 		}
 	}
 	if(stop == 2)
 		DuelEndProc();
+	NetServer::EndBatch();
 }
 void TagDuel::DuelEndProc() {
-	NetServer::SendPacketToPlayer(players[0], STOC_DUEL_END);
-	NetServer::ReSendToPlayer(players[1]);
-	NetServer::ReSendToPlayer(players[2]);
-	NetServer::ReSendToPlayer(players[3]);
+	auto packet = NetServer::SendPacketToPlayer(players[0], STOC_DUEL_END);
+	NetServer::ReSendToPlayer(players[1], packet);
+	NetServer::ReSendToPlayer(players[2], packet);
+	NetServer::ReSendToPlayer(players[3], packet);
 	for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-		NetServer::ReSendToPlayer(*oit);
+		NetServer::ReSendToPlayer(*oit, packet);
 	duel_stage = DUEL_STAGE_END;
 }
 void TagDuel::Surrender(DuelPlayer* dp) {
@@ -524,12 +542,12 @@ void TagDuel::Surrender(DuelPlayer* dp) {
 	wbuf[0] = MSG_WIN;
 	wbuf[1] = winplayermap[player];
 	wbuf[2] = 0;
-	NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, wbuf, 3);
-	NetServer::ReSendToPlayer(players[1]);
-	NetServer::ReSendToPlayer(players[2]);
-	NetServer::ReSendToPlayer(players[3]);
+	auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, wbuf, 3);
+	NetServer::ReSendToPlayer(players[1], packet);
+	NetServer::ReSendToPlayer(players[2], packet);
+	NetServer::ReSendToPlayer(players[3], packet);
 	for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-		NetServer::ReSendToPlayer(*oit);
+		NetServer::ReSendToPlayer(*oit, packet);
 	EndDuel();
 	DuelEndProc();
 	event_del(etimer);
@@ -539,6 +557,9 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 	int player, count, type;
 	while (pbuf - msgbuffer < (int)len) {
 		offset = pbuf;
+		update_cache.CheckMessage(offset);
+		messages.fetch_add(1, std::memory_order_relaxed);
+		ServerStats::messages.fetch_add(1, std::memory_order_relaxed);
 		unsigned char engType = BufferIO::Read<uint8_t>(pbuf);
 		switch (engType) {
 		case MSG_RETRY: {
@@ -564,18 +585,20 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			case 8:
 			case 9:
 			case 11: {
+				auto packet = NetServer::CreatePacket(STOC_GAME_MSG, offset, pbuf - offset);
 				for(int i = 0; i < 4; ++i)
 					if(players[i] != cur_player[player])
-						NetServer::SendBufferToPlayer(players[i], STOC_GAME_MSG, offset, pbuf - offset);
+						NetServer::ReSendToPlayer(players[i], packet);
 				for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-					NetServer::ReSendToPlayer(*oit);
+					NetServer::ReSendToPlayer(*oit, packet);
 				break;
 			}
 			case 10: {
+				auto packet = NetServer::CreatePacket(STOC_GAME_MSG, offset, pbuf - offset);
 				for(int i = 0; i < 4; ++i)
-					NetServer::SendBufferToPlayer(players[i], STOC_GAME_MSG, offset, pbuf - offset);
+					NetServer::ReSendToPlayer(players[i], packet);
 				for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-					NetServer::ReSendToPlayer(*oit);
+					NetServer::ReSendToPlayer(*oit, packet);
 				break;
 			}
 			}
@@ -584,12 +607,12 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 		case MSG_WIN: {
 			player = BufferIO::Read<uint8_t>(pbuf);
 			type = BufferIO::Read<uint8_t>(pbuf);
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			EndDuel();
 			return 2;
 		}
@@ -758,24 +781,24 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			player = BufferIO::Read<uint8_t>(pbuf);
 			count = BufferIO::Read<uint8_t>(pbuf);
 			pbuf += count * 7;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_CONFIRM_EXTRATOP: {
 			player = BufferIO::Read<uint8_t>(pbuf);
 			count = BufferIO::Read<uint8_t>(pbuf);
 			pbuf += count * 7;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for (auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_CONFIRM_CARDS: {
@@ -784,12 +807,12 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			count = BufferIO::Read<uint8_t>(pbuf);
 			if(pbuf[5] != LOCATION_DECK) {
 				pbuf += count * 7;
-				NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-				NetServer::ReSendToPlayer(players[1]);
-				NetServer::ReSendToPlayer(players[2]);
-				NetServer::ReSendToPlayer(players[3]);
+				auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+				NetServer::ReSendToPlayer(players[1], packet);
+				NetServer::ReSendToPlayer(players[2], packet);
+				NetServer::ReSendToPlayer(players[3], packet);
 				for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-					NetServer::ReSendToPlayer(*oit);
+					NetServer::ReSendToPlayer(*oit, packet);
 			} else {
 				pbuf += count * 7;
 				NetServer::SendBufferToPlayer(cur_player[player], STOC_GAME_MSG, offset, pbuf - offset);
@@ -798,12 +821,12 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 		}
 		case MSG_SHUFFLE_DECK: {
 			player = BufferIO::Read<uint8_t>(pbuf);
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_SHUFFLE_HAND: {
@@ -812,11 +835,12 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			NetServer::SendBufferToPlayer(cur_player[player], STOC_GAME_MSG, offset, (pbuf - offset) + count * 4);
 			for(int i = 0; i < count; ++i)
 				BufferIO::Write<int32_t>(pbuf, 0);
+			auto packet = NetServer::CreatePacket(STOC_GAME_MSG, offset, pbuf - offset);
 			for(int i = 0; i < 4; ++i)
 				if(players[i] != cur_player[player])
-					NetServer::SendBufferToPlayer(players[i], STOC_GAME_MSG, offset, pbuf - offset);
+					NetServer::ReSendToPlayer(players[i], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshHand(player, 0x781fff, 0);
 			break;
 		}
@@ -826,64 +850,65 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			NetServer::SendBufferToPlayer(cur_player[player], STOC_GAME_MSG, offset, (pbuf - offset) + count * 4);
 			for(int i = 0; i < count; ++i)
 				BufferIO::Write<int32_t>(pbuf, 0);
+			auto packet = NetServer::CreatePacket(STOC_GAME_MSG, offset, pbuf - offset);
 			for(int i = 0; i < 4; ++i)
 				if(players[i] != cur_player[player])
-					NetServer::SendBufferToPlayer(players[i], STOC_GAME_MSG, offset, pbuf - offset);
+					NetServer::ReSendToPlayer(players[i], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshExtra(player);
 			break;
 		}
 		case MSG_REFRESH_DECK: {
 			pbuf++;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_SWAP_GRAVE_DECK: {
 			player = BufferIO::Read<uint8_t>(pbuf);
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshGrave(player);
 			break;
 		}
 		case MSG_REVERSE_DECK: {
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_DECK_TOP: {
 			pbuf += 6;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_SHUFFLE_SET_CARD: {
 			unsigned int loc = BufferIO::Read<uint8_t>(pbuf);
 			count = BufferIO::Read<uint8_t>(pbuf);
 			pbuf += count * 8;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			if(loc == LOCATION_MZONE) {
 				RefreshMzone(0, 0x181fff, 0);
 				RefreshMzone(1, 0x181fff, 0);
@@ -895,14 +920,15 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 		}
 		case MSG_NEW_TURN: {
 			pbuf++;
+			last_replay.MarkTurn();
 			time_limit[0] = host_info.time_limit;
 			time_limit[1] = host_info.time_limit;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			if(turn_count > 0) {
 				if(turn_count % 2 == 0) {
 					if(cur_player[0] == players[0])
@@ -924,12 +950,12 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 		}
 		case MSG_NEW_PHASE: {
 			pbuf += 2;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshMzone(0);
 			RefreshMzone(1);
 			RefreshSzone(0);
@@ -952,11 +978,12 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			NetServer::SendBufferToPlayer(cur_player[cc], STOC_GAME_MSG, offset, pbuf - offset);
 			if (!(cl & (LOCATION_DROP + LOCATION_GENE)) && ((cl & (LOCATION_DECK + LOCATION_HAND)) || (cp & FACE_DOWN)))
 				BufferIO::Write<int32_t>(pbufw, 0);
+			auto packet = NetServer::CreatePacket(STOC_GAME_MSG, offset, pbuf - offset);
 			for(int i = 0; i < 4; ++i)
 				if(players[i] != cur_player[cc])
-					NetServer::SendBufferToPlayer(players[i], STOC_GAME_MSG, offset, pbuf - offset);
+					NetServer::ReSendToPlayer(players[i], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			if (cl != 0 && (cl & LOCATION_GENE) == 0 && (cl != pl || pc != cc))
 				RefreshSingle(cc, cl, cs);
 			break;
@@ -968,12 +995,12 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			int pp = pbuf[7];
 			int cp = pbuf[8];
 			pbuf += 9;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			if((pp & FACE_DOWN) && (cp & FACE_UP))
 				RefreshSingle(cc, cl, cs);
 			break;
@@ -981,12 +1008,12 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 		case MSG_SET: {
 			BufferIO::Write<int32_t>(pbuf, 0);
 			pbuf += 4;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_SWAP: {
@@ -997,43 +1024,43 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			int l2 = pbuf[13];
 			int s2 = pbuf[14];
 			pbuf += 16;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshSingle(c1, l1, s1);
 			RefreshSingle(c2, l2, s2);
 			break;
 		}
 		case MSG_FIELD_DISABLED: {
 			pbuf += 4;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_SUMMONING: {
 			pbuf += 8;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_SUMMONED: {
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshMzone(0);
 			RefreshMzone(1);
 			RefreshSzone(0);
@@ -1048,24 +1075,24 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			int cp = pbuf[7];
 			pbuf += 8;
 			auto pid = (cc == 0) ? 0 : 2;
-			NetServer::SendBufferToPlayer(players[pid], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[pid + 1]);
+			auto packet = NetServer::SendBufferToPlayer(players[pid], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[pid + 1], packet);
 			if (cp & FACE_DOWN)
 				BufferIO::Write<int32_t>(pbufw, 0);
 			pid = 2 - pid;
-			NetServer::SendBufferToPlayer(players[pid], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[pid + 1]);
+			packet = NetServer::SendBufferToPlayer(players[pid], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[pid + 1], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_SPSUMMONED: {
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshMzone(0);
 			RefreshMzone(1);
 			RefreshSzone(0);
@@ -1075,21 +1102,21 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 		case MSG_FLIPSUMMONING: {
 			RefreshSingle(pbuf[4], pbuf[5], pbuf[6]);
 			pbuf += 8;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_FLIPSUMMONED: {
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshMzone(0);
 			RefreshMzone(1);
 			RefreshSzone(0);
@@ -1098,22 +1125,22 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 		}
 		case MSG_CHAINING: {
 			pbuf += 16;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_CHAINED: {
 			pbuf++;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshMzone(0);
 			RefreshMzone(1);
 			RefreshSzone(0);
@@ -1124,22 +1151,22 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 		}
 		case MSG_CHAIN_SOLVING: {
 			pbuf++;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_CHAIN_SOLVED: {
 			pbuf++;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshMzone(0);
 			RefreshMzone(1);
 			RefreshSzone(0);
@@ -1149,12 +1176,12 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			break;
 		}
 		case MSG_CHAIN_END: {
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshMzone(0);
 			RefreshMzone(1);
 			RefreshSzone(0);
@@ -1165,22 +1192,22 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 		}
 		case MSG_CHAIN_NEGATED: {
 			pbuf++;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_CHAIN_DISABLED: {
 			pbuf++;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_CARD_SELECTED: {
@@ -1193,23 +1220,23 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			player = BufferIO::Read<uint8_t>(pbuf);
 			count = BufferIO::Read<uint8_t>(pbuf);
 			pbuf += count * 4;
-			NetServer::SendBufferToPlayer(players[player], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[player], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_BECOME_TARGET: {
 			count = BufferIO::Read<uint8_t>(pbuf);
 			pbuf += count * 4;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_DRAW: {
@@ -1224,160 +1251,161 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 				else
 					pbufw += 4;
 			}
+			auto packet = NetServer::CreatePacket(STOC_GAME_MSG, offset, pbuf - offset);
 			for(int i = 0; i < 4; ++i)
 				if(players[i] != cur_player[player])
-					NetServer::SendBufferToPlayer(players[i], STOC_GAME_MSG, offset, pbuf - offset);
+					NetServer::ReSendToPlayer(players[i], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_DAMAGE: {
 			pbuf += 5;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_RECOVER: {
 			pbuf += 5;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_EQUIP: {
 			pbuf += 8;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_LPUPDATE: {
 			pbuf += 5;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_UNEQUIP: {
 			pbuf += 4;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_CARD_TARGET: {
 			pbuf += 8;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_CANCEL_TARGET: {
 			pbuf += 8;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_PAY_LPCOST: {
 			pbuf += 5;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_ADD_COUNTER: {
 			pbuf += 7;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_REMOVE_COUNTER: {
 			pbuf += 7;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_ATTACK: {
 			pbuf += 8;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_BATTLE: {
 			pbuf += 26;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_ATTACK_DISABLED: {
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_DAMAGE_STEP_START: {
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshMzone(0);
 			RefreshMzone(1);
 			break;
 		}
 		case MSG_DAMAGE_STEP_END: {
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshMzone(0);
 			RefreshMzone(1);
 			break;
@@ -1392,24 +1420,24 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 			player = BufferIO::Read<uint8_t>(pbuf);
 			count = BufferIO::Read<uint8_t>(pbuf);
 			pbuf += count;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_TOSS_DICE: {
 			player = BufferIO::Read<uint8_t>(pbuf);
 			count = BufferIO::Read<uint8_t>(pbuf);
 			pbuf += count;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_ROCK_PAPER_SCISSORS: {
@@ -1420,12 +1448,12 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 		}
 		case MSG_HAND_RES: {
 			pbuf += 1;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for (auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_ANNOUNCE_RACE: {
@@ -1453,22 +1481,22 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 		}
 		case MSG_CARD_HINT: {
 			pbuf += 9;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_PLAYER_HINT: {
 			pbuf += 6;
-			NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
-			NetServer::ReSendToPlayer(players[1]);
-			NetServer::ReSendToPlayer(players[2]);
-			NetServer::ReSendToPlayer(players[3]);
+			auto packet = NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, offset, pbuf - offset);
+			NetServer::ReSendToPlayer(players[1], packet);
+			NetServer::ReSendToPlayer(players[2], packet);
+			NetServer::ReSendToPlayer(players[3], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			break;
 		}
 		case MSG_TAG_SWAP: {
@@ -1492,11 +1520,12 @@ int TagDuel::Analyze(unsigned char* msgbuffer, unsigned int len) {
 				else
 					pbufw += 4;
 			}
+			auto packet = NetServer::CreatePacket(STOC_GAME_MSG, offset, pbuf - offset);
 			for(int i = 0; i < 4; ++i)
 				if(players[i] != cur_player[player])
-					NetServer::SendBufferToPlayer(players[i], STOC_GAME_MSG, offset, pbuf - offset);
+					NetServer::ReSendToPlayer(players[i], packet);
 			for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-				NetServer::ReSendToPlayer(*oit);
+				NetServer::ReSendToPlayer(*oit, packet);
 			RefreshExtra(player);
 			RefreshMzone(0, 0x81fff, 0);
 			RefreshMzone(1, 0x81fff, 0);
@@ -1535,20 +1564,62 @@ void TagDuel::GetResponse(DuelPlayer* dp, unsigned char* pdata, unsigned int len
 void TagDuel::EndDuel() {
 	if(!pduel)
 		return;
-	last_replay.EndRecord();
-	char replaybuf[0x2000], *pbuf = replaybuf;
-	std::memcpy(pbuf, &last_replay.pheader, sizeof last_replay.pheader);
-	pbuf += sizeof last_replay.pheader;
-	std::memcpy(pbuf, last_replay.comp_data, last_replay.comp_size);
-	NetServer::SendBufferToPlayer(players[0], STOC_REPLAY, replaybuf, sizeof last_replay.pheader + last_replay.comp_size);
-	NetServer::ReSendToPlayer(players[1]);
-	NetServer::ReSendToPlayer(players[2]);
-	NetServer::ReSendToPlayer(players[3]);
-	for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-		NetServer::ReSendToPlayer(*oit);
-	end_duel(pduel);
+	std::vector<DuelPlayer*> recipients{ players[0], players[1], players[2], players[3] };
+	recipients.insert(recipients.end(), observers.begin(), observers.end());
+	NetServer::SendReplay(this, last_replay, recipients);
+	myend_duel(pduel);
 	event_del(etimer);
 	pduel = 0;
+	update_cache.Clear();
+	field_snapshot.clear();
+}
+/*
+* Send the field to an observer joining during the duel, followed by the usual message stream.
+* The snapshot is built once and shared by every observer joining before the field changes.
+*/
+void TagDuel::RequestField(DuelPlayer* dp) {
+	if(dp->type != NETPLAYER_TYPE_OBSERVER || !pduel)
+		return;
+	if(field_snapshot.empty()) {
+		// push pending changes first, the full queries below reset the query cache
+		observers.erase(dp);
+		for(int i = 0; i < 2; ++i) {
+			RefreshMzone(i);
+			RefreshSzone(i);
+			RefreshHand(i);
+			RefreshGrave(i);
+			RefreshExtra(i);
+		}
+		observers.insert(dp);
+		// the late observer never saw the records the refreshes compare against
+		update_cache.Clear();
+		unsigned char startbuf[32]{};
+		auto pbuf = startbuf;
+		BufferIO::Write<uint8_t>(pbuf, MSG_START);
+		BufferIO::Write<uint8_t>(pbuf, (players[0] == pplayer[0]) ? 0x10 : 0x11);
+		BufferIO::Write<uint8_t>(pbuf, host_info.duel_rule);
+		BufferIO::Write<int32_t>(pbuf, host_info.start_energy);
+		BufferIO::Write<int32_t>(pbuf, host_info.start_energy);
+		BufferIO::Write<uint16_t>(pbuf, query_field_count(pduel, 0, LOCATION_DECK));
+		BufferIO::Write<uint16_t>(pbuf, query_field_count(pduel, 0, LOCATION_ADECK));
+		BufferIO::Write<uint16_t>(pbuf, query_field_count(pduel, 1, LOCATION_DECK));
+		BufferIO::Write<uint16_t>(pbuf, query_field_count(pduel, 1, LOCATION_ADECK));
+		field_snapshot.push_back(NetServer::CreatePacket(STOC_DUEL_START));
+		field_snapshot.push_back(NetServer::CreatePacket(STOC_GAME_MSG, startbuf, 19));
+		std::vector<unsigned char> query_buffer(SIZE_QUERY_BUFFER);
+		int len = query_field_info(pduel, query_buffer.data());
+		field_snapshot.push_back(NetServer::CreatePacket(STOC_GAME_MSG, query_buffer.data(), len));
+		for(int i = 0; i < 2; ++i) {
+			field_snapshot.push_back(QueryObserverData(i, LOCATION_MZONE, 0xefffff));
+			field_snapshot.push_back(QueryObserverData(i, LOCATION_CALL, 0xefffff));
+			field_snapshot.push_back(QueryObserverData(i, LOCATION_HAND, 0x681fff));
+			field_snapshot.push_back(QueryObserverData(i, LOCATION_DROP, 0x81fff));
+			field_snapshot.push_back(QueryObserverData(i, LOCATION_VOID, 0x81fff));
+			field_snapshot.push_back(QueryObserverData(i, LOCATION_ADECK, 0xe81fff));
+		}
+	}
+	for(auto& packet : field_snapshot)
+		NetServer::ReSendToPlayer(dp, packet);
 }
 void TagDuel::WaitforResponse(int playerid) {
 	last_response = playerid;
@@ -1560,10 +1631,10 @@ void TagDuel::WaitforResponse(int playerid) {
 		STOC_TimeLimit sctl;
 		sctl.player = playerid;
 		sctl.left_time = time_limit[playerid];
-		NetServer::SendPacketToPlayer(players[0], STOC_TIME_LIMIT, sctl);
-		NetServer::ReSendToPlayer(players[1]);
-		NetServer::ReSendToPlayer(players[2]);
-		NetServer::ReSendToPlayer(players[3]);
+		auto packet = NetServer::SendPacketToPlayer(players[0], STOC_TIME_LIMIT, sctl);
+		NetServer::ReSendToPlayer(players[1], packet);
+		NetServer::ReSendToPlayer(players[2], packet);
+		NetServer::ReSendToPlayer(players[3], packet);
 		cur_player[playerid]->state = CTOS_TIME_CONFIRM;
 	} else
 		cur_player[playerid]->state = CTOS_RESPONSE;
@@ -1582,17 +1653,29 @@ inline int TagDuel::WriteUpdateData(int& player, int location, int& flag, unsign
 	BufferIO::Write<uint8_t>(qbuf, MSG_UPDATE_DATA);
 	BufferIO::Write<uint8_t>(qbuf, player);
 	BufferIO::Write<uint8_t>(qbuf, location);
+	StatsTimer timer(ServerStats::query_field);
 	int len = query_field_card(pduel, player, location, flag, qbuf, use_cache);
 	return len;
 }
+NetPacket TagDuel::QueryObserverData(int player, int location, int flag) {
+	std::vector<unsigned char> query_buffer;
+	query_buffer.resize(SIZE_QUERY_BUFFER);
+	auto qbuf = query_buffer.data();
+	int use_cache = 0;
+	auto len = WriteUpdateData(player, location, flag, qbuf, use_cache);
+	if(location != LOCATION_DROP)
+		HideQueryData(qbuf, len, location == LOCATION_HAND || location == LOCATION_ADECK);
+	return NetServer::CreatePacket(STOC_GAME_MSG, query_buffer.data(), len + 3);
+}
 void TagDuel::RefreshMzone(int player, int flag, int use_cache) {
 	std::vector<unsigned char> query_buffer;
 	query_buffer.resize(SIZE_QUERY_BUFFER);
 	auto qbuf = query_buffer.data();
 	auto len = WriteUpdateData(player, LOCATION_MZONE, flag, qbuf, use_cache);
 	int pid = (player == 0) ? 0 : 2;
-	NetServer::SendBufferToPlayer(players[pid], STOC_GAME_MSG, query_buffer.data(), len + 3);
-	NetServer::ReSendToPlayer(players[pid + 1]);
+	auto packet = update_cache.CreatePacket(UpdateCache::VIEW_OWNER, query_buffer.data(), len + 3);
+	packet.SendTo(players[pid]);
+	packet.SendTo(players[pid + 1]);
 	int qlen = 0;
 	while(qlen < len) {
 		int clen = BufferIO::Read<int32_t>(qbuf);
@@ -1605,10 +1688,11 @@ void TagDuel::RefreshMzone(int player, int flag, int use_cache) {
 		qbuf += clen - 4;
 	}
 	pid = 2 - pid;
-	NetServer::SendBufferToPlayer(players[pid], STOC_GAME_MSG, query_buffer.data(), len + 3);
-	NetServer::ReSendToPlayer(players[pid + 1]);
+	packet = update_cache.CreatePacket(UpdateCache::VIEW_PUBLIC, query_buffer.data(), len + 3);
+	packet.SendTo(players[pid]);
+	packet.SendTo(players[pid + 1]);
 	for(auto pit = observers.begin(); pit != observers.end(); ++pit)
-		NetServer::ReSendToPlayer(*pit);
+		packet.SendTo(*pit);
 }
 void TagDuel::RefreshSzone(int player, int flag, int use_cache) {
 	std::vector<unsigned char> query_buffer;
@@ -1616,8 +1700,9 @@ void TagDuel::RefreshSzone(int player, int flag, int use_cache) {
 	auto qbuf = query_buffer.data();
 	auto len = WriteUpdateData(player, LOCATION_CALL, flag, qbuf, use_cache);
 	int pid = (player == 0) ? 0 : 2;
-	NetServer::SendBufferToPlayer(players[pid], STOC_GAME_MSG, query_buffer.data(), len + 3);
-	NetServer::ReSendToPlayer(players[pid + 1]);
+	auto packet = update_cache.CreatePacket(UpdateCache::VIEW_OWNER, query_buffer.data(), len + 3);
+	packet.SendTo(players[pid]);
+	packet.SendTo(players[pid + 1]);
 	int qlen = 0;
 	while(qlen < len) {
 		int clen = BufferIO::Read<int32_t>(qbuf);
@@ -1630,17 +1715,18 @@ void TagDuel::RefreshSzone(int player, int flag, int use_cache) {
 		qbuf += clen - 4;
 	}
 	pid = 2 - pid;
-	NetServer::SendBufferToPlayer(players[pid], STOC_GAME_MSG, query_buffer.data(), len + 3);
-	NetServer::ReSendToPlayer(players[pid + 1]);
+	packet = update_cache.CreatePacket(UpdateCache::VIEW_PUBLIC, query_buffer.data(), len + 3);
+	packet.SendTo(players[pid]);
+	packet.SendTo(players[pid + 1]);
 	for(auto pit = observers.begin(); pit != observers.end(); ++pit)
-		NetServer::ReSendToPlayer(*pit);
+		packet.SendTo(*pit);
 }
 void TagDuel::RefreshHand(int player, int flag, int use_cache) {
 	std::vector<unsigned char> query_buffer;
 	query_buffer.resize(SIZE_QUERY_BUFFER);
 	auto qbuf = query_buffer.data();
 	auto len = WriteUpdateData(player, LOCATION_HAND, flag, qbuf, use_cache);
-	NetServer::SendBufferToPlayer(cur_player[player], STOC_GAME_MSG, query_buffer.data(), len + 3);
+	update_cache.CreatePacket(UpdateCache::VIEW_OWNER, query_buffer.data(), len + 3).SendTo(cur_player[player]);
 	int qlen = 0;
 	while(qlen < len) {
 		int slen = BufferIO::Read<int32_t>(qbuf);
@@ -1652,32 +1738,35 @@ void TagDuel::RefreshHand(int player, int flag, int use_cache) {
 			std::memset(qbuf, 0, slen - 4);
 		qbuf += slen - 4;
 	}
+	auto packet = update_cache.CreatePacket(UpdateCache::VIEW_PUBLIC, query_buffer.data(), len + 3);
 	for(int i = 0; i < 4; ++i)
 		if(players[i] != cur_player[player])
-			NetServer::SendBufferToPlayer(players[i], STOC_GAME_MSG, query_buffer.data(), len + 3);
+			packet.SendTo(players[i]);
 	for(auto pit = observers.begin(); pit != observers.end(); ++pit)
-		NetServer::ReSendToPlayer(*pit);
+		packet.SendTo(*pit);
 }
 void TagDuel::RefreshGrave(int player, int flag, int use_cache) {
 	std::vector<unsigned char> query_buffer;
 	query_buffer.resize(SIZE_QUERY_BUFFER);
 	auto qbuf = query_buffer.data();
 	auto len = WriteUpdateData(player, LOCATION_DROP, flag, qbuf, use_cache);
-	NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, query_buffer.data(), len + 3);
-	NetServer::ReSendToPlayer(players[1]);
-	NetServer::ReSendToPlayer(players[2]);
-	NetServer::ReSendToPlayer(players[3]);
+	auto packet = update_cache.CreatePacket(UpdateCache::VIEW_PUBLIC, query_buffer.data(), len + 3);
+	packet.SendTo(players[0]);
+	packet.SendTo(players[1]);
+	packet.SendTo(players[2]);
+	packet.SendTo(players[3]);
 	for(auto pit = observers.begin(); pit != observers.end(); ++pit)
-		NetServer::ReSendToPlayer(*pit);
+		packet.SendTo(*pit);
 }
 void TagDuel::RefreshExtra(int player, int flag, int use_cache) {
 	std::vector<unsigned char> query_buffer;
 	query_buffer.resize(SIZE_QUERY_BUFFER);
 	auto qbuf = query_buffer.data();
 	auto len = WriteUpdateData(player, LOCATION_ADECK, flag, qbuf, use_cache);
-	NetServer::SendBufferToPlayer(cur_player[player], STOC_GAME_MSG, query_buffer.data(), len + 3);
+	update_cache.CreatePacket(UpdateCache::VIEW_OWNER, query_buffer.data(), len + 3).SendTo(cur_player[player]);
 }
 void TagDuel::RefreshSingle(int player, int location, int sequence, int flag) {
+	update_cache.Invalidate(player, location);
 	flag |= (QUERY_CODE | QUERY_POSITION);
 	unsigned char query_buffer[0x1000];
 	auto qbuf = query_buffer;
@@ -1689,27 +1778,27 @@ void TagDuel::RefreshSingle(int player, int location, int sequence, int flag) {
 	auto position = GetPosition(qbuf, 12);
 	if(location & LOCATION_FIELD) {
 		int pid = (player == 0) ? 0 : 2;
-		NetServer::SendBufferToPlayer(players[pid], STOC_GAME_MSG, query_buffer, len + 4);
-		NetServer::ReSendToPlayer(players[pid + 1]);
+		auto packet = NetServer::SendBufferToPlayer(players[pid], STOC_GAME_MSG, query_buffer, len + 4);
+		NetServer::ReSendToPlayer(players[pid + 1], packet);
 		if(position & FACE_UP) {
 			pid = 2 - pid;
-			NetServer::SendBufferToPlayer(players[pid], STOC_GAME_MSG, query_buffer, len + 4);
-			NetServer::ReSendToPlayer(players[pid + 1]);
+			packet = NetServer::SendBufferToPlayer(players[pid], STOC_GAME_MSG, query_buffer, len + 4);
+			NetServer::ReSendToPlayer(players[pid + 1], packet);
 			for(auto pit = observers.begin(); pit != observers.end(); ++pit)
-				NetServer::ReSendToPlayer(*pit);
+				NetServer::ReSendToPlayer(*pit, packet);
 		}
 	} else {
 		int pid = (player == 0) ? 0 : 2;
-		NetServer::SendBufferToPlayer(players[pid], STOC_GAME_MSG, query_buffer, len + 4);
-		NetServer::ReSendToPlayer(players[pid + 1]);
+		auto packet = NetServer::SendBufferToPlayer(players[pid], STOC_GAME_MSG, query_buffer, len + 4);
+		NetServer::ReSendToPlayer(players[pid + 1], packet);
 		if(location == LOCATION_VOID && (position & FACE_DOWN))
 			return;
 		if (location & 0x90) {
 			for(int i = 0; i < 4; ++i)
 				if(players[i] != cur_player[player])
-					NetServer::ReSendToPlayer(players[i]);
+					NetServer::ReSendToPlayer(players[i], packet);
 			for(auto pit = observers.begin(); pit != observers.end(); ++pit)
-				NetServer::ReSendToPlayer(*pit);
+				NetServer::ReSendToPlayer(*pit, packet);
 		}
 	}
 }
@@ -1730,10 +1819,10 @@ void TagDuel::TagTimer(evutil_socket_t fd, short events, void* arg) {
 		wbuf[0] = MSG_WIN;
 		wbuf[1] = 1 - player;
 		wbuf[2] = 0x3;
-		NetServer::SendBufferToPlayer(sd->players[0], STOC_GAME_MSG, wbuf, 3);
-		NetServer::ReSendToPlayer(sd->players[1]);
-		NetServer::ReSendToPlayer(sd->players[2]);
-		NetServer::ReSendToPlayer(sd->players[3]);
+		auto packet = NetServer::SendBufferToPlayer(sd->players[0], STOC_GAME_MSG, wbuf, 3);
+		NetServer::ReSendToPlayer(sd->players[1], packet);
+		NetServer::ReSendToPlayer(sd->players[2], packet);
+		NetServer::ReSendToPlayer(sd->players[3], packet);
 		sd->EndDuel();
 		sd->DuelEndProc();
 		event_del(sd->etimer);
@@ -0,0 +1,149 @@
+#include "update_cache.h"
+
+namespace ygo {
+
+/*
+* msg: MSG_UPDATE_DATA, player, location, records
+* The delta is empty if no record changed.
+*/
+UpdatePacket UpdateCache::CreatePacket(int view, const unsigned char* msg, int len) {
+	const int player = msg[1];
+	const int location = msg[2];
+	auto& last = records[GetKey(view, player, location)];
+	std::vector<std::pair<const unsigned char*, int>> current;
+	const unsigned char* pbuf = msg + 3;
+	const unsigned char* end = msg + len;
+	while (end - pbuf >= 4) {
+		int32_t clen = 0;
+		std::memcpy(&clen, pbuf, sizeof clen);
+		if (clen < 4 || clen > end - pbuf)
+			break;
+		current.emplace_back(pbuf, clen);
+		pbuf += clen;
+	}
+	// a location that grew or shrank is sent in full
+	bool full = last.size() != current.size() || current.size() > 0xff;
+	delta.clear();
+	int count = 0;
+	if (!full) {
+		delta.push_back(MSG_UPDATE_DELTA);
+		delta.push_back((unsigned char)player);
+		delta.push_back((unsigned char)location);
+		delta.push_back(0);
+		for (size_t i = 0; i < current.size(); ++i) {
+			const auto& record = current[i];
+			if (last[i].size() == (size_t)record.second && !std::memcmp(last[i].data(), record.first, record.second))
+				continue;
+			delta.push_back((unsigned char)i);
+			delta.insert(delta.end(), record.first, record.first + record.second);
+			++count;
+		}
+		delta[3] = (unsigned char)count;
+	}
+	last.resize(current.size());
+	for (size_t i = 0; i < current.size(); ++i)
+		last[i].assign(current[i].first, current[i].first + current[i].second);
+	if (full || delta.size() >= (size_t)len)
+		return UpdatePacket(msg, len, NetServer::CreatePacket(STOC_GAME_MSG, msg, len), true);
+	if (!count)
+		return UpdatePacket(msg, len, NetPacket(), false);
+	return UpdatePacket(msg, len, NetServer::CreatePacket(STOC_GAME_MSG, delta.data(), delta.size()), false);
+}
+/*
+* Called for every core message before it is sent.
+* msg: the message, starting with its type
+*/
+void UpdateCache::CheckMessage(const unsigned char* msg) {
+	switch (msg[0]) {
+	case MSG_MOVE: {
+		int pc = msg[5];
+		int pl = msg[6];
+		int cc = msg[9];
+		int cl = msg[10];
+		Invalidate(pc, (pl & LOCATION_GENE) ? LOCATION_MZONE : pl);
+		Invalidate(cc, (cl & LOCATION_GENE) ? LOCATION_MZONE : cl);
+		break;
+	}
+	case MSG_POS_CHANGE:
+	case MSG_SET: {
+		Invalidate(msg[5], msg[6]);
+		break;
+	}
+	// these do not change the cards on the clients
+	case MSG_RETRY:
+	case MSG_HINT:
+	case MSG_WAITING:
+	case MSG_WIN:
+	case MSG_MATCH_KILL:
+	case MSG_NEW_TURN:
+	case MSG_NEW_PHASE:
+	case MSG_SUMMONING:
+	case MSG_SUMMONED:
+	case MSG_SPSUMMONING:
+	case MSG_SPSUMMONED:
+	case MSG_FLIPSUMMONED:
+	case MSG_CHAINED:
+	case MSG_CHAIN_SOLVING:
+	case MSG_CHAIN_SOLVED:
+	case MSG_CHAIN_END:
+	case MSG_CHAIN_NEGATED:
+	case MSG_CHAIN_DISABLED:
+	case MSG_CARD_SELECTED:
+	case MSG_RANDOM_SELECTED:
+	case MSG_BECOME_TARGET:
+	case MSG_CARD_TARGET:
+	case MSG_CANCEL_TARGET:
+	case MSG_EQUIP:
+	case MSG_UNEQUIP:
+	case MSG_DAMAGE:
+	case MSG_RECOVER:
+	case MSG_LPUPDATE:
+	case MSG_PAY_LPCOST:
+	case MSG_ADD_COUNTER:
+	case MSG_REMOVE_COUNTER:
+	case MSG_ATTACK:
+	case MSG_ATTACK_DISABLED:
+	case MSG_DAMAGE_STEP_START:
+	case MSG_DAMAGE_STEP_END:
+	case MSG_MISSED_EFFECT:
+	case MSG_TOSS_COIN:
+	case MSG_TOSS_DICE:
+	case MSG_ROCK_PAPER_SCISSORS:
+	case MSG_HAND_RES:
+	case MSG_ANNOUNCE_RACE:
+	case MSG_ANNOUNCE_ATTRIB:
+	case MSG_ANNOUNCE_CARD:
+	case MSG_ANNOUNCE_NUMBER:
+	case MSG_CARD_HINT:
+	case MSG_PLAYER_HINT:
+	case MSG_FIELD_DISABLED:
+	case MSG_SELECT_BATTLECMD:
+	case MSG_SELECT_IDLECMD:
+	case MSG_SELECT_EFFECTYN:
+	case MSG_SELECT_YESNO:
+	case MSG_SELECT_OPTION:
+	case MSG_SELECT_CARD:
+	case MSG_SELECT_UNSELECT_CARD:
+	case MSG_SELECT_CHAIN:
+	case MSG_SELECT_PLACE:
+	case MSG_SELECT_DISFIELD:
+	case MSG_SELECT_FACE:
+	case MSG_SELECT_TRIBUTE:
+	case MSG_SELECT_COUNTER:
+	case MSG_SELECT_SUM:
+	case MSG_SORT_CARD:
+		break;
+	default:
+		Clear();
+		break;
+	}
+}
+void UpdateCache::Invalidate(int player, int location) {
+	records.erase(GetKey(VIEW_OWNER, player, location));
+	records.erase(GetKey(VIEW_PUBLIC, player, location));
+}
+void UpdateCache::Clear() {
+	records.clear();
+}
+
+}
@@ -0,0 +1,70 @@
+#ifndef UPDATE_CACHE_H
+#define UPDATE_CACHE_H
+
+#include <map>
+#include <vector>
+#include "config.h"
+#include "netserver.h"
+
+namespace ygo {
+
+/*
+* A refresh for both kinds of client: the delta for the ones that sent CTOS_UPDATE_DELTA, the full message for the others.
+* The full packet is built for the first client that needs it, the message must not change before it is sent.
+*/
+class UpdatePacket {
+public:
+	UpdatePacket(const unsigned char* msg, int len, NetPacket delta_packet, bool is_full)
+		: msg(msg), len(len), delta(std::move(delta_packet)) {
+		if (is_full)
+			full = delta;
+	}
+	void SendTo(DuelPlayer* dp) {
+		if (!dp)
+			return;
+		if (dp->update_delta) {
+			NetServer::ReSendToPlayer(dp, delta);
+			return;
+		}
+		if (!full)
+			full = NetServer::CreatePacket(STOC_GAME_MSG, msg, len);
+		NetServer::ReSendToPlayer(dp, full);
+	}
+
+private:
+	const unsigned char* msg;
+	int len;
+	// empty if no record changed
+	NetPacket delta;
+	NetPacket full;
+};
+
+/*
+* The MSG_UPDATE_DATA records last sent to each view of the field.
+* A refresh only carries the records that changed since then, as MSG_UPDATE_DELTA.
+* Messages that let the clients change cards on their own invalidate the records they touch.
+*/
+class UpdateCache {
+public:
+	// the player the location belongs to, with hidden cards visible
+	static constexpr int VIEW_OWNER = 0;
+	// everyone else
+	static constexpr int VIEW_PUBLIC = 1;
+
+	UpdatePacket CreatePacket(int view, const unsigned char* msg, int len);
+	void CheckMessage(const unsigned char* msg);
+	void Invalidate(int player, int location);
+	void Clear();
+
+private:
+	static uint32_t GetKey(int view, int player, int location) {
+		return (view << 16) | (player << 8) | location;
+	}
+
+	std::map<uint32_t, std::vector<std::vector<unsigned char>>> records;
+	std::vector<unsigned char> delta;
+};
+
+}
+
+#endif //UPDATE_CACHE_H